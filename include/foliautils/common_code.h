@@ -31,7 +31,9 @@
 
 #include "ticcutils/XMLtools.h"
 #include "ticcutils/Unicode.h"
+#include "libxml/xmlreader.h"
 #include <string>
+#include <list>
 
 extern const int XML_PARSER_OPTIONS;
 
@@ -43,6 +45,38 @@ enum zipType { NORMAL, GZ, BZ2, UNKNOWN };
 
 xmlDoc *getXml( const std::string& , zipType& );
 
+class xml_element_stream {
+  /// read the elements with a given local name from an XML file one by one,
+  /// using an xmlTextReader, so the complete document is never in memory.
+  /// Every element is returned as a private copy. The previous element and
+  /// the next one are kept too, and they are linked as siblings exactly when
+  /// they are siblings in the file, so code that looks at node->next (or
+  /// holds on to a node of the previous element) works as on the full tree.
+public:
+  xml_element_stream( const std::string&, const std::string& );
+  ~xml_element_stream();
+  xml_element_stream( const xml_element_stream& ) = delete;
+  xml_element_stream& operator=( const xml_element_stream& ) = delete;
+  bool good() const { return _reader != 0 && !_error; };
+  zipType type() const { return _type; };
+  xmlNode *next();
+private:
+  xmlNode *read_element( bool& );
+  std::string _name;
+  std::string _buffer;
+  zipType _type;
+  xmlTextReader *_reader;
+  xmlDoc *_window;
+  xmlNode *_current;
+  int _depth;
+  bool _skip;
+  bool _error;
+};
+
+std::list<xmlNode*> child_nodes( const xmlNode *, const std::string& );
+xmlNode *first_child( const xmlNode *, const std::string& );
+std::list<xmlNode*> find_nodes( const xmlNode *, const std::string& );
+
 bool isalnum( UChar uc );
 bool isalpha( UChar uc );
 bool ispunct( UChar uc );
@@ -0,0 +1,226 @@
+/* ex: set tabstop=8 expandtab: */
+/*
+  Copyright (c) 2006 - 2024
+  CLST  - Radboud University
+  ILK   - Tilburg University
+
+  This file is part of foliautils
+
+  foliautils is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 3 of the License, or
+  (at your option) any later version.
+
+  foliautils is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+  For questions and suggestions, see:
+      https://github.com/LanguageMachines/foliautils/issues
+  or send mail to:
+      lamasoftware (at ) science.ru.nl
+
+*/
+
+#ifndef MAPPED_LEXICON_H
+#define MAPPED_LEXICON_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+
+// A compiled lexicon is one read-only file that can be mmap-ed as is.
+// Layout:
+//   header | bucket seeds | entry slots | suggestions | string pool | filter
+// The entry slots form a perfect hash table over all keys: every key is
+// found with exactly one probe. Non-matching keys are rejected by comparing
+// the key stored in the slot.
+// The filter is a Bloom filter over the tokens of all keys, so a user can
+// reject most words without touching the slots at all.
+// A lexicon that is built from text files can also be published as a
+// shared_lexicon: the first process builds the image in shared memory, all
+// later processes map that same image.
+
+const char LEXICON_MAGIC[8] = { 'F','L','X','L','E','X','\0','\0' };
+const uint32_t LEXICON_VERSION = 3;
+
+// n-gram keys are tokens joined with this separator
+const char LEXICON_SEPARATOR = '_';
+
+// entry flags
+const uint32_t LEX_VARIANT = 1;  // the key has 1 or more suggestions
+const uint32_t LEX_UNKNOWN = 2;  // the key is a known UNK
+const uint32_t LEX_VALUE   = 4;  // the key has a replacement value (puncts)
+
+struct lexicon_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t ngram_size;   // the n-gram size the lexicon was compiled for
+  uint32_t num_sugg;     // the maximum number of suggestions per key
+  uint32_t reserved;
+  uint64_t key_count;
+  uint64_t bucket_count;
+  uint64_t slot_count;
+  uint64_t suggestion_count;
+  uint64_t pool_size;
+  uint64_t seeds_offset;
+  uint64_t slots_offset;
+  uint64_t suggestions_offset;
+  uint64_t pool_offset;
+  uint64_t file_size;
+  uint64_t source_stamp; // identifies the sources of a shared_lexicon
+  uint64_t filter_offset;
+  uint64_t filter_blocks;
+};
+
+struct lexicon_entry {
+  uint64_t key_offset;
+  uint64_t value_offset;
+  uint64_t first_suggestion;
+  uint32_t key_length;
+  uint32_t value_length;
+  uint32_t suggestion_count;
+  uint32_t flags;            // 0 for an empty slot
+};
+
+struct lexicon_suggestion {
+  uint64_t word_offset;
+  uint32_t word_length;
+  float confidence;
+};
+
+struct alignas(64) filter_block {
+  uint64_t bits[8];
+};
+
+class lexicon_filter {
+  /// a blocked Bloom filter. All bits of a token are in the same 64 byte
+  /// block, so a query touches at most one cache line. At 12 bits per token
+  /// about 1% of the absent tokens pass.
+  /// The blocks are either owned, or a view on a mapped lexicon.
+public:
+  lexicon_filter(): _blocks(0), _mask(0) {};
+  lexicon_filter( const lexicon_filter& ) = delete;
+  lexicon_filter& operator=( const lexicon_filter& ) = delete;
+  void init( size_t );
+  void add( std::string_view );
+  void add_tokens( std::string_view );
+  void attach( const filter_block *, size_t );
+  bool may_contain( std::string_view ) const;
+  bool empty() const { return _blocks == 0; };
+  size_t block_count() const { return _blocks ? _mask + 1 : 0; };
+  const filter_block *blocks() const { return _blocks; };
+private:
+  std::vector<filter_block> _own;
+  const filter_block *_blocks;
+  uint64_t _mask;
+};
+
+class lexicon_builder {
+  /// collects keys, suggestions and values and writes them as one
+  /// mmap-able lexicon file
+public:
+  lexicon_builder( size_t ngram, size_t nums ):
+    _ngram_size(ngram), _num_sugg(nums), _stamp(0) {};
+  void add_variant( const std::string&, const std::string&, float );
+  void add_unknown( const std::string& );
+  void add_value( const std::string&, const std::string& );
+  size_t size() const { return _keys.size(); };
+  void set_stamp( uint64_t stamp ) { _stamp = stamp; };
+  void save( const std::string& ) const;
+private:
+  struct key_rec {
+    uint64_t key_offset = 0;
+    uint64_t value_offset = 0;
+    uint32_t key_length = 0;
+    uint32_t value_length = 0;
+    uint32_t flags = 0;
+    std::vector<lexicon_suggestion> suggestions;
+  };
+  key_rec& get_key( const std::string& );
+  lexicon_suggestion intern( const std::string&, float );
+  uint64_t intern( const std::string& );
+  size_t _ngram_size;
+  size_t _num_sugg;
+  uint64_t _stamp;
+  std::string _pool;
+  std::unordered_map<std::string,uint64_t> _interned;
+  std::unordered_map<std::string,size_t> _index;
+  std::vector<key_rec> _keys;
+};
+
+class mapped_lexicon {
+  /// a read-only view on a compiled lexicon file, mapped into memory
+public:
+  mapped_lexicon();
+  ~mapped_lexicon();
+  mapped_lexicon( const mapped_lexicon& ) = delete;
+  mapped_lexicon& operator=( const mapped_lexicon& ) = delete;
+  void open( const std::string& );
+  void close();
+  bool is_open() const { return _header != 0; };
+  // these are 0 when no lexicon is open
+  size_t size() const { return _header ? _header->key_count : 0; };
+  size_t ngram_size() const { return _header ? _header->ngram_size : 0; };
+  size_t num_sugg() const { return _header ? _header->num_sugg : 0; };
+  uint64_t source_stamp() const {
+    return _header ? _header->source_stamp : 0;
+  };
+  const lexicon_entry *find( std::string_view ) const;
+  size_t slot_count() const { return _header ? _header->slot_count : 0; };
+  const lexicon_entry& slot( size_t i ) const { return _slots[i]; };
+  std::string_view key( const lexicon_entry& e ) const {
+    return std::string_view( _pool + e.key_offset, e.key_length );
+  };
+  std::string_view value( const lexicon_entry& e ) const {
+    return std::string_view( _pool + e.value_offset, e.value_length );
+  };
+  const lexicon_suggestion *suggestions( const lexicon_entry& e ) const {
+    return _suggestions + e.first_suggestion;
+  };
+  std::string_view word( const lexicon_suggestion& s ) const {
+    return std::string_view( _pool + s.word_offset, s.word_length );
+  };
+  const lexicon_filter& filter() const { return _filter; };
+private:
+  void *_map;
+  size_t _map_size;
+  const lexicon_header *_header;
+  const uint32_t *_seeds;
+  const lexicon_entry *_slots;
+  const lexicon_suggestion *_suggestions;
+  const char *_pool;
+  lexicon_filter _filter;
+};
+
+class shared_lexicon {
+  /// publishes a lexicon that is built from text files as a compiled
+  /// lexicon in shared memory, so concurrent processes that use the same
+  /// files map one copy instead of each parsing their own.
+  /// The image is stamped with the names, sizes and modification times of
+  /// the sources. When a source changes, the first process that notices
+  /// builds a new image; processes that still map the old one keep it.
+  /// The images live in $FOLIAUTILS_SHM_DIR, or else in /dev/shm or /tmp.
+public:
+  shared_lexicon( const std::string&,
+		  const std::vector<std::string>&,
+		  const std::string& = "" );
+  const std::string& file_name() const { return _file_name; };
+  bool attach( mapped_lexicon&,
+	       const std::function<void(lexicon_builder&)>&,
+	       size_t = 0,
+	       size_t = 0 ) const;
+private:
+  bool open_current( mapped_lexicon& ) const;
+  std::string _file_name;
+  uint64_t _stamp;
+};
+
+#endif // MAPPED_LEXICON_H
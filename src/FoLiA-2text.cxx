@@ -24,14 +24,21 @@
       lamasoftware (at ) science.ru.nl
 */
 
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <string>
 #include <vector>
+#include <set>
 #include <iostream>
 #include <fstream>
+#include "libxml/xmlreader.h"
 
 #include "ticcutils/CommandLine.h"
 #include "ticcutils/FileUtils.h"
 #include "ticcutils/StringOps.h"
+#include "ticcutils/Unicode.h"
+#include "ticcutils/zipper.h"
 #include "libfolia/folia.h"
 #include "foliautils/common_code.h"
 #include "config.h"
@@ -59,6 +66,12 @@ void usage( const string& name ){
   cerr << "\t-V or --version \t show version " << endl;
   cerr << "\t-e\t\t expr: specify the expression all input files should match with." << endl;
   cerr << "\t-o\t\t name of the output file(s) prefix." << endl;
+  cerr << "\t--dom\t\t always load the complete FoLiA document. Default is to" << endl;
+  cerr << "\t\t\t read simple documents as a stream, which is a lot faster." << endl;
+  cerr << "\t--corpus='name'\t don't create a .txt file per document, but append all" << endl;
+  cerr << "\t\t\t texts to a few shard files 'name'.N.txt, one per thread." << endl;
+  cerr << "\t\t\t The index 'name'.idx tells where each document is." << endl;
+  cerr << "\t--jsonl\t\t with --corpus: write the shards as JSON lines ('name'.N.jsonl)" << endl;
 }
 
 UnicodeString handle_token_tag( const folia::FoliaElement *d,
@@ -69,11 +82,497 @@ UnicodeString handle_token_tag( const folia::FoliaElement *d,
   return tmp_result;
 }
 
+// The fast path: extract the text of one class straight from the XML stream,
+// without building a FoLiA Document. It only handles the plain cases:
+// <text> with div, head, p, s and w structure, and <t> nodes that hold
+// normalized text, optionally with <br/> and <t-hbr>. For everything else
+// (corrections, markup, speech, strings, unknown nodes etc.) it gives up,
+// and the caller falls back to the full Document.
+
+const string FOLIA_NS = "http://ilk.uvt.nl/folia";
+
+const set<string> text_structure = { "text", "div", "head", "p", "s", "w" };
+// annotations which never contribute to the text: inline annotations,
+// alternatives, and the span and morphology layers
+const set<string> text_skip = { "pos", "lemma", "sense", "lang", "desc",
+				"comment", "metric", "feat", "alt",
+				"altlayers", "entities", "chunking",
+				"dependencies", "syntax", "timing",
+				"coreferences", "semroles", "sentiments",
+				"statements", "observations",
+				"spanrelations", "morphology", "phonology" };
+
+struct text_frame {
+  string tag;
+  UnicodeString own;       // the text of its own <t>
+  bool has_own = false;
+  UnicodeString deep;      // the combined text of the children
+  UnicodeString delimiter; // the delimiter after the last child in deep
+};
+
+UnicodeString text_delimiter( const string& tag ){
+  if ( tag == "w" || tag == "s" ){
+    return " ";
+  }
+  else if ( tag == "div" ){
+    return "\n\n\n";
+  }
+  return "\n\n";
+}
+
+string reader_attribute( xmlTextReaderPtr reader, const char *name ){
+  string result;
+  xmlChar *value = xmlTextReaderGetAttribute( reader, (const xmlChar*)name );
+  if ( value ){
+    result = (const char*)value;
+    xmlFree( value );
+  }
+  return result;
+}
+
+bool is_plain_text( const UnicodeString& value ){
+  /// check that value needs no whitespace normalization and holds no
+  /// special characters
+  if ( value.isEmpty()
+       || value[0] == ' '
+       || value[value.length()-1] == ' ' ){
+    return false;
+  }
+  for ( int i=0; i < value.length(); ++i ){
+    UChar c = value[i];
+    if ( c == ' ' ){
+      if ( value[i+1] == ' ' ){
+	return false;
+      }
+    }
+    else if ( u_isUWhiteSpace( c )
+	      || c == 0x00AD   // soft hyphen
+	      || ( c >= 0x200B && c <= 0x200D ) // zero width spaces and joiners
+	      || c == 0xFEFF ){
+      return false;
+    }
+  }
+  return true;
+}
+
+bool stream_t( xmlTextReaderPtr reader, UnicodeString& result ){
+  /// read the content of the <t> the reader is on
+  /// \return false when it is too complicated
+  if ( xmlTextReaderIsEmptyElement( reader ) ){
+    return false;
+  }
+  int depth = xmlTextReaderDepth( reader );
+  bool skip = false;
+  int ret;
+  while ( ( ret = ( skip ? xmlTextReaderNext( reader )
+		    : xmlTextReaderRead( reader ) ) ) == 1 ){
+    skip = false;
+    int type = xmlTextReaderNodeType( reader );
+    if ( type == XML_READER_TYPE_END_ELEMENT
+	 && xmlTextReaderDepth( reader ) == depth ){
+      break;
+    }
+    else if ( type == XML_READER_TYPE_TEXT
+	      || type == XML_READER_TYPE_CDATA ){
+      UnicodeString value = TiCC::UnicodeFromUTF8( (const char*)xmlTextReaderConstValue( reader ) );
+      if ( !is_plain_text( value ) ){
+	return false;
+      }
+      result += value;
+    }
+    else if ( type == XML_READER_TYPE_ELEMENT ){
+      const char *ns = (const char*)xmlTextReaderConstNamespaceUri( reader );
+      if ( !ns || ns != FOLIA_NS ){
+	return false;
+      }
+      string name = (const char*)xmlTextReaderConstLocalName( reader );
+      if ( name == "br" ){
+	if ( !xmlTextReaderIsEmptyElement( reader ) ){
+	  return false;
+	}
+	result += "\n";
+      }
+      else if ( name == "t-hbr" ){
+	// without formatting, a hyphenation break adds nothing
+	skip = true;
+      }
+      else {
+	return false;
+      }
+    }
+    else if ( type == XML_READER_TYPE_WHITESPACE
+	      || type == XML_READER_TYPE_SIGNIFICANT_WHITESPACE ){
+      return false;
+    }
+  }
+  if ( ret != 1
+       || result.isEmpty()
+       || result[0] == '\n'
+       || result[result.length()-1] == '\n' ){
+    return false;
+  }
+  return true;
+}
+
+bool close_frame( vector<text_frame>& stack, UnicodeString& result ){
+  /// add the text of the innermost structure element to its parent.
+  /// An element with its own text AND text in its children is only
+  /// accepted when both are the same
+  text_frame frame = stack.back();
+  stack.pop_back();
+  if ( frame.has_own
+       && !frame.deep.isEmpty()
+       && frame.own != frame.deep ){
+    return false;
+  }
+  UnicodeString value = frame.deep.isEmpty() ? frame.own : frame.deep;
+  if ( stack.empty() ){
+    result = value;
+  }
+  else if ( !value.isEmpty() ){
+    text_frame& parent = stack.back();
+    if ( !parent.deep.isEmpty() ){
+      parent.deep += parent.delimiter;
+    }
+    parent.deep += value;
+    parent.delimiter = text_delimiter( frame.tag );
+  }
+  return true;
+}
+
+bool stream_body( xmlTextReaderPtr reader,
+		  const string& class_name,
+		  string& doc_id,
+		  UnicodeString& result ){
+  vector<text_frame> stack;
+  bool seen_text = false;
+  bool skip = false;
+  int ret;
+  while ( ( ret = ( skip ? xmlTextReaderNext( reader )
+		    : xmlTextReaderRead( reader ) ) ) == 1 ){
+    skip = false;
+    int type = xmlTextReaderNodeType( reader );
+    if ( type == XML_READER_TYPE_ELEMENT ){
+      const char *ns = (const char*)xmlTextReaderConstNamespaceUri( reader );
+      if ( !ns || ns != FOLIA_NS ){
+	if ( stack.empty() && seen_text ){
+	  continue;
+	}
+	return false;
+      }
+      string name = (const char*)xmlTextReaderConstLocalName( reader );
+      bool empty = xmlTextReaderIsEmptyElement( reader );
+      if ( stack.empty() ){
+	if ( name == "FoLiA" ){
+	  xmlChar *id = xmlTextReaderGetAttributeNs( reader,
+						     (const xmlChar*)"id",
+						     XML_XML_NAMESPACE );
+	  if ( id ){
+	    doc_id = (const char*)id;
+	    xmlFree( id );
+	  }
+	}
+	else if ( name == "metadata" ){
+	  skip = true;
+	}
+	else if ( name == "text" && !seen_text ){
+	  seen_text = true;
+	  stack.push_back( text_frame() );
+	  stack.back().tag = name;
+	  if ( empty
+	       && !close_frame( stack, result ) ){
+	    return false;
+	  }
+	}
+	else {
+	  return false;
+	}
+      }
+      else if ( name == "t" ){
+	string cls = reader_attribute( reader, "class" );
+	if ( cls.empty() ){
+	  cls = "current";
+	}
+	if ( cls != class_name ){
+	  skip = true;
+	}
+	else if ( stack.back().has_own
+		  || !stream_t( reader, stack.back().own ) ){
+	  return false;
+	}
+	else {
+	  stack.back().has_own = true;
+	}
+      }
+      else if ( text_skip.find( name ) != text_skip.end() ){
+	skip = true;
+      }
+      else if ( name != "text"
+		&& text_structure.find( name ) != text_structure.end() ){
+	if ( name == "w"
+	     && !reader_attribute( reader, "space" ).empty() ){
+	  return false;
+	}
+	stack.push_back( text_frame() );
+	stack.back().tag = name;
+	if ( empty
+	     && !close_frame( stack, result ) ){
+	  return false;
+	}
+      }
+      else {
+	return false;
+      }
+    }
+    else if ( type == XML_READER_TYPE_END_ELEMENT ){
+      if ( !stack.empty()
+	   && !close_frame( stack, result ) ){
+	return false;
+      }
+    }
+    else if ( type == XML_READER_TYPE_TEXT
+	      || type == XML_READER_TYPE_CDATA ){
+      if ( !stack.empty() ){
+	// mixed content
+	return false;
+      }
+    }
+  }
+  return ret == 0 && seen_text && !result.isEmpty();
+}
+
+void silent_reader_error( void *, const char *,
+			  xmlParserSeverities, xmlTextReaderLocatorPtr ){
+  // errors are reported when the Document is loaded
+}
+
+bool stream_text( const string& file_name,
+		  const string& class_name,
+		  string& doc_id,
+		  UnicodeString& result ){
+  /// try to extract the text of class 'class_name' from file_name, without
+  /// building a Document.
+  /// \param file_name the FoLiA file. May be gzip or bzip2 compressed
+  /// \param class_name the text class to extract
+  /// \param doc_id returns the xml:id of the document
+  /// \param result returns the text
+  /// \return false when the document has constructs we can't handle here,
+  /// or when there is no text. The caller should use the Document then.
+  string buffer;
+  xmlTextReaderPtr reader;
+  if ( TiCC::match_back( file_name, ".bz2" ) ){
+    buffer = TiCC::bz2ReadFile( file_name );
+    reader = xmlReaderForMemory( buffer.c_str(), buffer.length(),
+				 0, 0, XML_PARSE_HUGE );
+  }
+  else {
+    // gzip is handled by the reader
+    reader = xmlReaderForFile( file_name.c_str(), 0, XML_PARSE_HUGE );
+  }
+  if ( !reader ){
+    return false;
+  }
+  xmlTextReaderSetErrorHandler( reader, silent_reader_error, 0 );
+  bool ok = stream_body( reader, class_name, doc_id, result );
+  xmlFreeTextReader( reader );
+  if ( !ok ){
+    doc_id.clear();
+    result.remove();
+  }
+  return ok;
+}
+
+// A corpus index is one binary file:
+//   header | entries | string pool
+// Every entry tells in which shard a document is stored, at which byte
+// offset and with which length in bytes. For plain text shards, this is the
+// text of the document. For JSONL shards it is the complete JSON line.
+// The trailing newline is never included.
+
+const char INDEX_MAGIC[8] = { 'F','L','2','T','I','D','X','\0' };
+const uint32_t INDEX_VERSION = 1;
+
+struct index_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t shard_count;
+  uint64_t doc_count;
+  uint64_t entries_offset;
+  uint64_t pool_offset;
+  uint64_t pool_size;
+};
+
+struct index_entry {
+  uint64_t id_offset;    // the xml:id of the Document, in the pool
+  uint64_t file_offset;  // the name of the input file, in the pool
+  uint32_t id_length;
+  uint32_t file_length;
+  uint32_t shard;
+  uint32_t reserved;
+  uint64_t offset;
+  uint64_t length;
+};
+
+string json_escape( const string& in ){
+  /// escape a UTF-8 string for use as a JSON string value
+  string result;
+  result.reserve( in.size() + 16 );
+  for ( const auto c : in ){
+    switch ( c ){
+    case '"':
+      result += "\\\"";
+      break;
+    case '\\':
+      result += "\\\\";
+      break;
+    case '\n':
+      result += "\\n";
+      break;
+    case '\r':
+      result += "\\r";
+      break;
+    case '\t':
+      result += "\\t";
+      break;
+    default:
+      if ( static_cast<unsigned char>(c) < 0x20 ){
+	char buf[8];
+	snprintf( buf, sizeof(buf), "\\u%04x", c );
+	result += buf;
+      }
+      else {
+	result += c;
+      }
+    }
+  }
+  return result;
+}
+
+class shard_writer {
+  /// appends documents to one shard of the corpus.
+  /// Every thread owns a shard_writer, so no locking is needed
+public:
+  shard_writer(): _shard(0), _written(0), _jsonl(false) {};
+  bool open( const string&, uint32_t, bool );
+  void add( const string&, const string&, const UnicodeString& );
+  bool flush();
+  bool close();
+  const string& name() const { return _name; };
+  const vector<index_entry>& entries() const { return _entries; };
+  const string& pool() const { return _pool; };
+private:
+  string _name;
+  ofstream _os;
+  string _buffer;
+  string _pool;
+  vector<index_entry> _entries;
+  uint32_t _shard;
+  uint64_t _written;
+  bool _jsonl;
+};
+
+const size_t shard_buffer_size = 4*1024*1024;
+
+bool shard_writer::open( const string& name, uint32_t shard, bool jsonl ){
+  _name = name;
+  _os.open( name, ios::binary );
+  _shard = shard;
+  _jsonl = jsonl;
+  return _os.good();
+}
+
+void shard_writer::add( const string& id,
+			const string& file,
+			const UnicodeString& text ){
+  /// append the text of document 'id' from 'file' to the buffer, and
+  /// remember where it went
+  index_entry entry;
+  entry.id_offset = _pool.size();
+  entry.id_length = id.size();
+  _pool += id;
+  entry.file_offset = _pool.size();
+  entry.file_length = file.size();
+  _pool += file;
+  entry.shard = _shard;
+  entry.reserved = 0;
+  entry.offset = _written + _buffer.size();
+  string utf8 = TiCC::UnicodeToUTF8( text );
+  if ( _jsonl ){
+    string line = "{\"id\":\"" + json_escape( id )
+      + "\",\"file\":\"" + json_escape( file )
+      + "\",\"text\":\"" + json_escape( utf8 ) + "\"}";
+    entry.length = line.size();
+    _buffer += line;
+  }
+  else {
+    entry.length = utf8.size();
+    _buffer += utf8;
+  }
+  _buffer += "\n";
+  _entries.push_back( entry );
+  if ( _buffer.size() >= shard_buffer_size ){
+    flush();
+  }
+}
+
+bool shard_writer::flush(){
+  /// write the buffer to the shard
+  /// \return false when the shard can't be written. Once that happened,
+  /// it stays false, because the offsets in the index would be wrong
+  if ( !_buffer.empty() && _os.good() ){
+    _os.write( _buffer.data(), _buffer.size() );
+    _written += _buffer.size();
+    _buffer.clear();
+  }
+  return _os.good();
+}
+
+bool shard_writer::close(){
+  /// flush and close the shard
+  /// \return false when not all documents made it to the disk
+  flush();
+  _os.close();
+  return !_os.fail();
+}
+
+bool write_index( const string& name, vector<shard_writer>& shards ){
+  /// collect the entries of all shards in one index file.
+  /// The entries are ordered by shard, and within a shard by offset
+  index_header header;
+  memset( &header, 0, sizeof(header) );
+  memcpy( header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC) );
+  header.version = INDEX_VERSION;
+  header.shard_count = shards.size();
+  for ( const auto& sh : shards ){
+    header.doc_count += sh.entries().size();
+    header.pool_size += sh.pool().size();
+  }
+  header.entries_offset = sizeof(header);
+  header.pool_offset = header.entries_offset
+    + header.doc_count * sizeof(index_entry);
+  ofstream os( name, ios::binary );
+  os.write( reinterpret_cast<const char*>(&header), sizeof(header) );
+  uint64_t pool_base = 0;
+  for ( const auto& sh : shards ){
+    for ( auto entry : sh.entries() ){
+      entry.id_offset += pool_base;
+      entry.file_offset += pool_base;
+      os.write( reinterpret_cast<const char*>(&entry), sizeof(entry) );
+    }
+    pool_base += sh.pool().size();
+  }
+  for ( const auto& sh : shards ){
+    os.write( sh.pool().data(), sh.pool().size() );
+  }
+  os.close();
+  return !os.fail();
+}
+
 int main( int argc, char *argv[] ){
   TiCC::CL_Options opts( "hVvpe:t:o:c:",
 			 "class:,help,version,retaintok,threads:,"
 			 "restore-formatting,"
-			 "honour-tags,correction-handling:" );
+			 "honour-tags,correction-handling:,corpus:,jsonl,dom" );
   try {
     opts.init(argc,argv);
   }
@@ -100,9 +599,17 @@ int main( int argc, char *argv[] ){
     exit(EXIT_SUCCESS);
   }
   opts.extract( 'o', outputPrefix );
+  string corpus_name;
+  opts.extract( "corpus", corpus_name );
+  bool jsonl = opts.extract( "jsonl" );
+  if ( jsonl && corpus_name.empty() ){
+    cerr << "option --jsonl is only valid together with --corpus" << endl;
+    exit( EXIT_FAILURE );
+  }
   bool retaintok = opts.extract( "retaintok" );
   bool restore = opts.extract( "restore-formatting" );
   bool honour_tags = opts.extract( "honour-tags" );
+  bool use_dom = opts.extract( "dom" );
   CORRECTION_HANDLING ch = CORRECTION_HANDLING::CURRENT;
   string handling;
   opts.extract( "correction-handling", handling );
@@ -185,64 +692,109 @@ int main( int argc, char *argv[] ){
     cout << "start processing of " << toDo << " files " << endl;
   }
 
+  vector<shard_writer> shards;
+  if ( !corpus_name.empty() ){
+    size_t num_shards = 1;
+#ifdef HAVE_OPENMP
+    num_shards = omp_get_max_threads();
+#endif
+    shards = vector<shard_writer>( num_shards );
+    for ( size_t i=0; i < num_shards; ++i ){
+      string shard_name = outputPrefix + corpus_name + "."
+	+ TiCC::toString( i ) + ( jsonl ? ".jsonl" : ".txt" );
+      if ( !shards[i].open( shard_name, i, jsonl ) ){
+	cerr << "Output to '" << shard_name << "' is impossible" << endl;
+	exit( EXIT_FAILURE );
+      }
+    }
+  }
+
 #pragma omp parallel for shared(fileNames) schedule(dynamic)
   for ( size_t fn=0; fn < fileNames.size(); ++fn ){
     string docName = fileNames[fn];
     Document *d = 0;
-    try {
-      d = new Document( "file='"+ docName + "'" );
-    }
-    catch ( exception& e ){
+    string doc_id;
+    UnicodeString us;
+    // formatting, tag handling and debugging need the full Document
+    bool streamed = !use_dom
+      && !restore
+      && !honour_tags
+      && verbosity == 0
+      && stream_text( docName, class_name, doc_id, us );
+    if ( !streamed ){
+      try {
+	d = new Document( "file='"+ docName + "'" );
+      }
+      catch ( exception& e ){
 #pragma omp critical
-      {
-	cerr << "failed to load document '" << docName << "'" << endl;
-	cerr << "reason: " << e.what() << endl;
+	{
+	  cerr << "failed to load document '" << docName << "'" << endl;
+	  cerr << "reason: " << e.what() << endl;
+	}
+	continue;
       }
-      continue;
+      doc_id = d->id();
+    }
+    string outname;
+    if ( shards.empty() ){
+      outname = outputPrefix + TiCC::basename(docName) + ".txt";
+    }
+    else {
+      outname = outputPrefix + corpus_name;
     }
-    string outname = outputPrefix + TiCC::basename(docName) + ".txt";
-    if ( !TiCC::createPath( outname ) ){
+    if ( shards.empty()
+	 && !TiCC::createPath( outname ) ){
 #pragma omp critical
       {
 	cerr << "Output to '" << outname << "' is impossible" << endl;
       }
     }
     else {
-      folia::TextPolicy tp( class_name );
-      if ( retaintok ){
-	tp.set( folia::TEXT_FLAGS::RETAIN );
-      }
-      if ( restore ){
-	tp.set( folia::TEXT_FLAGS::ADD_FORMATTING );
-      }
-      tp.set_correction_handling( ch );
-      tp.set_debug( verbosity > 0 );
-      if ( honour_tags ){
-	tp.add_handler("token", &handle_token_tag );
-      }
-      UnicodeString us;
-      try {
-	us = d->text( tp );
-      }
-      catch( ... ){
-	cout << "document '" << docName << "' contains no text in class="
-	     << class_name << endl;
-      }
-      if ( honour_tags ){
-	UnicodeString out;
-	for ( int i=0; i < us.length(); ++i ){
-	  if ( us[i] == ZWJ ){
-	    out += " ";
-	  }
-	  else {
-	    out += us[i];
+      if ( !streamed ){
+	folia::TextPolicy tp( class_name );
+	if ( retaintok ){
+	  tp.set( folia::TEXT_FLAGS::RETAIN );
+	}
+	if ( restore ){
+	  tp.set( folia::TEXT_FLAGS::ADD_FORMATTING );
+	}
+	tp.set_correction_handling( ch );
+	tp.set_debug( verbosity > 0 );
+	if ( honour_tags ){
+	  tp.add_handler("token", &handle_token_tag );
+	}
+	try {
+	  us = d->text( tp );
+	}
+	catch( ... ){
+	  cout << "document '" << docName << "' contains no text in class="
+	       << class_name << endl;
+	}
+	if ( honour_tags ){
+	  UnicodeString out;
+	  for ( int i=0; i < us.length(); ++i ){
+	    if ( us[i] == ZWJ ){
+	      out += " ";
+	    }
+	    else {
+	      out += us[i];
+	    }
 	  }
+	  us = out;
 	}
-	us = out;
       }
       if ( !us.isEmpty() ){
-	ofstream os( outname );
-	os << us << endl;
+	if ( shards.empty() ){
+	  ofstream os( outname );
+	  os << us << endl;
+	}
+	else {
+	  int thread = 0;
+#ifdef HAVE_OPENMP
+	  thread = omp_get_thread_num();
+#endif
+	  shards[thread].add( doc_id, docName, us );
+	}
       }
 #pragma omp critical
       {
@@ -252,5 +804,24 @@ int main( int argc, char *argv[] ){
     }
     delete d;
   }
+  if ( !shards.empty() ){
+    bool shards_ok = true;
+    for ( auto& sh : shards ){
+      if ( !sh.close() ){
+	cerr << "failed to write the shard '" << sh.name() << "'" << endl;
+	shards_ok = false;
+      }
+    }
+    if ( !shards_ok ){
+      // an index of an incomplete corpus is worse than none
+      return EXIT_FAILURE;
+    }
+    string index_name = outputPrefix + corpus_name + ".idx";
+    if ( !write_index( index_name, shards ) ){
+      cerr << "failed to write the index '" << index_name << "'" << endl;
+      return EXIT_FAILURE;
+    }
+    cout << "corpus index stored in: " << index_name << endl;
+  }
   return EXIT_SUCCESS;
 }
@@ -179,7 +179,7 @@ UnicodeString get_text( const xmlNode *node ){
 
 UnicodeString get_line( xmlNode *line ){
   UnicodeString result;
-  list<xmlNode*> variants = TiCC::FindNodes( line, "*:wordRecVariants" );
+  list<xmlNode*> variants = child_nodes( line, "wordRecVariants" );
   if ( !variants.empty() ){
     if ( verbose ){
 #pragma omp critical
@@ -188,7 +188,7 @@ UnicodeString get_line( xmlNode *line ){
       }
     }
     for ( const auto& var : variants ){
-      list<xmlNode*> recs = TiCC::FindNodes( var, "*:wordRecVariant" );
+      list<xmlNode*> recs = child_nodes( var, "wordRecVariant" );
       if ( recs.empty() ){
 	// hapens sometimes, just skip..
       }
@@ -199,7 +199,7 @@ UnicodeString get_line( xmlNode *line ){
 	    cout << "\t\t\t\tfound " << recs.size() << " wordRecVariant nodes" << endl;
 	  }
 	}
-	list<xmlNode*> text = TiCC::FindNodes( recs.front(), "*:variantText" );
+	list<xmlNode*> text = child_nodes( recs.front(), "variantText" );
 	if ( verbose ){
 #pragma omp critical
 	  {
@@ -223,7 +223,7 @@ UnicodeString get_line( xmlNode *line ){
     }
   }
   else {
-    list<xmlNode*> chars = TiCC::FindNodes( line, "*:charParams" );
+    list<xmlNode*> chars = child_nodes( line, "charParams" );
     if ( verbose ){
 #pragma omp critical
       {
@@ -335,21 +335,17 @@ void update_formatting_info( formatting_info& line_font,
 }
 
 struct line_info {
-  line_info():
-    _line(0)
-  {};
   UnicodeString _value;
   formatting_info _fi;
-  xmlNode *_line;
   UnicodeString _hyph;
   UnicodeString _spaces;
 };
 
-void process_line( xmlNode *block,
+void process_line( const xmlNode *block,
 		   vector<line_info>& line_parts,
 		   const formatting_info& default_format,
 		   const map<string,formatting_info>& font_styles ){
-  list<xmlNode*> formats = TiCC::FindNodes( block, "*:formatting" );
+  list<xmlNode*> formats = child_nodes( block, "formatting" );
   if ( verbose ){
 #pragma omp critical
     {
@@ -365,7 +361,6 @@ void process_line( xmlNode *block,
     if ( !uresult.isEmpty() || !hyph.isEmpty() ){
       line_info li;
       li._value = uresult;
-      li._line = block;
       li._fi = line_format;
       li._hyph = hyph;
       UnicodeString tmp = uresult;
@@ -527,22 +522,47 @@ void append_metric( folia::Paragraph *root,
   root->add_child<folia::Metric>( args );
 }
 
-bool process_paragraph( folia::Paragraph *paragraph,
-			xmlNode *par,
-			const map<string,formatting_info>& font_styles ){
+struct par_data {
+  /// all that is needed from an ABBYY par to convert it. It is collected
+  /// from the XML first, so pages can be read in parallel
+  par_data(): is_item(false) {};
+  string style;
+  string align;
+  bool is_item;
+  map<string,string> first_char; // the attributes of the first charParams
+  map<string,string> last_char;  // the attributes of the last charParams
+  vector<vector<line_info>> lines;
+};
+
+list<xmlNode*> line_chars( const xmlNode *line ){
+  /// the charParams of a line, at any formatting node below it.
+  /// Like the XPath "*/*:charParams"
+  list<xmlNode*> result;
+  for ( const xmlNode *pnt = line->children; pnt; pnt = pnt->next ){
+    if ( pnt->type == XML_ELEMENT_NODE ){
+      result.splice( result.end(), child_nodes( pnt, "charParams" ) );
+    }
+  }
+  return result;
+}
+
+par_data analyse_paragraph( const xmlNode *par,
+			    const map<string,formatting_info>& font_styles ){
+  par_data result;
+  result.style = TiCC::getAttribute( par, "style" );
+  result.align = TiCC::getAttribute( par, "align" );
   formatting_info par_font;
   try {
-    string par_style = TiCC::getAttribute( par, "style" );
-    if ( !par_style.empty() ){
-      par_font = font_styles.at(par_style);
+    if ( !result.style.empty() ){
+      par_font = font_styles.at(result.style);
     }
   }
   catch ( const out_of_range& ){
     // continue
   }
   string item = TiCC::getAttribute( par, "isListItem" );
-  bool is_item = ( item == "1" );
-  list<xmlNode*> lines = TiCC::FindNodes( par, "*:line" );
+  result.is_item = ( item == "1" );
+  list<xmlNode*> lines = child_nodes( par, "line" );
   if ( verbose ){
 #pragma omp critical
     {
@@ -550,24 +570,36 @@ bool process_paragraph( folia::Paragraph *paragraph,
     }
   }
   if ( lines.empty() ){
-    return false;
+    return result;
   }
-
   if ( add_metrics ){
-    // add the metrics for the first charParam of the first line
+    // keep the attributes of the first charParam of the first line
     // and the last charParam of the last line
-    // First the charParams of the first line
-    list<xmlNode *> chrs = TiCC::FindNodes( lines.front(), "*/*:charParams" );
-    // get the attributes of the first charParam
-    map<string,string> atts = TiCC::getAttributes( chrs.front() );
+    list<xmlNode *> chrs = line_chars( lines.front() );
+    if ( !chrs.empty() ){
+      result.first_char = TiCC::getAttributes( chrs.front() );
+    }
+    chrs = line_chars( lines.back() );
+    if ( !chrs.empty() ){
+      result.last_char = TiCC::getAttributes( chrs.back() );
+    }
+  }
+  for ( const auto& line : lines ){
+    result.lines.push_back( vector<line_info>() );
+    process_line( line, result.lines.back(), par_font, font_styles );
+  }
+  return result;
+}
+
+void process_paragraph( folia::Paragraph *paragraph,
+			const par_data& data ){
+  if ( add_metrics ){
+    map<string,string> atts = data.first_char;
     append_metric( paragraph, "first_char_top", atts["t"] );
     append_metric( paragraph, "first_char_left", atts["l"] );
     append_metric( paragraph, "first_char_right", atts["r"] );
     append_metric( paragraph, "first_char_bottom", atts["b"] );
-    // Then the charParams of the last line
-    chrs = TiCC::FindNodes( lines.back(), "*/*:charParams" );
-    // get the attributes of the last charParam
-    atts = TiCC::getAttributes( chrs.back() );
+    atts = data.last_char;
     append_metric( paragraph, "last_char_top", atts["t"] );
     append_metric( paragraph, "last_char_left", atts["l"] );
     append_metric( paragraph, "last_char_right", atts["r"] );
@@ -579,9 +611,7 @@ bool process_paragraph( folia::Paragraph *paragraph,
   folia::FoliaElement *root
     = paragraph->add_child<folia::TextContent>( text_args);
   bool previous_hyphen = false;
-  for ( const auto& line : lines ){
-    vector<line_info> line_parts;
-    process_line( line, line_parts, par_font, font_styles );
+  for ( const auto& line_parts : data.lines ){
     bool no_break = false;
     //    cerr << "\tstart process parts: " << endl;
     folia::TextMarkupString *container = 0;
@@ -616,7 +646,7 @@ bool process_paragraph( folia::Paragraph *paragraph,
       previous_hyphen = false;
       if ( !it._hyph.isEmpty() ){
 	// check if we have a hyphenation
-	if ( is_item ){
+	if ( data.is_item ){
 	  // list items are special. KEEP the hyphen!
 	  value = "- " + value;
 	  add_value( content, value );
@@ -654,52 +684,55 @@ bool process_paragraph( folia::Paragraph *paragraph,
       //      cerr << "textcontent now: " << root << endl;
     }
   }
-  return true;
 }
 
-bool process_page( folia::FoliaElement *root,
-		   xmlNode *block,
-		   const map<string,formatting_info>& font_styles ){
-  list<xmlNode*> paragraphs = TiCC::FindNodes( block, ".//*:par" );
-  if ( verbose ){
-#pragma omp critical
-    {
-      cout << "\tfound " << paragraphs.size() << " paragraphs" << endl;
-    }
+bool process_par( folia::FoliaElement *root,
+		  const par_data& data ){
+  /// add a Paragraph for an analysed ABBYY par to root
+  /// \return false when the par has no lines. Then nothing is added
+  folia::KWargs args;
+  args["generate_id"] = root->id();
+  folia::Paragraph *paragraph = root->add_child<folia::Paragraph>( args );
+  if ( !data.style.empty() ){
+    args.clear();
+    args["subset"] = "par_style";
+    args["class"] = data.style;
+    paragraph->add_child<folia::Feature>( args );
+  }
+  if ( !data.align.empty() ){
+    args.clear();
+    args["subset"] = "par_align";
+    args["class"] = data.align;
+    paragraph->add_child<folia::Feature>( args );
+  }
+  if ( data.lines.empty() ){
+    destroy( paragraph );
+    return false;
   }
-  bool didit = false;
-  for ( const auto& par_node : paragraphs ){
-    folia::KWargs args;
-    args["generate_id"] = root->id();
-    folia::Paragraph *paragraph = root->add_child<folia::Paragraph>( args );
-    string style = TiCC::getAttribute( par_node, "style" );
-    if ( !style.empty() ){
-      args.clear();
-      args["subset"] = "par_style";
-      args["class"] = style;
-      paragraph->add_child<folia::Feature>( args );
-    }
-    string align = TiCC::getAttribute( par_node, "align" );
-    if ( !align.empty() ){
-      args.clear();
-      args["subset"] = "par_align";
-      args["class"] = align;
-      paragraph->add_child<folia::Feature>( args );
+  process_paragraph( paragraph, data );
+  return true;
+}
+
+void find_pars( const xmlNode *node, vector<par_data>& pars,
+		const map<string,formatting_info>& font_styles ){
+  /// analyse all par nodes below node, in document order
+  for ( const xmlNode *pnt = node->children; pnt; pnt = pnt->next ){
+    if ( pnt->type != XML_ELEMENT_NODE ){
+      continue;
     }
-    if ( process_paragraph( paragraph, par_node, font_styles ) ){
-      didit = true;
+    if ( TiCC::Name( pnt ) == "par" ){
+      pars.push_back( analyse_paragraph( pnt, font_styles ) );
     }
     else {
-      destroy( paragraph );
+      find_pars( pnt, pars, font_styles );
     }
   }
-  return didit;
 }
 
-map<string,formatting_info> extract_formatting_info( xmlNode *root ){
-  map<string,formatting_info> result;
-  list<xmlNode*> par_styles =
-    TiCC::FindNodes( root, ".//*:paragraphStyles/*:paragraphStyle" );
+void extract_formatting_info( xmlNode *styles,
+			      map<string,formatting_info>& result ){
+  /// add the fontStyles of a paragraphStyles node to result
+  list<xmlNode*> par_styles = child_nodes( styles, "paragraphStyle" );
   map<string,string> main_font_styles;
   for ( const auto& ps : par_styles ){
     string pid = TiCC::getAttribute( ps, "id" );
@@ -738,23 +771,95 @@ map<string,formatting_info> extract_formatting_info( xmlNode *root ){
       cerr << "surprise for " << font_id << " ==> "<< font_name << endl;
     }
   }
-  return result;
 }
 
+class page_batch {
+  /// a number of ABBYY pages, that are analysed in parallel and then added
+  /// to the document in order
+public:
+  explicit page_batch( const map<string,formatting_info>& styles ):
+    _styles( styles ),
+    _doc( 0 ),
+    _max( 2 )
+  {
+#ifdef HAVE_OPENMP
+    _max = 2 * omp_get_max_threads();
+#endif
+  }
+  ~page_batch(){
+    if ( _doc ){
+      xmlFreeDoc( _doc );
+    }
+  }
+  page_batch( const page_batch& ) = delete;
+  page_batch& operator=( const page_batch& ) = delete;
+  bool add( const xmlNode *page ){
+    /// keep a copy of page
+    /// \return true when the batch is full
+    if ( !_doc ){
+      _doc = xmlNewDoc( (const xmlChar*)"1.0" );
+      xmlDocSetRootElement( _doc,
+			    xmlNewDocNode( _doc, 0, (const xmlChar*)"batch", 0 ) );
+    }
+    xmlNode *copy = xmlDocCopyNode( const_cast<xmlNode*>(page), _doc, 1 );
+    xmlAddChild( xmlDocGetRootElement( _doc ), copy );
+    _pages.push_back( copy );
+    return _pages.size() >= _max;
+  }
+  void flush( folia::Text *text, folia::KWargs& div_args ){
+    /// analyse the pages in parallel, then add a Division per page to text
+    vector<vector<par_data>> analysed( _pages.size() );
+    for ( size_t i=0; i < _pages.size(); ++i ){
+#pragma omp task shared(analysed) firstprivate(i)
+      find_pars( _pages[i], analysed[i], _styles );
+    }
+#pragma omp taskwait
+    for ( const auto& pars : analysed ){
+      div_args["generate_id"] = text->id();
+      folia::Division *div = text->add_child<folia::Division>( div_args );
+      for ( const auto& par : pars ){
+	process_par( div, par );
+      }
+    }
+    _pages.clear();
+    if ( _doc ){
+      xmlFreeDoc( _doc );
+      _doc = 0;
+    }
+  }
+private:
+  const map<string,formatting_info>& _styles;
+  xmlDoc *_doc;
+  vector<xmlNode*> _pages;
+  size_t _max;
+};
+
 bool convert_abbyxml( const string& fileName,
 		      const string& outputDir,
 		      const zipType outputType,
 		      const string& prefix,
 		      const string& command ){
+  /// convert an ABBYY file, reading it as a stream. The pages are collected
+  /// in small batches, that are converted and released as soon as they are
+  /// full, so memory use does not grow with the size of the input.
+  /// (The FoLiA result is still built in memory)
   if ( verbose ){
 #pragma omp critical
     {
       cout << "start handling " << fileName << endl;
     }
   }
-  zipType inputType;
-  xmlDoc *xdoc = getXml( fileName, inputType );
-  if ( !xdoc ){
+  zipType inputType = UNKNOWN;
+  if ( TiCC::match_back( fileName, ".xml" ) ){
+    inputType = NORMAL;
+  }
+  else if ( TiCC::match_back( fileName, ".xml.gz" ) ){
+    inputType = GZ;
+  }
+  else if ( TiCC::match_back( fileName, ".xml.bz2" ) ){
+    inputType = BZ2;
+  }
+  else {
 #pragma omp critical
     {
       cerr << "problem detecting type of file: " << fileName << endl;
@@ -762,22 +867,23 @@ bool convert_abbyxml( const string& fileName,
     }
     return false;
   }
-  xmlNode *root = xmlDocGetRootElement( xdoc );
-  list<xmlNode*> pages = TiCC::FindNodes( root, ".//*:page" );
-  if ( pages.empty() ){
-#pragma omp critical
-    {
-      cerr << "Problem finding pages node in " << fileName << endl;
-    }
-    return false;
+  string buffer;
+  xmlTextReader *reader = 0;
+  if ( inputType == BZ2 ){
+    buffer = TiCC::bz2ReadFile( fileName );
+    reader = xmlReaderForMemory( buffer.c_str(), buffer.length(),
+				 0, 0, XML_PARSER_OPTIONS );
   }
-  else if ( verbose ){
+  else {
+    reader = xmlReaderForFile( fileName.c_str(), 0, XML_PARSER_OPTIONS );
+  }
+  if ( !reader ){
 #pragma omp critical
     {
-      cout << "found " << pages.size() << " page nodes" << endl;
+      cerr << "unable to read " << fileName << endl;
     }
+    return false;
   }
-  map<string,formatting_info> font_styles = extract_formatting_info( root );
   string orgFile = TiCC::basename( fileName );
   string docid = orgFile.substr( 0, orgFile.find(".") );
   docid = prefix + docid;
@@ -802,15 +908,71 @@ bool convert_abbyxml( const string& fileName,
   if ( add_breaks ){
     doc.declare( folia::AnnotationType::LINEBREAK, setname, args );
   }
-  xmlNode *docinfo = TiCC::xPath( root, "//*:paragraphStyles" );
-  if ( docinfo ){
-    doc.set_foreign_metadata( docinfo );
+  // the paragraphStyles are in the documentData, before the first page
+  map<string,formatting_info> font_styles;
+  bool styles_seen = false;
+  bool metadata_done = false;
+  size_t page_count = 0;
+  page_batch batch( font_styles );
+  bool skip = false;
+  int ret;
+  while ( ( ret = ( skip ? xmlTextReaderNext( reader )
+		    : xmlTextReaderRead( reader ) ) ) == 1 ){
+    skip = false;
+    if ( xmlTextReaderNodeType( reader ) != XML_READER_TYPE_ELEMENT ){
+      continue;
+    }
+    string name = (const char*)xmlTextReaderConstLocalName( reader );
+    if ( name == "paragraphStyles" ){
+      xmlNode *styles = xmlTextReaderExpand( reader );
+      if ( !styles ){
+	break;
+      }
+      extract_formatting_info( styles, font_styles );
+      if ( !styles_seen ){
+	doc.set_foreign_metadata( styles );
+	styles_seen = true;
+      }
+      skip = true;
+    }
+    else if ( name == "page" ){
+      if ( !metadata_done ){
+	doc.set_metadata( "abby_file", orgFile );
+	metadata_done = true;
+      }
+      xmlNode *page = xmlTextReaderExpand( reader );
+      if ( !page ){
+	break;
+      }
+      ++page_count;
+      if ( batch.add( page ) ){
+	batch.flush( text, args );
+      }
+      // continue after this page. The reader frees it
+      skip = true;
+    }
+  }
+  batch.flush( text, args );
+  xmlFreeTextReader( reader );
+  if ( ret != 0 ){
+#pragma omp critical
+    {
+      cerr << "unable to read " << fileName << endl;
+    }
+    return false;
   }
-  doc.set_metadata( "abby_file", orgFile );
-  for ( const auto& page : pages ){
-    args["generate_id"] = text->id();
-    folia::Division *div = text->add_child<folia::Division>( args );
-    process_page( div, page, font_styles );
+  if ( page_count == 0 ){
+#pragma omp critical
+    {
+      cerr << "Problem finding pages node in " << fileName << endl;
+    }
+    return false;
+  }
+  else if ( verbose ){
+#pragma omp critical
+    {
+      cout << "found " << page_count << " page nodes" << endl;
+    }
   }
 
   string outName;
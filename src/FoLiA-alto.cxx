@@ -25,14 +25,28 @@
 
 */
 
+#include <cerrno>
 #include <cstdio> // remove()
+#include <cstring>
 #include <string>
 #include <list>
+#include <map>
+#include <deque>
+#include <memory>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 #include <iostream>
 #include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
 #include "libfolia/folia.h"
 #include "ticcutils/XMLtools.h"
 #include "ticcutils/StringOps.h"
@@ -55,9 +69,121 @@ bool clearCachedFiles = false;
 string setname = "FoLia-alto-set";
 string classname = "OCR";
 string prefix = "FA-";
-string processor_id;
+size_t fetch_workers = 4;
+size_t alto_budget = 1024; // MB of parsed ALTO documents to keep
+
+class alto_store {
+  /// a process-wide cache of parsed ALTO documents, shared by all threads.
+  /// A document is parsed once, and pinned by a reference count while it
+  /// is in use. Unpinned documents are kept for the next user, until the
+  /// total size exceeds the budget: then the least recently used ones are
+  /// freed. The size of a parsed document is estimated from its file size.
+public:
+  explicit alto_store( size_t budget ): _budget(budget), _bytes(0) {};
+  ~alto_store();
+  xmlDoc *acquire( const string&, bool& );
+  void release( const string& );
+private:
+  struct entry {
+    xmlDoc *doc = 0;
+    size_t bytes = 0;
+    int refs = 0;
+    bool loading = true;
+    list<string>::iterator lru;
+  };
+  void evict();
+  size_t _budget;
+  size_t _bytes;
+  mutex _mutex;
+  condition_variable _loaded;
+  unordered_map<string,entry> _docs;
+  list<string> _lru; // the unpinned documents, most recently used first
+};
+
+alto_store::~alto_store(){
+  for ( const auto& it : _docs ){
+    if ( it.second.doc ){
+      xmlFreeDoc( it.second.doc );
+    }
+  }
+}
+
+xmlDoc *alto_store::acquire( const string& file, bool& cached ){
+  /// return the parsed document for file, and pin it. Returns 0 when it
+  /// can't be read. cached tells whether it was already parsed
+  unique_lock<mutex> lock( _mutex );
+  auto it = _docs.find( file );
+  if ( it != _docs.end() ){
+    // maybe another thread is parsing it right now
+    _loaded.wait( lock, [&](){
+	it = _docs.find( file );
+	return it == _docs.end() || !it->second.loading; } );
+  }
+  if ( it != _docs.end() ){
+    entry& e = it->second;
+    if ( e.refs++ == 0 ){
+      _lru.erase( e.lru );
+    }
+    cached = true;
+    return e.doc;
+  }
+  cached = false;
+  _docs[file];
+  lock.unlock();
+  xmlDoc *doc = xmlReadFile( file.c_str(), 0, XML_PARSER_OPTIONS );
+  size_t bytes = 0;
+  if ( doc ){
+    ifstream is( file, ios::binary | ios::ate );
+    // a libxml2 tree takes roughly 4 times the size of the file
+    bytes = 4 * static_cast<size_t>( is.tellg() );
+  }
+  lock.lock();
+  if ( !doc ){
+    _docs.erase( file );
+  }
+  else {
+    entry& e = _docs[file];
+    e.doc = doc;
+    e.bytes = bytes;
+    e.refs = 1;
+    e.loading = false;
+    _bytes += bytes;
+  }
+  _loaded.notify_all();
+  return doc;
+}
+
+void alto_store::release( const string& file ){
+  /// unpin the document for file. It stays available until the budget
+  /// is exceeded
+  lock_guard<mutex> lock( _mutex );
+  auto it = _docs.find( file );
+  if ( it != _docs.end() && --it->second.refs == 0 ){
+    _lru.push_front( file );
+    it->second.lru = _lru.begin();
+    evict();
+  }
+}
+
+void alto_store::evict(){
+  while ( _bytes > _budget * 1024 * 1024 && !_lru.empty() ){
+    string file = _lru.back();
+    _lru.pop_back();
+    auto it = _docs.find( file );
+    _bytes -= it->second.bytes;
+    xmlFreeDoc( it->second.doc );
+    _docs.erase( it );
+  }
+}
+
+alto_store& parsed_altos(){
+  static alto_store the_store( alto_budget );
+  return the_store;
+}
 
 class docCache {
+  /// the ALTO documents used for one article. They are taken from (and
+  /// pinned in) the process-wide alto_store
 public:
   ~docCache() { clear(); };
   void clear();
@@ -65,26 +191,36 @@ public:
   void add( const string&, const string& );
   xmlDoc *find( const string& ) const;
   unordered_map<string, xmlDoc*> cache;
+private:
+  string _dir;
 };
 
 void docCache::clear(){
   for ( const auto& it : cache ){
-    xmlFreeDoc( it.second );
+    parsed_altos().release( _dir + it.first );
   }
+  cache.clear();
 }
 
 void docCache::add( const string& dir, const string& f ){
   if ( cache.find( f ) == cache.end() ){
+    _dir = dir;
     string file = dir + f;
     ifstream is( file );
     if ( is ){
+      bool cached = false;
+      xmlDoc *xmldoc = parsed_altos().acquire( file, cached );
       if ( verbose ){
 #pragma omp critical
 	{
-	  cout << "open file " << file << endl;
+	  if ( cached ){
+	    cout << "found " << f << " in cache." << endl;
+	  }
+	  else {
+	    cout << "open file " << file << endl;
+	  }
 	}
       }
-      xmlDoc *xmldoc = xmlReadFile( file.c_str(), 0, XML_PARSER_OPTIONS );
       if ( xmldoc ){
 	cache[f] = xmldoc;
       }
@@ -183,6 +319,7 @@ xmlNode *findPart2Block( const xmlNode *start ){
 
 void addStr( folia::Paragraph *par, UnicodeString& txt,
 	     const xmlNode *pnt, const string& altoFile,
+	     const string& processor_id,
 	     bool do_strings,
 	     int cnt = 1 ){
   folia::KWargs atts = folia::getAttributes( pnt );
@@ -266,132 +403,160 @@ void addStr( folia::Paragraph *par, UnicodeString& txt,
   }
 }
 
+void convertBlock( folia::Paragraph *p,
+		   const xmlNode *node,
+		   const string& altoFile,
+		   const string& processor_id,
+		   const xmlNode *& keepPart1,
+		   bool do_strings ){
+  /// add the Strings of the TextBlock node to paragraph p
+  /// \param altoFile the reference for the Relations. Empty in direct mode
+  /// \param keepPart1 the first part of a hyphenated word, that is still
+  /// waiting for its second part. Possibly in the TextBlock before this one
+  UnicodeString ocr_text;
+  list<xmlNode*> lv = TiCC::FindNodes( node, "*[local-name()='TextLine']" );
+  int cnt = 0;
+  for ( const auto *line : lv ){
+    xmlNode *pnt = line->children;
+    while ( pnt ){
+      if ( pnt->type == XML_ELEMENT_NODE ){
+	if ( TiCC::Name(pnt) == "String" ){
+	  string sub_t = TiCC::getAttribute( pnt, "SUBS_TYPE" );
+	  if ( sub_t == "HypPart2" ){
+	    if ( keepPart1 == 0 ){
+	      addStr( p, ocr_text, pnt, altoFile, processor_id, do_strings, ++cnt );
+	    }
+	    else {
+	      folia::KWargs atts = folia::getAttributes( keepPart1 );
+	      string kid = atts["ID"];
+	      string sub_c = atts["SUBS_CONTENT"];
+	      UnicodeString subc = TiCC::UnicodeFromUTF8( sub_c );
+	      folia::KWargs sub_args;
+	      string id_arg = p->id() + ".";
+	      if ( !kid.empty() ){
+		id_arg += kid;
+	      }
+	      else {
+		id_arg += "String_" + TiCC::toString(++cnt);
+	      }
+	      sub_args["xml:id"] = id_arg;
+	      sub_args["class"] = classname;
+	      folia::FoliaElement *s;
+	      if ( do_strings ){
+		s = p->add_child<folia::String>( sub_args );
+	      }
+	      else {
+		s = p->add_child<folia::Word>( sub_args );
+	      }
+	      s->setutext( subc,
+			   ocr_text.length(),
+			   classname );
+	      ocr_text += " " + subc;
+	      if ( !altoFile.empty() ){
+		folia::KWargs rel_args;
+		rel_args["processor"] = processor_id;
+		p->doc()->declare( folia::AnnotationType::RELATION,
+				   setname, rel_args );
+		rel_args.clear();
+		rel_args["xlink:href"] = altoFile;
+		folia::Relation *h = s->add_child<folia::Relation>( rel_args );
+		rel_args.clear();
+		rel_args["id"] = kid;
+		rel_args["type"] = "str";
+		h->add_child<folia::LinkReference>( rel_args );
+		rel_args["id"] = TiCC::getAttribute( pnt, "ID" );
+		h->add_child<folia::LinkReference>( rel_args );
+	      }
+	      keepPart1 = 0;
+	    }
+	    pnt = pnt->next;
+	    continue;
+	  }
+	  else if ( sub_t == "HypPart1" ){
+	    // see if there is a Part2 in next line at this level.
+	    const xmlNode *part2 = findPart2Level( line );
+	    if ( part2 ){
+	      keepPart1 = pnt;
+	      break; //continue with next TextLine
+	    }
+	    else {
+	      // no second part on this level. seek in the next TextBlock
+	      part2 = findPart2Block( node );
+	      if ( !part2 ){
+		// Ok. Just ignore this and take the CONTENT
+		addStr( p, ocr_text, pnt, altoFile, processor_id, do_strings );
+	      }
+	      else {
+		keepPart1 = pnt;
+		break; //continue with next TextLine, but this should
+		// be empty, so in fact we go to the next block
+	      }
+	    }
+	  }
+	  else {
+	    addStr( p, ocr_text, pnt, altoFile, processor_id, do_strings, ++cnt );
+	  }
+	}
+      }
+      pnt = pnt->next;
+    }
+  }
+  if ( !ocr_text.isEmpty() )
+    p->setutext( ocr_text.tempSubString(1), classname );
+}
+
+folia::Paragraph *addParagraph( folia::FoliaElement *text,
+				const string& id,
+				const string& altoFile,
+				const string& processor_id,
+				set<string>& ids ){
+  /// add a Paragraph for the TextBlock with ID id to text
+  /// \return the new Paragraph, or 0 when the ID was seen before
+  if ( ids.find(id) != ids.end() ){
+    if ( verbose ){
+#pragma omp critical
+      {
+	cout << "skip duplicate ID " << id << endl;
+      }
+    }
+    return 0;
+  }
+  ids.insert(id);
+  folia::KWargs p_args;
+  p_args["processor"] = processor_id;
+  text->doc()->declare( folia::AnnotationType::PARAGRAPH, setname, p_args );
+  string arg = text->id() + ".p.";
+  if ( !altoFile.empty() ){
+    arg += altoFile + ".";
+  }
+  arg += id;
+  p_args["xml:id"] = arg;
+  return text->add_child<folia::Paragraph>( p_args );
+}
+
 void createFile( folia::FoliaElement *text,
 		 xmlDoc *alt_doc,
 		 const string& altoFile,
+		 const string& processor_id,
 		 const list<xmlNode*>& textblocks,
 		 bool do_strings ){
   xmlNode *root = xmlDocGetRootElement( alt_doc );
-  xmlNode *keepPart1 = 0;
+  const xmlNode *keepPart1 = 0;
   set<string> ids;
   for ( const auto& block : textblocks ){
     string id = TiCC::getAttribute( block, "ID" );
-    if ( ids.find(id) != ids.end() ){
-      if ( verbose ){
-#pragma omp critical
-	{
-	  cout << "skip duplicate ID " << id << endl;
-	}
-      }
+    folia::Paragraph *p = addParagraph( text, id, altoFile,
+					processor_id, ids );
+    if ( !p ){
       continue;
     }
-    else {
-      ids.insert(id);
-    }
-    folia::KWargs p_args;
-    p_args["processor"] = processor_id;
-    text->doc()->declare( folia::AnnotationType::PARAGRAPH, setname, p_args );
-    string arg = text->id() + ".p.";
-    if ( !altoFile.empty() ){
-      arg += altoFile + ".";
-    }
-    arg += id;
-    p_args["xml:id"] = arg;
-    folia::Paragraph *p = text->add_child<folia::Paragraph>( p_args );
-    UnicodeString ocr_text;
     list<xmlNode*> v =
       TiCC::FindNodes( root,
-			"//*[local-name()='TextBlock' and @ID='"
-			+ id + "']" );
+		       "//*[local-name()='TextBlock' and @ID='"
+		       + id + "']" );
     if ( v.size() == 1 ){
-      xmlNode *node = v.front();
-      list<xmlNode*> lv = TiCC::FindNodes( node, "*[local-name()='TextLine']" );
-      int cnt = 0;
-      for ( const auto *line : lv ){
-	xmlNode *pnt = line->children;
-	while ( pnt ){
-	  if ( pnt->type == XML_ELEMENT_NODE ){
-	    if ( TiCC::Name(pnt) == "String" ){
-	      string sub_t = TiCC::getAttribute( pnt, "SUBS_TYPE" );
-	      if ( sub_t == "HypPart2" ){
-		if ( keepPart1 == 0 ){
-		  addStr( p, ocr_text, pnt, altoFile, do_strings, ++cnt );
-		}
-		else {
-		  folia::KWargs atts = folia::getAttributes( keepPart1 );
-		  string kid = atts["ID"];
-		  string sub_c = atts["SUBS_CONTENT"];
-		  UnicodeString subc = TiCC::UnicodeFromUTF8( sub_c );
-		  folia::KWargs sub_args;
-		  string id_arg = p->id() + ".";
-		  if ( !kid.empty() ){
-		    id_arg += kid;
-		  }
-		  else {
-		    id_arg += "String_" + TiCC::toString(++cnt);
-		  }
-		  sub_args["xml:id"] = id_arg;
-		  sub_args["class"] = classname;
-		  folia::FoliaElement *s;
-		  if ( do_strings ){
-		    s = p->add_child<folia::String>( sub_args );
-		  }
-		  else {
-		    s = p->add_child<folia::Word>( sub_args );
-		  }
-		  s->setutext( subc,
-			       ocr_text.length(),
-			       classname );
-		  ocr_text += " " + subc;
-		  if ( !altoFile.empty() ){
-		    folia::KWargs rel_args;
-		    rel_args["processor"] = processor_id;
-		    text->doc()->declare( folia::AnnotationType::RELATION,
-		    			  setname, rel_args );
-		    rel_args.clear();
-		    rel_args["xlink:href"] = altoFile;
-		    folia::Relation *h = s->add_child<folia::Relation>( rel_args );
-		    rel_args.clear();
-		    rel_args["id"] = kid;
-		    rel_args["type"] = "str";
-		    h->add_child<folia::LinkReference>( rel_args );
-		    rel_args["id"] = TiCC::getAttribute( pnt, "ID" );
-		    h->add_child<folia::LinkReference>( rel_args );
-		  }
-		  keepPart1 = 0;
-		}
-		pnt = pnt->next;
-		continue;
-	      }
-	      else if ( sub_t == "HypPart1" ){
-		// see if there is a Part2 in next line at this level.
-		const xmlNode *part2 = findPart2Level( line );
-		if ( part2 ){
-		  keepPart1 = pnt;
-		  break; //continue with next TextLine
-		}
-		else {
-		  // no second part on this level. seek in the next TextBlock
-		  part2 = findPart2Block( node );
-		  if ( !part2 ){
-		    // Ok. Just ignore this and take the CONTENT
-		    addStr( p, ocr_text, pnt, altoFile, do_strings );
-		  }
-		  else {
-		    keepPart1 = pnt;
-		    break; //continue with next TextLine, but this should
-		    // be empty, so in fact we go to the next block
-		  }
-		}
-	      }
-	      else {
-		addStr( p, ocr_text, pnt, altoFile, do_strings, ++cnt );
-	      }
-	    }
-	  }
-	  pnt = pnt->next;
-	}
-      }
+      convertBlock( p, v.front(), altoFile, processor_id,
+		    keepPart1, do_strings );
     }
     else if ( v.empty() ){
       // probably an CB node...
@@ -404,21 +569,49 @@ void createFile( folia::FoliaElement *text,
     else {
       cerr << "Confusing! " << endl;
     }
-    if ( !ocr_text.isEmpty() )
-      p->setutext( ocr_text.tempSubString(1), classname );
   }
 }
 
+bool streamFile( folia::FoliaElement *text,
+		 xml_element_stream& blocks,
+		 const string& altoFile,
+		 const string& processor_id,
+		 bool do_strings ){
+  /// add all TextBlocks from the stream to text. Only the current
+  /// TextBlock and its neighbours are in memory.
+  /// \param altoFile the reference for the Relations. Empty in direct mode
+  /// \return false when there were no TextBlocks at all
+  const xmlNode *keepPart1 = 0;
+  set<string> ids;
+  bool found = false;
+  while ( const xmlNode *block = blocks.next() ){
+    found = true;
+    string id = TiCC::getAttribute( block, "ID" );
+    folia::Paragraph *p = addParagraph( text, id, "", processor_id, ids );
+    if ( !p ){
+      continue;
+    }
+    if ( id.empty() ){
+      // the ID is needed to link the result back
+      cerr << "found nothing, what is this? " << id << endl;
+      continue;
+    }
+    convertBlock( p, block, altoFile, processor_id, keepPart1, do_strings );
+  }
+  return found;
+}
+
 void processBlocks( folia::FoliaElement *text,
 		    const list<xmlNode*>& blocks,
 		    const docCache& cache,
+		    const string& processor_id,
 		    bool do_strings ){
   for ( const auto& it : blocks ){
     string alt = TiCC::getAttribute( it, "alto" );
     xmlDoc *alt_doc = cache.find( alt );
     if ( alt_doc ){
       list<xmlNode*> texts = TiCC::FindNodes( it, "dcx:TextBlock" );
-      createFile( text, alt_doc, alt, texts, do_strings );
+      createFile( text, alt_doc, alt, processor_id, texts, do_strings );
     }
     else {
 #pragma omp critical
@@ -465,7 +658,7 @@ void processArticle( const string& f,
   outName += docid + ".folia.xml";
   folia::Document doc( "xml:id='" + docid + "'" );
   folia::processor *proc = add_provenance( doc, "FoLiA-alto", command );
-  processor_id = proc->id();
+  string processor_id = proc->id();
   folia::KWargs args;
   args["processor"] = processor_id;
   if ( do_strings ){
@@ -486,7 +679,7 @@ void processArticle( const string& f,
 	cerr << "found no blocks" << endl;
       }
     }
-    processBlocks( text, blocks, cache, do_strings );
+    processBlocks( text, blocks, cache, processor_id, do_strings );
   }
 
   zipType type = inputType;
@@ -553,6 +746,499 @@ string generateName( const string& ref, string& id ){
   return res;
 }
 
+struct http_url {
+  string host;
+  string port;
+  string path;
+};
+
+bool parse_url( const string& url, http_url& result ){
+  /// split a plain http:// URL. (https is not handled in-process)
+  const string scheme = "http://";
+  if ( url.compare( 0, scheme.size(), scheme ) != 0 ){
+    return false;
+  }
+  string rest = url.substr( scheme.size() );
+  string::size_type pos = rest.find( '/' );
+  string host_port = rest.substr( 0, pos );
+  result.path = ( pos == string::npos ) ? "/" : rest.substr( pos );
+  pos = host_port.find( ':' );
+  result.host = host_port.substr( 0, pos );
+  result.port = ( pos == string::npos ) ? "80" : host_port.substr( pos+1 );
+  return !result.host.empty();
+}
+
+bool run_wget( const string& url, const string& file ){
+  /// fetch url into file with an external wget. The arguments are passed
+  /// as they are, so no shell ever sees the url
+  pid_t pid = fork();
+  if ( pid < 0 ){
+    return false;
+  }
+  if ( pid == 0 ){
+    const char *argv[] = { "wget", "-q", "-O", file.c_str(),
+			   "--", url.c_str(), nullptr };
+    execvp( "wget", const_cast<char**>( argv ) );
+    _exit( 127 );
+  }
+  int status = 0;
+  while ( waitpid( pid, &status, 0 ) < 0 ){
+    if ( errno != EINTR ){
+      return false;
+    }
+  }
+  return WIFEXITED( status ) && WEXITSTATUS( status ) == 0;
+}
+
+bool chunk_size( const string& line, size_t& len ){
+  /// parse the size line of a chunk: a hexadecimal number, possibly
+  /// followed by ';extensions'. Anything else is a protocol error, and must
+  /// never be taken for the (0 sized) last chunk
+  const string::size_type digits
+    = line.find_first_not_of( "0123456789abcdefABCDEF" );
+  if ( line.empty() || digits == 0 ){
+    return false;
+  }
+  char *end = 0;
+  errno = 0;
+  unsigned long value = strtoul( line.c_str(), &end, 16 );
+  if ( errno == ERANGE
+       || ( digits != string::npos
+	    && end != line.c_str() + digits ) ){
+    // an overflow, or a '0x' prefix that strtoul accepts and HTTP doesn't
+    return false;
+  }
+  while ( *end == ' ' || *end == '\t' ){
+    ++end;
+  }
+  if ( *end != '\0' && *end != ';' ){
+    return false;
+  }
+  len = value;
+  return true;
+}
+
+class http_connection {
+  /// one HTTP/1.1 connection to a host, kept open between requests
+public:
+  http_connection(): _fd(-1) {};
+  ~http_connection(){ close(); };
+  http_connection( const http_connection& ) = delete;
+  http_connection& operator=( const http_connection& ) = delete;
+  bool get( const http_url&, int&, map<string,string>&, string&, string& );
+  void close();
+private:
+  bool connect( const http_url&, string& );
+  bool request( const http_url&, int&, map<string,string>&,
+		string&, string& );
+  bool fill();
+  bool read_line( string& );
+  bool read_bytes( size_t, string& );
+  int _fd;
+  string _host;
+  string _port;
+  string _buffer;
+};
+
+void http_connection::close(){
+  if ( _fd >= 0 ){
+    ::close( _fd );
+  }
+  _fd = -1;
+  _buffer.clear();
+}
+
+bool http_connection::connect( const http_url& url, string& error ){
+  close();
+  struct addrinfo hints;
+  memset( &hints, 0, sizeof(hints) );
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  struct addrinfo *addrs = 0;
+  int res = getaddrinfo( url.host.c_str(), url.port.c_str(), &hints, &addrs );
+  if ( res != 0 ){
+    error = "unable to resolve " + url.host + ": " + gai_strerror( res );
+    return false;
+  }
+  for ( struct addrinfo *a = addrs; a; a = a->ai_next ){
+    _fd = socket( a->ai_family, a->ai_socktype, a->ai_protocol );
+    if ( _fd < 0 ){
+      continue;
+    }
+    struct timeval tv;
+    tv.tv_sec = 60;
+    tv.tv_usec = 0;
+    setsockopt( _fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv) );
+    setsockopt( _fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv) );
+    if ( ::connect( _fd, a->ai_addr, a->ai_addrlen ) == 0 ){
+      break;
+    }
+    ::close( _fd );
+    _fd = -1;
+  }
+  freeaddrinfo( addrs );
+  if ( _fd < 0 ){
+    error = "unable to connect to " + url.host + ":" + url.port;
+    return false;
+  }
+  _host = url.host;
+  _port = url.port;
+  return true;
+}
+
+bool http_connection::fill(){
+  char buf[65536];
+  ssize_t len = recv( _fd, buf, sizeof(buf), 0 );
+  if ( len <= 0 ){
+    return false;
+  }
+  _buffer.append( buf, len );
+  return true;
+}
+
+bool http_connection::read_line( string& line ){
+  string::size_type pos;
+  while ( ( pos = _buffer.find( "\r\n" ) ) == string::npos ){
+    if ( !fill() ){
+      return false;
+    }
+  }
+  line = _buffer.substr( 0, pos );
+  _buffer.erase( 0, pos+2 );
+  return true;
+}
+
+bool http_connection::read_bytes( size_t len, string& result ){
+  while ( _buffer.size() < len ){
+    if ( !fill() ){
+      return false;
+    }
+  }
+  result.append( _buffer, 0, len );
+  _buffer.erase( 0, len );
+  return true;
+}
+
+bool http_connection::get( const http_url& url,
+			   int& status,
+			   map<string,string>& headers,
+			   string& body,
+			   string& error ){
+  /// GET url. The connection is reused when it is still open to the same
+  /// host. The server may have closed an idle connection, so a request on
+  /// a reused connection that fails is tried once more on a fresh one
+  bool reused = ( _fd >= 0 && _host == url.host && _port == url.port );
+  if ( !reused && !connect( url, error ) ){
+    return false;
+  }
+  if ( request( url, status, headers, body, error ) ){
+    return true;
+  }
+  close();
+  if ( reused && connect( url, error ) ){
+    error.clear();
+    if ( request( url, status, headers, body, error ) ){
+      return true;
+    }
+    close();
+  }
+  return false;
+}
+
+bool http_connection::request( const http_url& url,
+			       int& status,
+			       map<string,string>& headers,
+			       string& body,
+			       string& error ){
+  headers.clear();
+  body.clear();
+  string req = "GET " + url.path + " HTTP/1.1\r\n"
+    + "Host: " + url.host + ( url.port == "80" ? "" : ":" + url.port )
+    + "\r\nUser-Agent: FoLiA-alto/" + VERSION
+    + "\r\nConnection: keep-alive\r\n\r\n";
+  size_t sent = 0;
+  while ( sent < req.size() ){
+    ssize_t len = send( _fd, req.data() + sent, req.size() - sent,
+			MSG_NOSIGNAL );
+    if ( len <= 0 ){
+      error = "unable to send the request to " + url.host;
+      return false;
+    }
+    sent += len;
+  }
+  string line;
+  if ( !read_line( line ) ){
+    error = "no response from " + url.host;
+    return false;
+  }
+  vector<string> parts = TiCC::split( line );
+  if ( parts.size() < 2
+       || parts[0].compare( 0, 5, "HTTP/" ) != 0
+       || !TiCC::stringTo( parts[1], status ) ){
+    error = "invalid response from " + url.host + ": " + line;
+    return false;
+  }
+  bool keep_alive = ( parts[0] != "HTTP/1.0" );
+  while ( read_line( line ) && !line.empty() ){
+    string::size_type pos = line.find( ':' );
+    if ( pos != string::npos ){
+      string value = TiCC::trim( line.substr( pos+1 ) );
+      headers[TiCC::lowercase( line.substr( 0, pos ) )] = value;
+    }
+  }
+  if ( !line.empty() ){
+    error = "truncated response headers from " + url.host;
+    return false;
+  }
+  const auto conn = headers.find( "connection" );
+  if ( conn != headers.end() ){
+    string value = TiCC::lowercase( conn->second );
+    if ( value == "close" ){
+      keep_alive = false;
+    }
+    else if ( value == "keep-alive" ){
+      keep_alive = true;
+    }
+  }
+  const auto te = headers.find( "transfer-encoding" );
+  const auto cl = headers.find( "content-length" );
+  if ( te != headers.end()
+       && TiCC::lowercase( te->second ).find( "chunked" ) != string::npos ){
+    while ( true ){
+      if ( !read_line( line ) ){
+	error = "truncated chunked body from " + url.host;
+	return false;
+      }
+      size_t len = 0;
+      if ( !chunk_size( line, len ) ){
+	error = "invalid chunk size from " + url.host + ": '" + line + "'";
+	return false;
+      }
+      if ( len == 0 ){
+	break;
+      }
+      if ( !read_bytes( len, body ) || !read_line( line ) ){
+	error = "truncated chunked body from " + url.host;
+	return false;
+      }
+    }
+    // skip the trailer
+    while ( read_line( line ) && !line.empty() ){
+    }
+  }
+  else if ( cl != headers.end() ){
+    size_t len = 0;
+    if ( !TiCC::stringTo( cl->second, len ) || !read_bytes( len, body ) ){
+      error = "truncated body from " + url.host;
+      return false;
+    }
+  }
+  else {
+    // the body ends when the server closes the connection
+    while ( fill() ){
+    }
+    body = _buffer;
+    _buffer.clear();
+    keep_alive = false;
+  }
+  if ( !keep_alive ){
+    close();
+  }
+  return true;
+}
+
+class alto_fetcher {
+  /// fetches ALTO files in-process, with a bounded pool of workers that
+  /// is shared by all (OpenMP) threads. Every worker keeps its connections
+  /// open for the next request. A file that is requested by several
+  /// threads at once is only fetched once: the others wait for it.
+  /// Files are written under a temporary name and then renamed, so a
+  /// file in the cache is always complete.
+public:
+  explicit alto_fetcher( size_t workers ):
+    _workers(workers), _stop(false) {};
+  ~alto_fetcher();
+  void fetch( const unordered_map<string,string>&,
+	      unordered_map<string,string>& );
+private:
+  struct job {
+    string url;
+    string file;
+    bool done = false;
+    string error;
+  };
+  void work( size_t );
+  bool fetch_one( map<string,unique_ptr<http_connection>>&,
+		  const job&, size_t, string& );
+  size_t _workers;
+  bool _stop;
+  vector<thread> _threads;
+  mutex _mutex;
+  condition_variable _wakeup;   // signals the workers
+  condition_variable _finished; // signals the waiting callers
+  deque<shared_ptr<job>> _queue;
+  unordered_map<string,shared_ptr<job>> _in_flight; // by file name
+};
+
+alto_fetcher::~alto_fetcher(){
+  {
+    lock_guard<mutex> lock( _mutex );
+    _stop = true;
+  }
+  _wakeup.notify_all();
+  for ( auto& t : _threads ){
+    t.join();
+  }
+}
+
+void alto_fetcher::fetch( const unordered_map<string,string>& jobs,
+			  unordered_map<string,string>& failed ){
+  /// fetch all url => file jobs, and wait until they are done.
+  /// failed gets the reason for every url that could not be fetched
+  failed.clear();
+  vector<shared_ptr<job>> mine;
+  unique_lock<mutex> lock( _mutex );
+  if ( _threads.empty() ){
+    for ( size_t i=0; i < _workers; ++i ){
+      _threads.emplace_back( &alto_fetcher::work, this, i );
+    }
+  }
+  for ( const auto& [url,file] : jobs ){
+    const auto it = _in_flight.find( file );
+    if ( it != _in_flight.end() ){
+      mine.push_back( it->second );
+    }
+    else {
+      auto j = make_shared<job>();
+      j->url = url;
+      j->file = file;
+      _in_flight[file] = j;
+      _queue.push_back( j );
+      mine.push_back( j );
+    }
+  }
+  _wakeup.notify_all();
+  _finished.wait( lock, [&mine](){
+      for ( const auto& j : mine ){
+	if ( !j->done ){
+	  return false;
+	}
+      }
+      return true; } );
+  for ( const auto& j : mine ){
+    if ( !j->error.empty() ){
+      failed[j->url] = j->error;
+    }
+  }
+}
+
+void alto_fetcher::work( size_t worker ){
+  map<string,unique_ptr<http_connection>> connections; // by host:port
+  while ( true ){
+    shared_ptr<job> j;
+    {
+      unique_lock<mutex> lock( _mutex );
+      _wakeup.wait( lock, [this](){ return _stop || !_queue.empty(); } );
+      if ( _stop ){
+	return;
+      }
+      j = _queue.front();
+      _queue.pop_front();
+    }
+    string error;
+    chrono::milliseconds backoff( 500 );
+    for ( int attempt=0; attempt < 3; ++attempt ){
+      if ( attempt > 0 ){
+	this_thread::sleep_for( backoff );
+	backoff *= 2;
+      }
+      error.clear();
+      if ( fetch_one( connections, *j, worker, error ) ){
+	break;
+      }
+    }
+    {
+      lock_guard<mutex> lock( _mutex );
+      j->error = error;
+      j->done = true;
+      _in_flight.erase( j->file );
+    }
+    _finished.notify_all();
+  }
+}
+
+bool alto_fetcher::fetch_one( map<string,unique_ptr<http_connection>>& connections,
+			      const job& j,
+			      size_t worker,
+			      string& error ){
+  string tmp_name = j.file + ".part" + TiCC::toString( worker );
+  // a left-over from an earlier (killed) run must never end up in the cache
+  remove( tmp_name.c_str() );
+  string url = j.url;
+  bool fetched = false;
+  for ( int redirects=0; redirects < 5 && !fetched; ++redirects ){
+    http_url parsed;
+    if ( !parse_url( url, parsed ) ){
+      // not plain http, leave it to wget
+      if ( !run_wget( url, tmp_name ) ){
+	remove( tmp_name.c_str() );
+	error = "wget failed for '" + url + "'";
+	return false;
+      }
+      fetched = true;
+      break;
+    }
+    auto& conn = connections[parsed.host + ":" + parsed.port];
+    if ( !conn ){
+      conn.reset( new http_connection() );
+    }
+    int status = 0;
+    map<string,string> headers;
+    string body;
+    if ( !conn->get( parsed, status, headers, body, error ) ){
+      return false;
+    }
+    if ( status >= 300 && status < 400
+	 && headers.find( "location" ) != headers.end() ){
+      string location = headers["location"];
+      if ( location.find( "://" ) == string::npos ){
+	location = "http://" + parsed.host
+	  + ( parsed.port == "80" ? "" : ":" + parsed.port ) + location;
+      }
+      url = location;
+      continue;
+    }
+    if ( status != 200 ){
+      error = "HTTP status " + TiCC::toString( status ) + " for " + url;
+      return false;
+    }
+    ofstream os( tmp_name, ios::binary );
+    os.write( body.data(), body.size() );
+    os.close();
+    if ( !os ){
+      remove( tmp_name.c_str() );
+      error = "unable to write " + tmp_name;
+      return false;
+    }
+    fetched = true;
+  }
+  if ( !fetched ){
+    error = "too many redirects for " + j.url;
+    return false;
+  }
+  if ( rename( tmp_name.c_str(), j.file.c_str() ) != 0 ){
+    remove( tmp_name.c_str() );
+    error = "unable to rename " + tmp_name + " to " + j.file;
+    return false;
+  }
+  return true;
+}
+
+alto_fetcher& fetcher(){
+  static alto_fetcher the_fetcher( fetch_workers );
+  return the_fetcher;
+}
+
 bool download( const string& alto_cache,
 	       const list<xmlNode*>& resources,
 	       unordered_map<string,string>& urns,
@@ -600,26 +1286,23 @@ bool download( const string& alto_cache,
     }
   }
 
-  int retry = 3;
-  while ( retry-- > 0 ){
-    auto it = ref_file_map.begin();
-    while ( it != ref_file_map.end() ){
-      string cmd = "wget " + it->first + " -q -O " + it->second;
-      int res = system( cmd.c_str() );
-      if ( res ){
-	if ( retry == 0 ){
+  unordered_map<string,string> failed;
+  fetcher().fetch( ref_file_map, failed );
+  auto it = ref_file_map.begin();
+  while ( it != ref_file_map.end() ){
+    const auto fail = failed.find( it->first );
+    if ( fail != failed.end() ){
 #pragma omp critical
-	  {
-	    cerr << "repeatedly failed to execute: '" << cmd << "'" << endl;
-	  }
-	  downloaded[it->second] = "FAIL";
-	}
-	++it;
-      }
-      else {
-	++d_cnt;
-	ref_file_map.erase( it++ );
+      {
+	cerr << "repeatedly failed to fetch: '" << it->first << "': "
+	     << fail->second << endl;
       }
+      downloaded[it->second] = "FAIL";
+      ++it;
+    }
+    else {
+      ++d_cnt;
+      ref_file_map.erase( it++ );
     }
   }
   if ( !ref_file_map.empty() ){
@@ -695,26 +1378,23 @@ bool download( const string& alto_cache,
     }
   }
 
-  int retry = 3;
-  while ( retry-- > 0 ){
-    auto it = ref_file_map.begin();
-    while ( it != ref_file_map.end() ){
-      string cmd = "wget " + it->first + " -q -O " + it->second;
-      int res = system( cmd.c_str() );
-      if ( res ){
-	if ( retry == 0 ){
+  unordered_map<string,string> failed;
+  fetcher().fetch( ref_file_map, failed );
+  auto it = ref_file_map.begin();
+  while ( it != ref_file_map.end() ){
+    const auto fail = failed.find( it->first );
+    if ( fail != failed.end() ){
 #pragma omp critical
-	  {
-	    cerr << "repeatedly failed to execute: '" << cmd << "'" << endl;
-	  }
-	}
-	++it;
-      }
-      else {
-	downloaded.insert( it->second );
-	++d_cnt;
-	ref_file_map.erase( it++ );
+      {
+	cerr << "repeatedly failed to fetch: '" << it->first << "': "
+	     << fail->second << endl;
       }
+      ++it;
+    }
+    else {
+      downloaded.insert( it->second );
+      ++d_cnt;
+      ref_file_map.erase( it++ );
     }
   }
   if ( !ref_file_map.empty() ){
@@ -778,6 +1458,134 @@ void clear_files( const unordered_set<string>& files ){
   }
 }
 
+class didl_index {
+  /// the Components of a DIDL by their dc:identifier, and the mimeType of
+  /// its Resources. Collected in one walk over the DIDL, so looking up the
+  /// parts of an article doesn't need an XPath scan of the whole tree.
+public:
+  explicit didl_index( xmlNode *didl ){ walk( didl ); };
+  list<xmlNode*> components( const string& ) const;
+  const list<xmlNode*>& all_components() const { return _all_components; };
+  list<xmlNode*> resources( const string& ) const;
+private:
+  void walk( xmlNode * );
+  unordered_map<string,list<xmlNode*>> _components;
+  list<xmlNode*> _all_components;
+  list<pair<xmlNode*,string>> _resources; // with their mimeType
+};
+
+void didl_index::walk( xmlNode *node ){
+  string name = TiCC::Name( node );
+  for ( xmlNode *pnt = node->children; pnt; pnt = pnt->next ){
+    if ( pnt->type != XML_ELEMENT_NODE ){
+      continue;
+    }
+    string child = TiCC::Name( pnt );
+    if ( child == "Component" && name == "Item" ){
+      _all_components.push_back( pnt );
+      string id = TiCC::getAttribute( pnt, "identifier" );
+      if ( !id.empty() ){
+	_components[id].push_back( pnt );
+      }
+    }
+    else if ( child == "Resource" && name == "Component" ){
+      _resources.push_back( make_pair( pnt,
+				       TiCC::getAttribute( pnt, "mimeType" ) ) );
+    }
+    walk( pnt );
+  }
+}
+
+list<xmlNode*> didl_index::components( const string& id ) const {
+  /// the Item Components with dc:identifier 'id'
+  const auto it = _components.find( id );
+  if ( it == _components.end() ){
+    return list<xmlNode*>();
+  }
+  return it->second;
+}
+
+list<xmlNode*> didl_index::resources( const string& mime_type ) const {
+  /// the Component Resources with this mimeType, in document order
+  list<xmlNode*> result;
+  for ( const auto& [res,mime] : _resources ){
+    if ( mime == mime_type ){
+      result.push_back( res );
+    }
+  }
+  return result;
+}
+
+bool solveArticle( const string& art,
+		   const didl_index& index,
+		   const string& alto_cache,
+		   const string& outDir,
+		   const zipType inputType,
+		   const zipType outputType,
+		   const string& command,
+		   bool do_strings ){
+  /// convert article 'art' of a DIDL. This only reads the DIDL and the
+  /// shared ALTO pages, so articles can be converted in parallel
+  bool succes = true;
+  string subject;
+  list<xmlNode*> meta = index.components( art + ":metadata" );
+  if ( meta.size() == 1 ){
+    list<xmlNode*> subs = TiCC::FindNodes( meta.front(), "didl:Resource//srw_dc:dcx/dc:subject" );
+    if ( subs.size() == 1 ){
+      subject = TiCC::TextValue(subs.front());
+    }
+    else {
+#pragma omp critical
+      {
+	cerr << "problems with dc:subject in " << TiCC::getAttribute( subs.front(), "identifier" ) << endl;
+      }
+      succes = false;
+    }
+  }
+  else {
+#pragma omp critical
+    {
+      cerr << "problems with metadata in " << art << endl;
+    }
+    succes = false;
+  }
+
+  list<xmlNode*> comps = index.components( art + ":zoning" );
+  if ( comps.size() == 1 ){
+    list<xmlNode*> zones = TiCC::FindNodes( comps.front(), "didl:Resource/dcx:zoning" );
+    if ( zones.size() == 1 ){
+      // pin just the pages of this article
+      docCache cache;
+      list<xmlNode*> blocks = TiCC::FindNodes( zones.front(), "dcx:article-part/dcx:blocks" );
+      cache.fill( alto_cache, blocks );
+      processZone( art,
+		   subject,
+		   zones.front(),
+		   cache,
+		   outDir,
+		   inputType,
+		   outputType,
+		   command,
+		   do_strings );
+    }
+    else {
+#pragma omp critical
+      {
+	cerr << "problems with zones in " << TiCC::getAttribute( comps.front(), "identifier" ) << endl;
+      }
+      succes = false;
+    }
+  }
+  else {
+#pragma omp critical
+    {
+      cerr << "problems with Components in " << art << endl;
+    }
+    succes = false;
+  }
+  return succes;
+}
+
 void solveArtAlto( const string& alto_cache,
 		   const string& file,
 		   const string& outDir,
@@ -797,7 +1605,8 @@ void solveArtAlto( const string& alto_cache,
     if ( metadata ){
       xmlNode *didl = TiCC::xPath( metadata, "//*[local-name()='DIDL']" );
       if ( didl ){
-	list<xmlNode*> resources = TiCC::FindNodes( didl, "//didl:Component/didl:Resource[@mimeType='text/xml']" );
+	didl_index index( didl );
+	list<xmlNode*> resources = index.resources( "text/xml" );
 	if ( resources.empty() ){
 #pragma omp critical
 	  {
@@ -818,9 +1627,6 @@ void solveArtAlto( const string& alto_cache,
 	    }
 	    else {
 	      cout << "Downloaded files " << endl;
-	      list<xmlNode*> blocks = TiCC::FindNodes( didl, "//dcx:blocks" );
-	      docCache cache; // each thread it own cache...
-	      cache.fill( alto_cache, blocks );
 	      list<xmlNode*> items = TiCC::FindNodes( didl, "didl:Item/didl:Item/didl:Item" );
 	      if ( items.empty() ){
 #pragma omp critical
@@ -845,60 +1651,36 @@ void solveArtAlto( const string& alto_cache,
 		    article_names.insert( art_id );
 		  }
 		}
-		for ( const auto& art : article_names ){
-		  string subject;
-		  list<xmlNode*> meta = TiCC::FindNodes( didl, "//didl:Item/didl:Component[@dc:identifier='" + art + ":metadata']" );
-		  if ( meta.size() == 1 ){
-		    list<xmlNode*> subs = TiCC::FindNodes( meta.front(), "didl:Resource//srw_dc:dcx/dc:subject" );
-		    if ( subs.size() == 1 ){
-		      subject = TiCC::TextValue(subs.front());
-		    }
-		    else {
-#pragma omp critical
-		      {
-			cerr << "problems with dc:subject in " << TiCC::getAttribute( subs.front(), "identifier" ) << endl;
-		      }
-		      succes = false;
-		    }
+		// every article is a task, so idle threads of the team can help
+		// out on big issues
+		vector<string> articles( article_names.begin(),
+					 article_names.end() );
+		auto convert = [&]( const string& art ){
+		  bool ok = false;
+		  try {
+		    ok = solveArticle( art, index, alto_cache, outDir,
+				       inputType, outputType, command,
+				       do_strings );
 		  }
-		  else {
+		  catch ( const exception& e ){
 #pragma omp critical
 		    {
-		      cerr << "problems with metadata in " << art << endl;
-		    }
-		    succes = false;
-		  }
-
-		  list<xmlNode*> comps = TiCC::FindNodes( didl, "//didl:Item/didl:Component[@dc:identifier='" + art + ":zoning']" );
-		  if ( comps.size() == 1 ){
-		    list<xmlNode*> zones = TiCC::FindNodes( comps.front(), "didl:Resource/dcx:zoning" );
-		    if ( zones.size() == 1 ){
-		      processZone( art,
-				   subject,
-				   zones.front(),
-				   cache,
-				   outDir,
-				   inputType,
-				   outputType,
-				   command,
-				   do_strings );
-		    }
-		    else {
-#pragma omp critical
-		      {
-			cerr << "problems with zones in " << TiCC::getAttribute( comps.front(), "identifier" ) << endl;
-		      }
-		      succes = false;
+		      cerr << "article " << art << " failed: " << e.what()
+			   << endl;
 		    }
 		  }
-		  else {
+		  if ( !ok ){
 #pragma omp critical
 		    {
-		      cerr << "problems with Components in " << art << endl;
+		      succes = false;
 		    }
-		    succes = false;
 		  }
+		};
+		for ( size_t i=0; i < articles.size(); ++i ){
+#pragma omp task shared(convert,articles) firstprivate(i)
+		  convert( articles[i] );
 		}
+#pragma omp taskwait
 	      }
 	      if ( clearCachedFiles )
 		clear_files( downloaded_files );
@@ -957,15 +1739,15 @@ void solveBook( const string& altoFile,
       cout << "start handling " << altoFile << endl;
     }
   }
-  zipType inputType;
-  xmlDoc *xmldoc = getXml( altoFile, inputType );
-  if ( xmldoc ){
+  xml_element_stream blocks( altoFile, "TextBlock" );
+  if ( blocks.good() ){
+    zipType inputType = blocks.type();
     string docid = replaceColon( book_id, '.' );
     docid = prefix + docid;
     string outName = outDir + docid + ".folia.xml";
     folia::Document doc( "xml:id='" + docid + "'" );
     folia::processor *proc = add_provenance( doc, "FoLiA-alto", command );
-    processor_id = proc->id();
+    string processor_id = proc->id();
     folia::KWargs proc_args;
     proc_args["processor"] = processor_id;
     if ( do_strings ){
@@ -977,136 +1759,19 @@ void solveBook( const string& altoFile,
     folia::KWargs text_args;
     text_args["xml:id"] = docid + ".text";
     folia::Text *text = doc.create_root<folia::Text>( text_args );
-    xmlNode *root = xmlDocGetRootElement( xmldoc );
-    list<xmlNode*> textblocks = TiCC::FindNodes( root, "//*:TextBlock" );
-    if ( textblocks.empty() ){
+    if ( !streamFile( text, blocks, urn, processor_id, do_strings ) ){
 #pragma omp critical
       {
 	cerr << "found no textblocks in " << altoFile << endl;
       }
-      xmlFreeDoc( xmldoc );
       return;
     }
-    xmlNode *keepPart1 = 0;
-    set<string> ids;
-    for ( auto const& block : textblocks ){
-      string id = TiCC::getAttribute( block, "ID" );
-      if ( ids.find(id) != ids.end() ){
-	if ( verbose ){
+    if ( !blocks.good() ){
 #pragma omp critical
-	  {
-	    cout << "skip duplicate ID " << id << endl;
-	  }
-	}
-	continue;
-      }
-      else {
-	ids.insert(id);
-      }
-      folia::KWargs p_args;
-      p_args["processor"] = processor_id;
-      doc.declare( folia::AnnotationType::PARAGRAPH, setname, p_args );
-      p_args["xml:id"] = text->id() + ".p." + id;
-      folia::Paragraph *p = text->add_child<folia::Paragraph>( p_args );
-      UnicodeString ocr_text;
-      list<xmlNode*> v =
-	TiCC::FindNodes( root,
-			 "//*[local-name()='TextBlock' and @ID='"
-			 + id + "']" );
-      if ( v.size() == 1 ){
-	xmlNode *node = v.front();
-	list<xmlNode*> lv = TiCC::FindNodes( node, "*[local-name()='TextLine']" );
-	for ( const auto *line : lv ){
-	  xmlNode *pnt = line->children;
-	  while ( pnt ){
-	    if ( pnt->type == XML_ELEMENT_NODE ){
-	      if ( TiCC::Name(pnt) == "String" ){
-		string sub_t = TiCC::getAttribute( pnt, "SUBS_TYPE" );
-		if ( sub_t == "HypPart2" ){
-		  if ( keepPart1 == 0 ){
-		    addStr( p, ocr_text, pnt, urn, do_strings );
-		  }
-		  else {
-		    folia::KWargs atts = folia::getAttributes( keepPart1 );
-		    string kid = atts["ID"];
-		    string sub_c = atts["SUBS_CONTENT"];
-		    UnicodeString subc = TiCC::UnicodeFromUTF8( sub_c );
-		    folia::KWargs args;
-		    args["xml:id"] = p->id() + "." + kid;
-		    args["class"] = classname;
-		    folia::FoliaElement *s;
-		    if ( do_strings ){
-		      s = p->add_child<folia::String>( args );
-		    }
-		    else {
-		      s = p->add_child<folia::Word>( args );
-		    }
-		    s->setutext( subc,
-				 ocr_text.length(),
-				 classname );
-		    ocr_text += " " + subc;
-		    args.clear();
-		    args["processor"] = processor_id;
-		    text->doc()->declare( folia::AnnotationType::RELATION,
-		    			  setname, args );
-		    args.clear();
-		    args["xlink:href"] = urn;
-		    folia::Relation *h = s->add_child<folia::Relation>( args );
-		    args.clear();
-		    args["id"] = kid;
-		    args["type"] = "str";
-		    h->add_child<folia::LinkReference>( args );
-		    args["id"] = TiCC::getAttribute( pnt, "ID" );
-		    h->add_child<folia::LinkReference>( args );
-		    keepPart1 = 0;
-		  }
-		  pnt = pnt->next;
-		  continue;
-		}
-		else if ( sub_t == "HypPart1" ){
-		  // see if there is a Part2 in next line at this level.
-		  const xmlNode *part2 = findPart2Level( line );
-		  if ( part2 ){
-		    keepPart1 = pnt;
-		    break; //continue with next TextLine
-		  }
-		  else {
-		    // no second part on this level. seek in the next TextBlock
-		    part2 = findPart2Block( node );
-		    if ( !part2 ){
-		      // Ok. Just ignore this and take the CONTENT
-		      addStr( p, ocr_text, pnt, urn, do_strings );
-		    }
-		    else {
-		      keepPart1 = pnt;
-		      break; //continue with next TextLine, but this should
-		      // be empty, so in fact we go to the next block
-		    }
-		  }
-		}
-		else {
-		  addStr( p, ocr_text, pnt, urn, do_strings );
-		}
-	      }
-	    }
-	    pnt = pnt->next;
-	  }
-	}
-      }
-      else if ( v.empty() ){
-	// probably an CB node...
-	if ( id.find("CB") != string::npos ){
-	  // YES
-	}
-	else {
-	  cerr << "found nothing, what is this? " << id << endl;
-	}
-      }
-      else {
-	cerr << "Confusing! " << endl;
+      {
+	cerr << "unable to read " << altoFile << endl;
       }
-      if ( !ocr_text.isEmpty() )
-	p->setutext( ocr_text.tempSubString(1), classname );
+      return;
     }
     zipType type = inputType;
     if ( outputType != NORMAL )
@@ -1135,7 +1800,6 @@ void solveBook( const string& altoFile,
 	}
       }
     }
-    xmlFreeDoc( xmldoc );
   }
   else {
     cerr << "unable to read " << altoFile << endl;
@@ -1161,7 +1825,8 @@ void solveBookAlto( const string& alto_cache,
     if ( metadata ){
       xmlNode *didl = TiCC::xPath( metadata, "//*[local-name()='DIDL']" );
       if ( didl ){
-	list<xmlNode*> resources = TiCC::FindNodes( didl, "//didl:Component/didl:Resource[@mimeType='text/xml']" );
+	didl_index index( didl );
+	list<xmlNode*> resources = index.resources( "text/xml" );
 	if ( resources.empty() ){
 #pragma omp critical
 	  {
@@ -1183,7 +1848,7 @@ void solveBookAlto( const string& alto_cache,
 	    }
 	    else {
 	      cout << "Downloaded files " << endl;
-	      list<xmlNode*> meta = TiCC::FindNodes( didl, "//didl:Item/didl:Component" );
+	      const list<xmlNode*>& meta = index.all_components();
 	      for ( const auto& m : meta ){
 		string id = TiCC::getAttribute( m, "identifier");
 		if ( !id.empty() ){
@@ -1247,17 +1912,22 @@ void solveDirectAlto( const string& full_file,
   {
     cout << "resolving direct on " << full_file << endl;
   }
-  zipType type;
-  xmlDoc *xmldoc = getXml( full_file, type );
+  xml_element_stream blocks( full_file, "TextBlock" );
+  if ( !blocks.good() ){
+#pragma omp critical
+    {
+      cerr << "unable to read " << full_file << endl;
+    }
+    return;
+  }
   string filename = TiCC::basename( full_file );
   string docid = filename.substr( 0, filename.find(".") );
   docid = replaceColon(docid,'.');
   docid = prefix + docid;
   string outName = outDir + docid + ".folia.xml";
-  list<xmlNode*> texts = TiCC::FindNodes( xmldoc, "//*:TextBlock" );
   folia::Document doc( "xml:id='" + docid + "'" );
   folia::processor *proc = add_provenance( doc, "FoLiA-alto", command );
-  processor_id = proc->id();
+  string processor_id = proc->id();
   folia::KWargs args;
   args["processor"] = processor_id;
   if ( do_strings ){
@@ -1269,7 +1939,14 @@ void solveDirectAlto( const string& full_file,
   args.clear();
   args["xml:id"] =  docid + ".text";
   folia::Text *text = doc.create_root<folia::Text>( args );
-  createFile( text, xmldoc, "", texts, do_strings );
+  streamFile( text, blocks, "", processor_id, do_strings );
+  if ( !blocks.good() ){
+#pragma omp critical
+    {
+      cerr << "unable to read " << full_file << endl;
+    }
+    return;
+  }
   vector<folia::Paragraph*> pv = doc.paragraphs();
   if ( pv.size() == 0 ||
        ( pv.size() == 1 && pv[0]->size() == 0 ) ){
@@ -1300,6 +1977,10 @@ void usage(){
   cerr << "Usage: alto [options] file/dir" << endl;
   cerr << "\t--cache\t\t alto cache directory " << endl;
   cerr << "\t--clear\t\t clear cached Alto files at start" << endl;
+  cerr << "\t--cache-size=<MB> keep at most 'MB' megabytes of parsed Alto files in memory."
+       << " (default " << alto_budget << ")" << endl;
+  cerr << "\t--fetch-threads=<n> download at most 'n' Alto files at the same time."
+       << " (default " << fetch_workers << ")" << endl;
   cerr << "\t--direct\t read alto files directly. (so NO Didl)" << endl;
   cerr << "\t-t <threads> or\n\t--threads <threads> Number of threads to run on." << endl;
   cerr << "\t\t\t If 'threads' has the value \"max\", the number of threads is set to a" << endl;
@@ -1327,7 +2008,8 @@ int main( int argc, char *argv[] ){
   try {
     opts.add_short_options( "vVt:O:h" );
     opts.add_long_options( "cache:,clear,class:,direct,setname:,compress:,"
-			   "type:,help,prefix:,version,threads:,oldstrings" );
+			   "type:,help,prefix:,version,threads:,oldstrings,"
+			   "fetch-threads:,cache-size:" );
     opts.init( argc, argv );
   }
   catch( TiCC::OptionError& e ){
@@ -1360,6 +2042,18 @@ int main( int argc, char *argv[] ){
   if ( !do_direct ){
     clearCachedFiles = opts.extract( "clear" );
     opts.extract( "cache", alto_cache );
+    if ( opts.extract( "cache-size", value ) ){
+      if ( !TiCC::stringTo( value, alto_budget ) ){
+	cerr << "illegal value for --cache-size (" << value << ")" << endl;
+	exit( EXIT_FAILURE );
+      }
+    }
+    if ( opts.extract( "fetch-threads", value ) ){
+      if ( !TiCC::stringTo( value, fetch_workers ) || fetch_workers == 0 ){
+	cerr << "illegal value for --fetch-threads (" << value << ")" << endl;
+	exit( EXIT_FAILURE );
+      }
+    }
   }
   if ( opts.extract( "type", kind ) ){
     if ( kind != "krant" && kind != "boek" ){
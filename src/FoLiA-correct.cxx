@@ -31,9 +31,21 @@
 #include <map>
 #include <unordered_map>
 #include <unordered_set>
+#include <memory>
 #include <vector>
+#include <string_view>
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <csignal>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #include "ticcutils/FileUtils.h"
 #include "ticcutils/CommandLine.h"
@@ -43,6 +55,7 @@
 #include "ticcutils/Timer.h"
 #include "libfolia/folia.h"
 #include "foliautils/common_code.h"
+#include "foliautils/mapped_lexicon.h"
 
 #include "config.h"
 #ifdef HAVE_OPENMP
@@ -56,6 +69,8 @@ using TiCC::operator<<;
 
 const char SEPCHAR = '_';
 const string SEPARATOR = "_";
+static_assert( SEPCHAR == LEXICON_SEPARATOR,
+	       "the lexicon filter splits the keys at SEPCHAR" );
 
 int verbose = 0;
 string input_classname = "current";
@@ -65,12 +80,20 @@ string rebase_inputclass;
 string setname = "Ticcl-set";
 string punct_sep = " ";
 size_t ngram_size = 1;
+int root_threads = 1;   // threads per document, for the correction roots
 
 struct word_conf {
-  word_conf(){};
-  word_conf( const string& w, const string& c ): word(w), conf(c){};
+  word_conf(): conf(0) {};
+  word_conf( const string& w, float c ): word(w), conf(c){};
   string word;
-  string conf;
+  float conf;
+};
+
+struct suggestion {
+  /// one ranked suggestion. The word lives in a string_arena
+  const char *word;
+  uint32_t length;
+  float confidence;
 };
 
 ostream& operator<<( ostream& os, const word_conf& wc ){
@@ -78,137 +101,773 @@ ostream& operator<<( ostream& os, const word_conf& wc ){
   return os;
 }
 
+class variant_list {
+  /// a view on the ranked suggestions for one variant key. These either
+  /// live in a variant_table or in a mapped lexicon.
+public:
+  variant_list(): _text(0), _lex(0), _sugg(0), _size(0) {};
+  variant_list( const suggestion *s, size_t n ):
+    _text(s), _lex(0), _sugg(0), _size(n) {};
+  variant_list( const mapped_lexicon& lex,
+		const lexicon_entry& e,
+		size_t limit ):
+    _text(0),
+    _lex(&lex),
+    _sugg(lex.suggestions(e)),
+    _size(std::min<size_t>(e.suggestion_count,limit)) {};
+  size_t size() const { return _size; };
+  bool empty() const { return _size == 0; };
+  string word( size_t i ) const {
+    if ( _text ){
+      return string( _text[i].word, _text[i].length );
+    }
+    return string( _lex->word( _sugg[i] ) );
+  }
+  float confidence( size_t i ) const {
+    if ( _text ){
+      return _text[i].confidence;
+    }
+    return _sugg[i].confidence;
+  }
+  string conf( size_t i ) const {
+    return TiCC::toString( confidence( i ) );
+  }
+private:
+  const suggestion *_text;
+  const mapped_lexicon *_lex;
+  const lexicon_suggestion *_sugg;
+  size_t _size;
+};
+
+const string DELTA_MAGIC = "#FoLiA-correct-delta";
+const int DELTA_VERSION = 3;
+
+class correction_delta {
+  /// a stand-off record of the corrections of one document. For every
+  /// correction root, in document order, the changes made to it:
+  ///   R  root-id  input-hash  declared-type  set  alias  corrected-text
+  ///   E  word-ids  original  kind  new-words  final-punct [word conf]...
+  ///   K  word-id  text
+  ///   N
+  /// An E record is an edit, a K record a word that is kept as it is, and N
+  /// means no space after the last word. Replaying these on the original
+  /// document recreates the corrected document, without a lexicon.
+public:
+  void describe( const string&, const string& );
+  void add( const vector<string>& fields ){ _records.push_back( fields ); };
+  bool save( const string& ) const;
+  bool load( const string&, string& );
+  const vector<vector<string>>& records() const { return _records; };
+  map<string,string> settings;
+  map<string,size_t> counts;
+private:
+  vector<vector<string>> _records;
+};
+
+string text_hash( const string& text ){
+  /// the FNV-1a hash of text, in hex
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for ( const auto& c : text ){
+    h ^= static_cast<unsigned char>(c);
+    h *= 0x100000001b3ULL;
+  }
+  ostringstream os;
+  os << hex << h;
+  return os.str();
+}
+
+vector<string> split_fields( const string& line ){
+  /// split line at every TAB. Unlike TiCC::split_at(), empty fields are kept
+  vector<string> result;
+  string::size_type start = 0;
+  while ( true ){
+    string::size_type pos = line.find( '\t', start );
+    if ( pos == string::npos ){
+      result.push_back( line.substr( start ) );
+      break;
+    }
+    result.push_back( line.substr( start, pos-start ) );
+    start = pos+1;
+  }
+  return result;
+}
+
+void correction_delta::describe( const string& input,
+				 const string& command ){
+  /// store the settings needed to replay the corrections on input
+  settings["command"] = command;
+  settings["input"] = input;
+  if ( rebase_inputclass.empty() ){
+    settings["inputclass"] = input_classname;
+  }
+  else {
+    settings["inputclass"] = safe_inputclass;
+  }
+  settings["rebase-inputclass"] = rebase_inputclass;
+  settings["outputclass"] = output_classname;
+  settings["setname"] = setname;
+}
+
+bool correction_delta::save( const string& file_name ) const {
+  ofstream os( file_name );
+  if ( !os ){
+    return false;
+  }
+  os << DELTA_MAGIC << "\t" << DELTA_VERSION << endl;
+  for ( const auto& [key,value] : settings ){
+    os << "S\t" << key << "\t" << value << endl;
+  }
+  for ( const auto& fields : _records ){
+    for ( size_t i=0; i < fields.size(); ++i ){
+      if ( i > 0 ){
+	os << "\t";
+      }
+      os << fields[i];
+    }
+    os << endl;
+  }
+  for ( const auto& [edit,count] : counts ){
+    os << "C\t" << edit << "\t" << count << endl;
+  }
+  return os.good();
+}
+
+bool correction_delta::load( const string& file_name, string& error ){
+  /// read a delta file. On failure, error holds the reason
+  ifstream is( file_name );
+  if ( !is ){
+    error = "unable to open " + file_name;
+    return false;
+  }
+  string line;
+  if ( !getline( is, line )
+       || line != DELTA_MAGIC + "\t" + TiCC::toString(DELTA_VERSION) ){
+    error = file_name + " is not a version "
+      + TiCC::toString(DELTA_VERSION) + " FoLiA-correct delta";
+    return false;
+  }
+  while ( getline( is, line ) ){
+    if ( line.empty() ){
+      continue;
+    }
+    vector<string> fields = split_fields( line );
+    const string& type = fields[0];
+    size_t count;
+    if ( type == "S" && fields.size() == 3 ){
+      settings[fields[1]] = fields[2];
+      continue;
+    }
+    else if ( type == "R" && fields.size() == 7 ){
+      _records.push_back( fields );
+      continue;
+    }
+    else if ( !_records.empty()
+	      && ( ( type == "E" && fields.size() >= 6
+		     && fields.size() % 2 == 0 )
+		   || ( type == "K" && fields.size() == 3 )
+		   || ( type == "N" && fields.size() == 1 ) ) ){
+      // the changes of the last root
+      _records.push_back( fields );
+      continue;
+    }
+    else if ( type == "C" && fields.size() == 3
+	      && TiCC::stringTo( fields[2], count ) ){
+      counts[fields[1]] += count;
+      continue;
+    }
+    error = "invalid line in " + file_name + ": " + line;
+    return false;
+  }
+  return true;
+}
+
+class string_arena {
+  /// stores strings back to back in large blocks. A stored string never
+  /// moves, so lookup tables can use string_view keys into the arena, and
+  /// a string costs no more than its characters.
+public:
+  string_arena(): _next(0), _free(0) {};
+  string_arena( const string_arena& ) = delete;
+  string_arena& operator=( const string_arena& ) = delete;
+  string_view add( string_view );
+  string_view intern( string_view );
+private:
+  static const size_t block_size = 1024*1024;
+  vector<unique_ptr<char[]>> _blocks;
+  char *_next;
+  size_t _free;
+  unordered_set<string_view> _interned;
+};
+
+string_view string_arena::add( string_view s ){
+  if ( s.empty() ){
+    // there may be no block to point into yet
+    return string_view();
+  }
+  if ( s.size() > _free ){
+    size_t size = std::max( block_size, s.size() );
+    _blocks.emplace_back( new char[size] );
+    _next = _blocks.back().get();
+    _free = size;
+  }
+  memcpy( _next, s.data(), s.size() );
+  string_view result( _next, s.size() );
+  _next += s.size();
+  _free -= s.size();
+  return result;
+}
+
+string_view string_arena::intern( string_view s ){
+  /// like add(), but equal strings are only stored once
+  const auto it = _interned.find( s );
+  if ( it != _interned.end() ){
+    return *it;
+  }
+  string_view result = add( s );
+  _interned.insert( result );
+  return result;
+}
+
+struct suggestion_span {
+  uint32_t first;
+  uint32_t count;
+};
+
+class variant_table {
+  /// the ranked suggestions for all variant keys. The keys and the
+  /// suggested words live in an arena (every word is stored once), and
+  /// the suggestions for one key are a span in a single array.
+public:
+  bool add( string_view, const vector<word_conf>& );
+  variant_list find( string_view ) const;
+  variant_list list( const suggestion_span& span ) const {
+    return variant_list( _suggestions.data() + span.first, span.count );
+  };
+  const unordered_map<string_view,suggestion_span>& keys() const {
+    return _spans;
+  };
+  size_t size() const { return _spans.size(); };
+  bool empty() const { return _spans.empty(); };
+  void shrink() { _suggestions.shrink_to_fit(); };
+private:
+  string_arena _strings;
+  unordered_map<string_view,suggestion_span> _spans;
+  vector<suggestion> _suggestions;
+};
+
+bool variant_table::add( string_view key, const vector<word_conf>& vec ){
+  /// set the suggestions for key. A key can only be added once: then false
+  /// is returned and the table is unchanged. Don't add while variant_lists
+  /// are in use: the array may move.
+  if ( _spans.find( key ) != _spans.end() ){
+    return false;
+  }
+  suggestion_span span;
+  span.first = _suggestions.size();
+  span.count = vec.size();
+  for ( const auto& wc : vec ){
+    string_view word = _strings.intern( wc.word );
+    suggestion sugg;
+    sugg.word = word.data();
+    sugg.length = word.size();
+    sugg.confidence = wc.conf;
+    _suggestions.push_back( sugg );
+  }
+  _spans[_strings.add( key )] = span;
+  return true;
+}
+
+variant_list variant_table::find( string_view key ) const {
+  const auto it = _spans.find( key );
+  if ( it == _spans.end() ){
+    return variant_list();
+  }
+  return list( it->second );
+}
+
+struct filter_counts {
+  size_t hits = 0;
+  size_t misses = 0;
+};
+
+// the filter results of the current thread, added to the edit statistics
+// per correction root
+thread_local filter_counts filter_stats;
+
+// where the correction traces of the current thread go
+thread_local ostream *trace_stream = &cout;
+
+ostream& trace(){
+  return *trace_stream;
+}
+
+class token_buffer;
+
+class ngram_trie {
+  /// a trie over the tokens of the n-gram keys of a text lexicon. A SEPCHAR
+  /// joined key is stored as a path of tokens, so one walk from a position
+  /// in the token stream finds every n-gram starting there that has a
+  /// lexicon entry. Unigram keys are not stored: the lexicon filter handles
+  /// those. The trie holds views on the keys, so these must outlive it.
+public:
+  ngram_trie(): _final(1,false) {};
+  void add( string_view );
+  uint32_t step( uint32_t, string_view ) const;
+  bool is_final( uint32_t node ) const { return _final[node]; };
+  bool empty() const { return _edges.empty(); };
+private:
+  unordered_map<string_view,uint32_t> _ids;
+  unordered_map<uint64_t,uint32_t> _edges;
+  vector<bool> _final;
+};
+
+void ngram_trie::add( string_view key ){
+  uint32_t node = 0;
+  while ( true ){
+    size_t pos = key.find( SEPCHAR );
+    string_view tok = key.substr( 0, pos );
+    uint32_t id = _ids.emplace( tok, _ids.size()+1 ).first->second;
+    uint64_t edge = ( uint64_t(node) << 32 ) | id;
+    const auto it = _edges.find( edge );
+    if ( it == _edges.end() ){
+      uint32_t next = _final.size();
+      _final.push_back( false );
+      _edges[edge] = next;
+      node = next;
+    }
+    else {
+      node = it->second;
+    }
+    if ( pos == string_view::npos ){
+      break;
+    }
+    key.remove_prefix( pos+1 );
+  }
+  _final[node] = true;
+}
+
+uint32_t ngram_trie::step( uint32_t node, string_view tok ) const {
+  /// follow the edge for tok from node. Returns 0 when there is none
+  const auto id = _ids.find( tok );
+  if ( id == _ids.end() ){
+    return 0;
+  }
+  const auto it = _edges.find( ( uint64_t(node) << 32 ) | id->second );
+  if ( it == _edges.end() ){
+    return 0;
+  }
+  return it->second;
+}
+
+class ticcl_lexicon {
+  /// the variants, unknowns and puncts used for correction. They are read
+  /// from the TICCL files, or taken from a compiled lexicon file.
+public:
+  ticcl_lexicon(): num_sugg(10) {};
+  variant_list find_variants( string_view ) const;
+  bool is_unknown( string_view ) const;
+  bool find_punct( string_view, string& ) const;
+  void use_image( const string& );
+  void check_image( const string& );
+  void compile( const string& ) const;
+  void compile( lexicon_builder& ) const;
+  bool is_mapped() const { return image.is_open(); };
+  const lexicon_filter& token_filter() const {
+    return is_mapped() ? image.filter() : filter;
+  };
+  void build_index();
+  vector<unsigned int> scan( const token_buffer& ) const;
+  variant_table variants;
+  unordered_set<string_view> unknowns;
+  unordered_map<string_view,string> puncts;
+  string_arena unknown_keys;
+  string_arena punct_keys;
+  mapped_lexicon image;
+  ngram_trie index;      // only for text lexicons
+  lexicon_filter filter; // only for text lexicons
+  size_t num_sugg;
+};
+
+variant_list ticcl_lexicon::find_variants( string_view word ) const {
+  if ( is_mapped() ){
+    const lexicon_entry *e = image.find( word );
+    if ( e && ( e->flags & LEX_VARIANT ) ){
+      return variant_list( image, *e, num_sugg );
+    }
+    return variant_list();
+  }
+  return variants.find( word );
+}
+
+bool ticcl_lexicon::is_unknown( string_view word ) const {
+  bool result;
+  if ( is_mapped() ){
+    const lexicon_entry *e = image.find( word );
+    result = e && ( e->flags & LEX_UNKNOWN );
+  }
+  else {
+    result = unknowns.find( word ) != unknowns.end();
+  }
+  return result;
+}
+
+bool ticcl_lexicon::find_punct( string_view word, string& value ) const {
+  bool result = false;
+  if ( is_mapped() ){
+    const lexicon_entry *e = image.find( word );
+    if ( e && ( e->flags & LEX_VALUE ) ){
+      value = image.value( *e );
+      result = true;
+    }
+  }
+  else {
+    const auto pit = puncts.find( word );
+    if ( pit != puncts.end() ){
+      value = pit->second;
+      result = true;
+    }
+  }
+  return result;
+}
+
+void ticcl_lexicon::use_image( const string& file_name ){
+  /// use a lexicon file, created with --compile-lexicon
+  image.open( file_name );
+  check_image( file_name );
+}
+
+void ticcl_lexicon::check_image( const string& file_name ){
+  /// make sure the mapped image fits our settings
+  if ( image.ngram_size() != ngram_size ){
+    throw runtime_error( "lexicon '" + file_name + "' was compiled for "
+			 + "--ngram=" + TiCC::toString(image.ngram_size())
+			 + ", not for --ngram="
+			 + TiCC::toString(ngram_size) );
+  }
+  if ( num_sugg > image.num_sugg() ){
+    num_sugg = image.num_sugg();
+  }
+}
+
+void ticcl_lexicon::compile( const string& file_name ) const {
+  /// store the variants, unknowns and puncts as one mmap-able lexicon
+  lexicon_builder builder( ngram_size, num_sugg );
+  compile( builder );
+  builder.save( file_name );
+}
+
+void ticcl_lexicon::compile( lexicon_builder& builder ) const {
+  for ( const auto& [word,span] : variants.keys() ){
+    variant_list vl = variants.list( span );
+    for ( size_t i=0; i < vl.size(); ++i ){
+      builder.add_variant( string(word), vl.word(i), vl.confidence(i) );
+    }
+  }
+  for ( const auto& word : unknowns ){
+    builder.add_unknown( string(word) );
+  }
+  for ( const auto& [word,value] : puncts ){
+    builder.add_value( string(word), value );
+  }
+}
+
+void ticcl_lexicon::build_index(){
+  /// index the keys of a text lexicon: the filter gets every token of every
+  /// key, the trie only the n-gram keys. A compiled lexicon carries its own
+  /// filter, and needs no trie.
+  if ( is_mapped() ){
+    return;
+  }
+  size_t token_count = 0;
+  auto count_tokens = [&token_count]( string_view key ){
+    token_count += count( key.begin(), key.end(), SEPCHAR ) + 1;
+  };
+  auto add_key = [this]( string_view key ){
+    filter.add_tokens( key );
+    if ( key.find( SEPCHAR ) != string_view::npos ){
+      index.add( key );
+    }
+  };
+  for ( const auto& it : variants.keys() ){
+    count_tokens( it.first );
+  }
+  for ( const auto& word : unknowns ){
+    count_tokens( word );
+  }
+  for ( const auto& it : puncts ){
+    count_tokens( it.first );
+  }
+  filter.init( token_count );
+  for ( const auto& it : variants.keys() ){
+    add_key( it.first );
+  }
+  for ( const auto& word : unknowns ){
+    add_key( word );
+  }
+  for ( const auto& it : puncts ){
+    add_key( it.first );
+  }
+}
+
+struct token_r {
+  /// one unigram, as found in the document (after HEMP replacement)
+  token_r( const string& t, FoliaElement *w ): text(t), word(w){};
+  explicit token_r( const string& t ): token_r(t,0){};
+  string text;
+  FoliaElement *word;
+};
+
+ostream& operator<<( ostream& os, const token_r& tok ){
+  os << tok.text;
+  if ( tok.word ){
+    os << " " << tok.word;
+  }
+  return os;
+}
+
+class token_buffer {
+  /// all tokens of one correction root, joined with SEPCHAR. So every
+  /// n-gram key is a substring of this buffer, and candidate n-grams can be
+  /// looked up without building new strings.
+public:
+  explicit token_buffer( const vector<token_r>& );
+  size_t size() const { return _words.size(); };
+  size_t length() const { return _text.size(); };
+  string_view ngram( size_t start, size_t n ) const {
+    return view( _text, start, n );
+  }
+  string_view key( size_t start, size_t n ) const {
+    /// the n-gram with '#' replaced by '.', for bigram and trigram lookups
+    return view( _filtered.empty() ? _text : _filtered, start, n );
+  }
+  FoliaElement *word( size_t i ) const { return _words[i]; };
+  bool is_filtered() const { return !_filtered.empty(); };
+private:
+  string_view view( const string& s, size_t start, size_t n ) const {
+    return string_view( s ).substr( _begin[start],
+				    _begin[start+n] - _begin[start] - 1 );
+  }
+  string _text;
+  string _filtered;
+  vector<size_t> _begin;
+  vector<FoliaElement*> _words;
+};
+
+token_buffer::token_buffer( const vector<token_r>& tokens ){
+  _begin.reserve( tokens.size() + 1 );
+  _words.reserve( tokens.size() );
+  size_t len = 0;
+  for ( const auto& tok : tokens ){
+    len += tok.text.size() + 1;
+  }
+  _text.reserve( len );
+  for ( const auto& tok : tokens ){
+    _begin.push_back( _text.size() );
+    _text += tok.text;
+    _text += SEPCHAR;
+    _words.push_back( tok.word );
+  }
+  _begin.push_back( _text.size() );
+  if ( _text.find( '#' ) != string::npos ){
+    _filtered = _text;
+    std::replace( _filtered.begin(), _filtered.end(), '#', '.' );
+  }
+}
+
+vector<unsigned int> ticcl_lexicon::scan( const token_buffer& tokens ) const {
+  /// one left to right pass over the tokens, finding the n-grams that may
+  /// have a lexicon entry, as a bit set per start position: bit n is set for
+  /// a possibly known n-gram, bit 0 for the '#' filtered unigram.
+  /// Every token is first checked against the filter. A rejected token is in
+  /// no key at all, so it also ends every n-gram that would include it.
+  /// For a text lexicon the trie then confirms the n-grams, for a compiled
+  /// lexicon a single probe in the image does that later.
+  const lexicon_filter& tok_filter = token_filter();
+  vector<unsigned int> result( tokens.size(), 0 );
+  vector<bool> pass( tokens.size() );
+  for ( size_t i=0; i < tokens.size(); ++i ){
+    string_view tok = tokens.ngram( i, 1 );
+    string_view key = tokens.key( i, 1 );
+    bool raw = tok_filter.may_contain( tok );
+    bool filtered = ( key == tok ) ? raw : tok_filter.may_contain( key );
+    pass[i] = filtered;
+    if ( raw || filtered ){
+      ++filter_stats.hits;
+    }
+    else {
+      ++filter_stats.misses;
+    }
+    if ( filtered ){
+      result[i] |= 1u;
+    }
+    if ( raw ){
+      result[i] |= 2u;
+    }
+  }
+  if ( ngram_size < 2 ){
+    return result;
+  }
+  for ( size_t i=0; i+1 < tokens.size(); ++i ){
+    uint32_t node = 0;
+    for ( size_t n=1; n <= ngram_size && i+n <= tokens.size(); ++n ){
+      if ( !pass[i+n-1] ){
+	break;
+      }
+      if ( !is_mapped() ){
+	node = index.step( node, tokens.key( i+n-1, 1 ) );
+	if ( node == 0 ){
+	  break;
+	}
+	if ( n > 1 && index.is_final( node ) ){
+	  result[i] |= 1u << n;
+	}
+      }
+      else if ( n > 1 ){
+	result[i] |= 1u << n;
+      }
+    }
+  }
+  return result;
+}
+
+class root_plan;
+
 class gram_r {
-  friend vector<gram_r> extract_bigrams( const vector<gram_r>&  );
-  friend vector<gram_r> extract_trigrams( const vector<gram_r>&  );
-  friend gram_r extract_last_bigram( const vector<gram_r>&  );
+  /// a candidate n-gram: a window of n tokens in a token_buffer.
+  /// Only when an edit is made, the result strings are created.
   friend ostream& operator<<( ostream& os, const gram_r& );
   friend ostream& operator<<( ostream& os, const gram_r* );
+  friend class root_plan;
 public:
-  gram_r( const string&, FoliaElement* );
-  explicit gram_r( const string& s ): gram_r(s,0){};
+  gram_r( const token_buffer& buf, size_t start, size_t n,
+	  unsigned int known ):
+    _buf(&buf), _start(start), _n(n), _known(known),
+    _filtered(false), _corrected(false) {};
   FoliaElement *get_word( size_t index ) const {
-    if ( _words.empty() ){
-      return 0;
-    }
-    return _words[index];
+    return _buf->word( _start + index );
   }
-  string orig_text() const;
+  string_view orig_view() const {
+    return _filtered ? _buf->key( _start, _n ) : _buf->ngram( _start, _n );
+  }
+  string orig_text() const { return string( orig_view() ); };
   string result_text() const;
-  bool has_space();
-  int correct_one_trigram( const unordered_map<string,vector<word_conf> >&,
-			   const unordered_set<string>&,
-			   const unordered_map<string,string>&,
+  void append_result( string& ) const;
+  bool has_space() const;
+  int correct_one_trigram( const ticcl_lexicon&,
 			   unordered_map<string,size_t>&,
-			   size_t&,
-			   const processor *);
-  int correct_one_bigram( const unordered_map<string,vector<word_conf> >&,
-			  const unordered_set<string>&,
-			  const unordered_map<string,string>&,
+			   root_plan& );
+  int correct_one_bigram( const ticcl_lexicon&,
 			  unordered_map<string,size_t>&,
-			  size_t&,
-			  const processor * );
-  void correct_one_unigram( const unordered_map<string,vector<word_conf> >&,
-			    const unordered_set<string>&,
-			    const unordered_map<string,string>&,
+			  root_plan& );
+  void correct_one_unigram( const ticcl_lexicon&,
 			    unordered_map<string,size_t>&,
-			    size_t&,
-			    const processor * );
+			    root_plan& );
+  int correct( const ticcl_lexicon&,
+	       unordered_map<string,size_t>&,
+	       root_plan& );
 private:
-  void clear(){ _orig.clear(); _result.clear();_words.clear(); };
-  bool has_folia() const { return (!_words.empty() && _words[0]); };
+  bool has_folia() const { return get_word(0) != 0; };
+  bool is_known() const {
+    /// does the lexicon have an entry for this n-gram at all?
+    unsigned int bit = ( _n == 1 && _filtered ) ? 0 : _n;
+    return ( _known >> bit ) & 1u;
+  }
   bool no_depunct() const {
-    if ( !_words.empty() && _words.back() ){
-      return ( _words.back()->cls() == "ABBREVIATION"
-	       || _words.back()->cls() == "ABBREVIATION-KNOWN"
-	       || _words.back()->cls() == "INITIAL"
-	       || _words.back()->cls() == "INITIALS" );
+    FoliaElement *last = get_word( _n-1 );
+    if ( last ){
+      return ( last->cls() == "ABBREVIATION"
+	       || last->cls() == "ABBREVIATION-KNOWN"
+	       || last->cls() == "INITIAL"
+	       || last->cls() == "INITIALS" );
     }
     else {
       return false;
     }
   };
+  vector<FoliaElement*> words() const {
+    vector<FoliaElement*> result( _n );
+    for ( size_t i=0; i < _n; ++i ){
+      result[i] = get_word(i);
+    }
+    return result;
+  }
   string set_ed_type();
+  string correction_kind() const;
+  vector<string> edit_record() const;
   void apply_folia_correction( size_t&, const processor * ) const;
   void set_output_text( size_t& ) const;
+  const token_buffer *_buf;
+  size_t _start;
+  size_t _n;
+  unsigned int _known;  // the known n-grams at _start, see ngram_trie::match
+  bool _filtered;   // the original is the '#' filtered text
+  bool _corrected;
   string _ed_type;
   string _final_punct;
-  vector<string> _orig;
-  vector<string> _result;
-  vector<FoliaElement*> _words;
-  const vector<word_conf>* _suggestions;
+  vector<string> _result; // empty when unchanged
+  variant_list _suggestions;
 };
 
-string gram_r::orig_text() const {
-  string result;
-  for ( const auto& s : _orig ){
-    result += s;
-    if ( &s != &_orig.back() ){
-      result += "_";
-    }
+void gram_r::append_result( string& out ) const {
+  if ( _result.empty() ){
+    out += orig_view();
   }
-  return result;
-}
-
-string gram_r::result_text() const {
-  string result;
-  for ( const auto& s : _result ){
-    result += s;
-    if ( &s != &_result.back() ){
-      result += " ";
+  else {
+    for ( const auto& s : _result ){
+      out += s;
+      if ( &s != &_result.back() ){
+	out += " ";
+      }
     }
   }
   if ( !_final_punct.empty() ){
-    result += punct_sep + _final_punct;
+    out += punct_sep + _final_punct;
   }
-  return result;
 }
 
-gram_r::gram_r( const string& val, FoliaElement *el ) :
-  _suggestions(0)
-{
-  _orig.push_back( val );
-  //  cerr << "create gram_r: " << el->xmlstring() << endl;
-  _words.push_back( el );
+string gram_r::result_text() const {
+  string result;
+  append_result( result );
+  return result;
 }
 
-bool gram_r::has_space( ){
+bool gram_r::has_space() const {
   if ( !has_folia() ){
     return true;
   }
   else {
-    FoliaElement *w = _words.back();
-    if ( w->space() ){
-      if ( verbose > 2 ){
-      }
-      return true;
-    }
-    else {
-      return false;
-    }
+    return get_word( _n-1 )->space();
   }
 }
 
-size_t unicode_size( const string& value ){
-  UnicodeString us = TiCC::UnicodeFromUTF8(value);
-  return us.length();
+size_t unicode_size( string_view value ){
+  /// the length of UTF-8 value in UTF-16 units, like UnicodeString::length()
+  size_t result = 0;
+  for ( const auto& c : value ){
+    unsigned char uc = static_cast<unsigned char>(c);
+    if ( ( uc & 0xC0 ) != 0x80 ){
+      // not a continuation byte. 4 byte sequences need a surrogate pair
+      result += ( uc >= 0xF0 ) ? 2 : 1;
+    }
+  }
+  return result;
 }
 
 void gram_r::set_output_text( size_t& offset ) const {
   // cerr << "SET TEXT on: " << _words[0]->xmlstring() << endl;
   // cerr << "SET TEXT: " << orig_text() << endl;
   // cerr << "SET TEXT class: " << output_classname << endl;
-  _words[0]->settext( orig_text(), offset, output_classname );
-  offset += unicode_size(orig_text()) + 1;
+  get_word(0)->settext( orig_text(), offset, output_classname );
+  offset += unicode_size( orig_view() ) + 1;
 }
 
 ostream& operator<<( ostream& os, const gram_r& rec ){
-  os << rec.orig_text();
-  if ( !rec._result.empty() ){
+  os << rec.orig_view();
+  if ( rec._corrected ){
     os << " (" << rec._ed_type << ") ==> '" << rec.result_text() << "'";
   }
-  if ( rec._words[0] != 0 ){
-    os << " " << rec._words;
+  if ( rec.get_word(0) != 0 ){
+    os << " " << rec.words();
   }
   return os;
 }
@@ -218,39 +877,151 @@ ostream& operator<<( ostream& os, const gram_r *rec ){
   return os;
 }
 
-vector<gram_r> extract_bigrams( const vector<gram_r>& unigrams ){
-  vector<gram_r> result = unigrams;
-  result.pop_back();
-  for ( size_t i=0; i < unigrams.size()-1; ++i ){
-    result[i]._words.push_back( unigrams[i+1]._words[0] );
-    result[i]._orig.push_back( unigrams[i+1].orig_text() );
+class plan_step {
+  /// one action on the FoLiA tree, with the trace output preceding it
+public:
+  enum step_type { EDIT, KEEP, NO_SPACE };
+  plan_step( step_type t, const gram_r& g, const string& tr ):
+    type(t), gram(g), trace(tr) {};
+  step_type type;
+  gram_r gram;
+  string trace;
+};
+
+class root_plan {
+  /// the corrections of one root (p, s, ...). They are decided without
+  /// touching the FoLiA tree, so the roots of a document can be handled in
+  /// parallel. apply() then changes the tree, one root at a time.
+public:
+  root_plan(): root(0), declare(AnnotationType::NO_ANN) {};
+  void add( plan_step::step_type, const gram_r& );
+  void apply( const processor * ) const;
+  void record( correction_delta& ) const;
+  FoliaElement *root;
+  unique_ptr<token_buffer> tokens;
+  vector<plan_step> steps;
+  string corrected;
+  AnnotationType declare;   // the annotation to declare, NO_ANN for none
+  string original_set;
+  KWargs correction_args;
+  unordered_map<string,size_t> counts;
+  ostringstream traces;
+  string trace_tail;
+  string warning;
+  string error;
+};
+
+void root_plan::add( plan_step::step_type type, const gram_r& gram ){
+  steps.push_back( plan_step( type, gram, traces.str() ) );
+  traces.str( "" );
+}
+
+void root_plan::apply( const processor *proc ) const {
+  if ( !warning.empty() ){
+    cerr << warning << endl;
+  }
+  if ( declare != AnnotationType::NO_ANN ){
+    KWargs args = correction_args;
+    args["processor"] = proc->id();
+    root->doc()->declare( declare, original_set, args );
+  }
+  size_t offset = 0;
+  for ( const auto& step : steps ){
+    cout << step.trace;
+    switch ( step.type ){
+    case plan_step::EDIT:
+      step.gram.apply_folia_correction( offset, proc );
+      break;
+    case plan_step::KEEP:
+      step.gram.set_output_text( offset );
+      break;
+    case plan_step::NO_SPACE:
+      --offset;
+      break;
+    }
+  }
+  cout << trace_tail;
+  if ( !corrected.empty() ){
+    root->settext( corrected, output_classname );
   }
-  return result;
 }
 
-vector<gram_r> extract_trigrams( const vector<gram_r>& unigrams ){
-  vector<gram_r> result = unigrams;
-  result.pop_back();
-  result.pop_back();
-  for ( size_t i=0; i < unigrams.size()-2; ++i ){
-    result[i]._words.push_back( unigrams[i+1]._words[0] );
-    result[i]._orig.push_back( unigrams[i+1].orig_text() );
-    result[i]._words.push_back( unigrams[i+2]._words[0] );
-    result[i]._orig.push_back( unigrams[i+2].orig_text() );
+string input_hash( FoliaElement *root ){
+  /// a hash of the text of root that is corrected: the text of its words or
+  /// strings, when it has those. A delta only applies to a root with the
+  /// same text
+  string text;
+  vector<FoliaElement*> ev;
+  vector<Word*> wv = root->select<Word>();
+  if ( !wv.empty() ){
+    ev.assign( wv.begin(), wv.end() );
   }
-  return result;
+  else {
+    vector<String*> sv = root->select<String>();
+    ev.assign( sv.begin(), sv.end() );
+  }
+  if ( ev.empty() ){
+    vector<TextContent *> origV
+      = root->select<TextContent>(SELECT_FLAGS::LOCAL);
+    if ( origV.empty() ){
+      origV = root->select<TextContent>();
+    }
+    for ( const auto& it : origV ){
+      text += it->str(input_classname) + " ";
+    }
+  }
+  for ( const auto& it : ev ){
+    text += it->str(input_classname);
+    if ( it->space() ){
+      text += " ";
+    }
+  }
+  return text_hash( text );
 }
 
-gram_r extract_last_bigram( const vector<gram_r>& unigrams ){
-  gram_r result = unigrams[unigrams.size()-2];
-  gram_r last = unigrams[unigrams.size()-1];
-  result._orig.push_back( last.orig_text() );
-  result._words.push_back( last._words[0] );
-  return result;
+void root_plan::record( correction_delta& delta ) const {
+  /// add the changes that apply() makes to delta. Call it before apply(),
+  /// while root still has its original text
+  if ( steps.empty() && corrected.empty()
+       && declare == AnnotationType::NO_ANN ){
+    // apply() doesn't change root
+    return;
+  }
+  if ( root->id().empty() ){
+    throw runtime_error( "a delta needs an xml:id on every "
+			 + root->xmltag() + " that is corrected" );
+  }
+  string declared = "-";
+  if ( declare == AnnotationType::STRING ){
+    declared = "string";
+  }
+  else if ( declare == AnnotationType::TOKEN ){
+    declared = "token";
+  }
+  string alias;
+  const auto it = correction_args.find( "alias" );
+  if ( it != correction_args.end() ){
+    alias = it->second;
+  }
+  delta.add( { "R", root->id(), input_hash( root ), declared,
+	       original_set, alias, corrected } );
+  for ( const auto& step : steps ){
+    switch ( step.type ){
+    case plan_step::EDIT:
+      delta.add( step.gram.edit_record() );
+      break;
+    case plan_step::KEEP:
+      delta.add( { "K", step.gram.get_word(0)->id(), step.gram.orig_text() } );
+      break;
+    case plan_step::NO_SPACE:
+      delta.add( { "N" } );
+      break;
+    }
+  }
 }
 
 bool fillVariants( const string& fn,
-		   unordered_map<string,vector<word_conf> >& variants,
+		   variant_table& variants,
 		   size_t numSugg ){
   ifstream is( fn );
   string line;
@@ -276,7 +1047,10 @@ bool fillVariants( const string& fn,
 	  if ( vec.size() > numSugg ){
 	    vec.resize( numSugg );
 	  }
-	  variants[current_word] = vec;
+	  if ( !variants.add( current_word, vec ) ){
+	    cerr << "duplicate variant '" << current_word << "' in " << fn
+		 << ", only its first suggestions are used" << endl;
+	  }
 	  vec.clear();
 	}
 	current_word = word;
@@ -287,18 +1061,12 @@ bool fillVariants( const string& fn,
 	// skip 'too long' n-gram variants
 	continue;
       }
-      string confS;
-      if ( parts.size() == 7 ){
-	confS = "1.0";
+      float conf = 1.0;
+      if ( parts.size() == 6
+	   && !TiCC::stringTo<float>( parts[5], conf ) ){
+	conf = 1.0;
       }
-      else {
-	confS = parts[5];
-	double d;
-	if ( !TiCC::stringTo<double>( confS, d ) ){
-	  confS = "1.0";
-	}
-      }
-      vec.push_back( word_conf( trans, confS ) );
+      vec.push_back( word_conf( trans, conf ) );
     }
     else {
       cerr << "error in line " << line << endl;
@@ -308,12 +1076,18 @@ bool fillVariants( const string& fn,
     if ( vec.size() > numSugg ){
       vec.resize( numSugg );
     }
-    variants[current_word] = vec;
+    if ( !variants.add( current_word, vec ) ){
+      cerr << "duplicate variant '" << current_word << "' in " << fn
+	   << ", only its first suggestions are used" << endl;
+    }
   }
+  variants.shrink();
   return !variants.empty();
 }
 
-bool fillUnknowns( const string& fn, unordered_set<string>& unknowns ){
+bool fillUnknowns( const string& fn,
+		   unordered_set<string_view>& unknowns,
+		   string_arena& keys ){
   ifstream is( fn );
   string line;
   while ( getline( is, line ) ) {
@@ -325,7 +1099,9 @@ bool fillUnknowns( const string& fn, unordered_set<string>& unknowns ){
 	double dum;
 	if ( !TiCC::stringTo( parts[0], dum ) ){
 	  // 'true' numeric values are never UNK
-	  unknowns.insert( parts[0] );
+	  if ( unknowns.find( parts[0] ) == unknowns.end() ){
+	    unknowns.insert( keys.add( parts[0] ) );
+	  }
 	}
       }
     }
@@ -336,13 +1112,21 @@ bool fillUnknowns( const string& fn, unordered_set<string>& unknowns ){
   return !unknowns.empty();
 }
 
-bool fillPuncts( const string& fn, unordered_map<string,string>& puncts ){
+bool fillPuncts( const string& fn,
+		 unordered_map<string_view,string>& puncts,
+		 string_arena& keys ){
   ifstream is( fn );
   string line;
   while ( getline( is, line ) ) {
     vector<string> parts = TiCC::split( line );
     if ( parts.size() == 2 ){
-      puncts[parts[0]] = parts[1];
+      const auto it = puncts.find( parts[0] );
+      if ( it != puncts.end() ){
+	it->second = parts[1];
+      }
+      else {
+	puncts[keys.add( parts[0] )] = parts[1];
+      }
     }
     else {
       cerr << "error reading punct value from line " << line << endl;
@@ -355,204 +1139,255 @@ void filter( string& word, char c = '#' ){
   std::replace( word.begin(), word.end(), c, '.' );
 }
 
-bool solve_punctuation( string& word,
-			const unordered_map<string,string>& puncts,
+bool solve_punctuation( string_view word,
+			const ticcl_lexicon& lex,
+			string& new_word,
 			string& final ){
   const string real_puncts = ".,;!?:";
   final.clear();
-  const auto pit = puncts.find( word );
   bool result = false;
-  if ( pit != puncts.end() ){
+  if ( lex.find_punct( word, new_word ) ){
     result = true;
-    string new_word = pit->second;
     if ( real_puncts.find(word.back()) != string::npos
 	 && new_word.back() != word.back() ){
       final = word.back();
     }
-    word = new_word;
   }
   return result;
 }
 
 string gram_r::set_ed_type() {
-  size_t o_s = _orig.size();
+  size_t o_s = _n;
   size_t r_s = _result.size();
   _ed_type = TiCC::toString(o_s) + "-" + TiCC::toString(r_s);
   return _ed_type;
 }
 
-void gram_r::apply_folia_correction( size_t& offset,
-				     const processor *proc ) const {
+string gram_r::correction_kind() const {
+  if ( _ed_type == "1-1"
+       || _ed_type == "2-2"
+       || _ed_type == "3-3" ){
+    return "edit";
+  }
+  else if ( _ed_type == "2-1"
+	    || _ed_type == "3-1"
+	    || _ed_type == "3-2" ){
+    return "merge";
+  }
+  else {
+    return "split";
+  }
+}
+
+vector<string> gram_r::edit_record() const {
+  /// this edit, as an E record of a correction_delta
+  string ids;
   if ( has_folia() ){
-    bool doStrings = _words[0]->xmltag() == "str";
-    string org_set = _words[0]->sett();
-    string what;
-    if ( _ed_type == "1-1"
-	 || _ed_type == "2-2"
-	 || _ed_type == "3-3" ){
-      what = "edit";
-    }
-    else if ( _ed_type == "2-1"
-	      || _ed_type == "3-1"
-	      || _ed_type == "3-2" ){
-      what = "merge";
+    for ( const auto& w : words() ){
+      if ( !ids.empty() ){
+	ids += " ";
+      }
+      ids += w->id();
+    }
+  }
+  else {
+    ids = "-";
+  }
+  string result;
+  for ( const auto& s : _result ){
+    if ( !result.empty() ){
+      result += SEPARATOR;
+    }
+    result += s;
+  }
+  vector<string> record = { "E", ids, orig_text(), correction_kind(),
+			    result, _final_punct };
+  for ( size_t i=0; i < _suggestions.size(); ++i ){
+    record.push_back( _suggestions.word(i) );
+    record.push_back( _suggestions.conf(i) );
+  }
+  return record;
+}
+
+void add_correction( const vector<FoliaElement*>& oV,
+		     const string& what,
+		     const vector<string>& result,
+		     const string& final_punct,
+		     const vector<pair<string,string>>& suggestions,
+		     size_t& offset,
+		     const processor *proc ){
+  /// replace the words in oV by a Correction with the words in result (and
+  /// final_punct) as New elements, and the suggestions, when more than 1.
+  /// what is "edit", "merge" or "split"
+  FoliaElement *first = oV.front();
+  FoliaElement *last = oV.back();
+  bool doStrings = first->xmltag() == "str";
+  string org_set = first->sett();
+  vector<FoliaElement*> sV;
+  vector<FoliaElement*> cV;
+  vector<FoliaElement*> nV;
+  for ( const auto& p : result ){
+    // New elements
+    KWargs args;
+    args["xml:id"] = first->generateId( what );
+    if ( org_set != "None" ){
+      args["set"] = org_set;
+    }
+    args["processor"] = proc->id();
+    if ( &p == &result.back() ){
+      if ( !last->space() ){
+	args["space"] = "no";
+      }
+    }
+    FoliaElement *el = 0;
+    if ( doStrings ){
+      el = new String( args, first->doc() );
     }
     else {
-      what = "split";
+      el = new Word( args, first->doc() );
     }
-    if ( verbose > 3 ){
-      cerr << what << " ngram: " << this << endl;
+    el->settext( p, offset, output_classname );
+    offset += unicode_size(p) + 1;
+    nV.push_back( el );
+  }
+  if ( !final_punct.empty() ){
+    // A final punct is an extra New element
+    KWargs args;
+    args["xml:id"] = first->generateId( "split" );
+    if ( org_set != "None" ){
+      args["set"] = org_set;
     }
-    vector<FoliaElement*> oV = _words;
-    vector<FoliaElement*> sV;
-    vector<FoliaElement*> cV;
-    vector<FoliaElement*> nV;
-    for ( const auto& p : _result ){
-      // New elements
-      KWargs args;
-      args["xml:id"] = _words[0]->generateId( what );
-      if ( org_set != "None" ){
-	args["set"] = org_set;
-      }
-      args["processor"] = proc->id();
-      if ( &p == &_result.back() ){
-	if ( !_words.back()->space() ){
-	  args["space"] = "no";
-	}
-      }
-      FoliaElement *el = 0;
-      if ( doStrings ){
-	el = new String( args, _words[0]->doc() );
-      }
-      else {
-	el = new Word( args, _words[0]->doc() );
-      }
-      el->settext( p, offset, output_classname );
-      offset += unicode_size(p) + 1;
-      nV.push_back( el );
+    if ( !last->space() ){
+      args["space"] = "no";
     }
-    if ( !_final_punct.empty() ){
-      // A final punct is an extra New element
-      KWargs args;
-      args["xml:id"] = _words[0]->generateId( "split" );
-      if ( org_set != "None" ){
-	args["set"] = org_set;
-      }
-      if ( !_words.back()->space() ){
-	args["space"] = "no";
-      }
-      args["processor"] = proc->id();
-      FoliaElement *el = 0;
-      if ( doStrings ){
-	el = new String( args, _words[0]->doc() );
-      }
-      else {
-	el = new Word( args, _words[0]->doc() );
-      }
-      el->settext( _final_punct, offset, output_classname );
-      offset += unicode_size(_final_punct) + 1;
-      nV.push_back( el );
-    }
-    if ( _suggestions && _suggestions->size() > 1 ){
-      // Suggestion elements
-      size_t limit = _suggestions->size();
-      for( size_t j=0; j < limit; ++j ){
-	KWargs sargs;
-	sargs["confidence"] = (*_suggestions)[j].conf;
-	sargs["n"]= TiCC::toString(j+1) + "/" + TiCC::toString(limit);
-	Suggestion *sug = new Suggestion( sargs );
-	sV.push_back( sug );
-	vector<string> parts = TiCC::split_at( (*_suggestions)[j].word,
-					       SEPARATOR );
-	for ( const auto& s : parts ){
-	  KWargs wargs;
-	  wargs["xml:id"] = _words[0]->generateId( "suggestion" );
-	  if ( org_set != "None" ){
-	    wargs["set"] = org_set;
-	  }
-	  if ( !_words.back()->space() ){
-	    wargs["space"] = "no";
-	  }
-	  wargs["processor"] = proc->id();
-	  FoliaElement *elt;
-	  if ( doStrings ){
-	    elt = sug->add_child<String>( wargs );
-	  }
-	  else {
-	    elt = sug->add_child<Word>( wargs );
-	  }
-	  elt->settext( s, output_classname );
+    args["processor"] = proc->id();
+    FoliaElement *el = 0;
+    if ( doStrings ){
+      el = new String( args, first->doc() );
+    }
+    else {
+      el = new Word( args, first->doc() );
+    }
+    el->settext( final_punct, offset, output_classname );
+    offset += unicode_size(final_punct) + 1;
+    nV.push_back( el );
+  }
+  if ( suggestions.size() > 1 ){
+    // Suggestion elements
+    size_t limit = suggestions.size();
+    for( size_t j=0; j < limit; ++j ){
+      KWargs sargs;
+      sargs["confidence"] = suggestions[j].second;
+      sargs["n"]= TiCC::toString(j+1) + "/" + TiCC::toString(limit);
+      Suggestion *sug = new Suggestion( sargs );
+      sV.push_back( sug );
+      vector<string> parts = TiCC::split_at( suggestions[j].first,
+					     SEPARATOR );
+      for ( const auto& s : parts ){
+	KWargs wargs;
+	wargs["xml:id"] = first->generateId( "suggestion" );
+	if ( org_set != "None" ){
+	  wargs["set"] = org_set;
+	}
+	if ( !last->space() ){
+	  wargs["space"] = "no";
+	}
+	wargs["processor"] = proc->id();
+	FoliaElement *elt;
+	if ( doStrings ){
+	  elt = sug->add_child<String>( wargs );
+	}
+	else {
+	  elt = sug->add_child<Word>( wargs );
 	}
+	elt->settext( s, output_classname );
       }
     }
+  }
+  if ( verbose > 3 ){
+    cerr << "correct node: " << first->parent() << endl;
+    cerr << "original=" << oV << endl;
+    cerr << "new=" << nV << endl;
+    cerr << "suggestions=" << nV << endl;
+  }
+  KWargs cor_args;
+  cor_args["processor"] = proc->id();
+  Correction *c = first->parent()->correct( oV, cV, nV, sV, cor_args );
+  if ( verbose > 3 ){
+    cerr << "created: " << c->xmlstring() << endl;
+  }
+  else if ( verbose > 1 ){
+    cerr << "created: " << c << endl;
+  }
+}
+
+void gram_r::apply_folia_correction( size_t& offset,
+				     const processor *proc ) const {
+  if ( has_folia() ){
+    string what = correction_kind();
     if ( verbose > 3 ){
-      cerr << "correct node: " << _words[0]->parent() << endl;
-      cerr << "original=" << oV << endl;
-      cerr << "new=" << nV << endl;
-      cerr << "suggestions=" << nV << endl;
-    }
-    KWargs cor_args;
-    cor_args["processor"] = proc->id();
-    Correction *c = _words[0]->parent()->correct( oV, cV, nV, sV, cor_args );
-    if ( verbose > 3 ){
-      cerr << "created: " << c->xmlstring() << endl;
+      cerr << what << " ngram: " << this << endl;
     }
-    else if ( verbose > 1 ){
-      cerr << "created: " << c << endl;
+    vector<pair<string,string>> suggestions;
+    for ( size_t j=0; j < _suggestions.size(); ++j ){
+      suggestions.push_back( make_pair( _suggestions.word(j),
+					_suggestions.conf(j) ) );
     }
+    add_correction( words(), what, _result, _final_punct, suggestions,
+		    offset, proc );
   }
 }
 
-void gram_r::correct_one_unigram( const unordered_map<string,vector<word_conf> >& variants,
-				  const unordered_set<string>& unknowns,
-				  const unordered_map<string,string>& puncts,
+void gram_r::correct_one_unigram( const ticcl_lexicon& lex,
 				  unordered_map<string,size_t>& counts,
-				  size_t& offset,
-				  const processor *proc ){
+				  root_plan& plan ){
   bool did_edit = false;
   if ( verbose > 2 ){
-    cout << "correct unigram " << this << endl;
+    trace() << "correct unigram " << this << endl;
   }
-  string word = orig_text();
-  string orig_word = word;
+  string_view orig_word = orig_view();
+  string_view word = orig_word;
+  string depuncted;
   string final_punct;
   bool is_punct = false;
-  if ( !no_depunct() ){
+  // when the trie has no entry, every lookup below would fail
+  bool known = is_known();
+  if ( known && !no_depunct() ){
     if ( ngram_size > 1 ){
-      is_punct = solve_punctuation( word, puncts, final_punct );
+      is_punct = solve_punctuation( word, lex, depuncted, final_punct );
       if ( is_punct ){
+	word = depuncted;
 	if ( verbose > 2 ){
-	  cout << "punctuated word found, final='" << final_punct << "'" << endl;
-	  cout << "depuncted word   : '" << word << "'" << endl;
+	  trace() << "punctuated word found, final='" << final_punct << "'" << endl;
+	  trace() << "depuncted word   : '" << word << "'" << endl;
 	}
       }
     }
   }
-  const auto vit = variants.find( word );
-  if ( vit != variants.end() ){
+  _result.clear();
+  variant_list vl;
+  if ( known ){
+    vl = lex.find_variants( word );
+  }
+  if ( !vl.empty() ){
     // 1 or more edits found
-    _suggestions = &vit->second;
-    _result.clear();
+    _suggestions = vl;
     // edit might be seperatable!
-    string edit = vit->second[0].word;
-    vector<string> parts = TiCC::split_at( edit, SEPARATOR );
-    _result = parts;
+    _result = TiCC::split_at( vl.word(0), SEPARATOR );
     _final_punct = final_punct;
+    _corrected = true;
     string ed = set_ed_type( );
     ++counts[ed];
     if ( verbose > 1 ){
-      cout << word << " = " << ed << " => " << result_text() << endl;
+      trace() << word << " = " << ed << " => " << result_text() << endl;
     }
     did_edit = true;
   }
   else {
     // a word with no suggested variants
-    _result.clear();
-    auto uit = unknowns.find( word );
-    if ( uit == unknowns.end() ){
-      uit = unknowns.find( orig_word );
-    }
-    if ( uit != unknowns.end() ){
+    if ( known
+	 && ( lex.is_unknown( word )
+	      || lex.is_unknown( orig_word ) ) ){
       // ok it is a registrated garbage word
       _result.push_back( "UNK" );
       set_ed_type( );
@@ -560,376 +1395,278 @@ void gram_r::correct_one_unigram( const unordered_map<string,vector<word_conf> >
       did_edit = true;
     }
     else if ( is_punct ){
-      _result.push_back( word );
+      _result.push_back( string(word) );
       _final_punct = final_punct;
       did_edit = true;
     }
-    else {
-      _result.push_back( orig_word );
-    }
+    // otherwise the result is just the original word
+    _corrected = true;
   }
   if ( did_edit ){
     if ( verbose ){
-      cout << "correction: " << endl;
-      cout << this << endl;
+      trace() << "correction: " << endl;
+      trace() << this << endl;
     }
-    apply_folia_correction( offset, proc );
+    plan.add( plan_step::EDIT, *this );
   }
   else {
     // NO edit just take the string
     if ( has_folia() ){
-      set_output_text( offset );
+      plan.add( plan_step::KEEP, *this );
     }
   }
 }
 
-string correct_unigrams( const vector<gram_r>& unigrams,
-			 const unordered_map<string,vector<word_conf> >& variants,
-			 const unordered_set<string>& unknowns,
-			 const unordered_map<string,string>& puncts,
-			 unordered_map<string,size_t>& counts,
-			 const processor *proc ){
-  if ( verbose > 1 ){
-    cout << "correct unigrams" << endl;
-  }
-  string result;
-  size_t offset = 0;
-  for ( auto uni : unigrams ){
-    uni.correct_one_unigram( variants, unknowns,
-			     puncts, counts, offset, proc );
-    result += uni.result_text();
-    if ( uni.has_space() ){
-      result += " ";
-    }
-    else {
-      --offset;
-    }
-  }
-  if ( verbose > 2 ){
-    cout << "corrected=" << result << endl;
-  }
-  return result;
-}
-
-int gram_r::correct_one_bigram( const unordered_map<string,vector<word_conf> >& variants,
-				const unordered_set<string>& unknowns,
-				const unordered_map<string,string>& puncts,
+int gram_r::correct_one_bigram( const ticcl_lexicon& lex,
 				unordered_map<string,size_t>& counts,
-				size_t& offset,
-				const processor *proc ){
+				root_plan& plan ){
   int extra_skip = 0;
   if ( verbose > 2 ){
-    cout << "correct bigram " << this << endl;
+    trace() << "correct bigram " << this << endl;
   }
-  string word = orig_text();
-  filter(word);
-  string orig_word = word;
+  string_view orig_word = _buf->key( _start, _n );
+  string_view word = orig_word;
+  string depuncted;
   string final_punct;
-  if ( !no_depunct() ){
+  bool known = is_known();
+  if ( known && !no_depunct() ){
     if ( ngram_size > 1 ){
-      bool is_punct = solve_punctuation( word, puncts, final_punct );
+      bool is_punct = solve_punctuation( word, lex, depuncted, final_punct );
       if ( is_punct ){
+	word = depuncted;
 	if ( verbose > 2 ){
-	  cout << "punctuated word found, final='" << final_punct << "'" << endl;
-	  cout << "depuncted word   : " << word << endl;
+	  trace() << "punctuated word found, final='" << final_punct << "'" << endl;
+	  trace() << "depuncted word   : " << word << endl;
 	}
       }
     }
   }
-  const auto vit = variants.find( word );
-  if ( vit != variants.end() ){
+  variant_list vl;
+  if ( known ){
+    vl = lex.find_variants( word );
+  }
+  if ( !vl.empty() ){
     // edits found
-    _suggestions = &vit->second;
-    string edit = vit->second[0].word;
-    vector<string> parts = TiCC::split_at( edit, SEPARATOR ); // edit can be unseperated!
-    _result = parts;
+    _suggestions = vl;
+    // edit can be unseperated!
+    _result = TiCC::split_at( vl.word(0), SEPARATOR );
     _final_punct = final_punct;
+    _corrected = true;
     string ed = set_ed_type();
     ++counts[ed];
     if ( verbose > 1 ){
-      cout << orig_word << " = " << ed << " => " << result_text() << endl;
+      trace() << orig_word << " = " << ed << " => " << result_text() << endl;
     }
     extra_skip = 1;
     if ( verbose ){
-      cout << "correction: " << endl;
-      cout << this << endl;
+      trace() << "correction: " << endl;
+      trace() << this << endl;
     }
-    apply_folia_correction( offset, proc );
+    plan.add( plan_step::EDIT, *this );
   }
   else {
     // a bigram with no suggested variants
-    auto uit = unknowns.find( word );
-    if ( uit == unknowns.end() ){
-      uit = unknowns.find( orig_word );
-    }
-    if ( uit != unknowns.end() ){
+    if ( known
+	 && ( lex.is_unknown( word )
+	      || lex.is_unknown( orig_word ) ) ){
       // ok it is a registrated garbage bigram
       _result.clear();
       _result.push_back( "UNK" );
       _result.push_back( "UNK" );
+      _corrected = true;
       ++counts["UNK UNK"];
       set_ed_type( );
       if ( verbose > 2 ){
-	cout << orig_text() << " ==> " << result_text() << endl;
+	trace() << orig_view() << " ==> " << result_text() << endl;
       }
       extra_skip = 1;
       if ( verbose ){
-	cout << "correction: " << endl;
-	cout << this << endl;
+	trace() << "correction: " << endl;
+	trace() << this << endl;
       }
-      apply_folia_correction( offset, proc );
+      plan.add( plan_step::EDIT, *this );
     }
     else {
       // just use the ORIGINAL bigram and handle the first part like unigram
       if ( verbose > 1 ){
-	cout << "no correction for bigram: " << this << endl;
+	trace() << "no correction for bigram: " << this << endl;
       }
-      _orig.pop_back();
-      _words.pop_back();
+      --_n;
       _final_punct.clear();
       if ( verbose > 1 ){
-	cout << "try unigram: " << this << endl;
+	trace() << "try unigram: " << this << endl;
       }
-      correct_one_unigram( variants, unknowns,
-			   puncts, counts, offset,
-			   proc );
+      correct_one_unigram( lex, counts, plan );
     }
   }
   if ( verbose > 1 ){
-    cout << orig_text() << " = 2 => " << result_text() << endl;
+    trace() << orig_view() << " = 2 => " << result_text() << endl;
   }
   return extra_skip;
 }
 
-string correct_bigrams( const vector<gram_r>& bigrams,
-			const unordered_map<string,vector<word_conf> >& variants,
-			const unordered_set<string>& unknowns,
-			const unordered_map<string,string>& puncts,
-			gram_r& last,
-			unordered_map<string,size_t>& counts,
-			const processor *proc ){
-  if ( verbose > 1 ){
-    cout << "correct " << bigrams.size() << " bigrams" << endl;
-  }
-  string result;
-  int skip = 0;
-  size_t offset = 0;
-  size_t cnt = 0;
-  for ( auto bi : bigrams ){
-    ++cnt;
-    if ( verbose > 1 ){
-      cout << "bigram " << cnt <<" is: '" << bi << "'" << endl;
-    }
-    if ( skip > 0 ){
-      --skip;
-      continue;
-    }
-    if ( verbose > 2 ){
-      cout << "before correct_one_bi: bi=" << bi << endl;
-      cout << "before correct_one_bi: back=" << bigrams.back() << endl;
-    }
-    skip = bi.correct_one_bigram( variants, unknowns,
-				  puncts, counts, offset, proc );
-    if ( verbose > 2 ){
-      cout << "After correct_one_bi: cor=" << bi << endl;
-      cout << "After correct_one_bi: back=" << bigrams.back() << endl;
-    }
-    result += bi.result_text();
-    if ( bi.has_space() ){
-      result += " ";
-    }
-    else {
-      --offset;
-    }
-  }
-  if ( skip == 0 ){
-    last.correct_one_unigram( variants, unknowns,
-			      puncts, counts, offset, proc );
-    if ( verbose > 2 ){
-      cout << "handled last word: " << last << endl;
-    }
-    result += last.result_text();
-  }
-  return result;
-}
-
-int gram_r::correct_one_trigram( const unordered_map<string,vector<word_conf> >& variants,
-				 const unordered_set<string>& unknowns,
-				 const unordered_map<string,string>& puncts,
+int gram_r::correct_one_trigram( const ticcl_lexicon& lex,
 				 unordered_map<string,size_t>& counts,
-				 size_t& offset,
-				 const processor *proc ){
+				 root_plan& plan ){
   int extra_skip = 0;
   if ( verbose > 2 ){
-    cout << "correct trigram " << orig_text() << endl;
+    trace() << "correct trigram " << orig_view() << endl;
   }
-  string word = orig_text();
-  filter(word);
-  string orig_word = word;
-  if ( !no_depunct() ){
+  string_view orig_word = _buf->key( _start, _n );
+  string_view word = orig_word;
+  string depuncted;
+  bool known = is_known();
+  if ( known && !no_depunct() ){
     if ( ngram_size > 1 ){
-      bool is_punct = solve_punctuation( word, puncts, _final_punct );
+      bool is_punct = solve_punctuation( word, lex, depuncted, _final_punct );
       if ( is_punct ){
+	word = depuncted;
 	if ( verbose > 2 ){
-	  cout << "punctuated word found, final='" << _final_punct << "'" << endl;
-	  cout << "depuncted word   : " << word << endl;
+	  trace() << "punctuated word found, final='" << _final_punct << "'" << endl;
+	  trace() << "depuncted word   : " << word << endl;
 	}
       }
     }
   }
-  const auto vit = variants.find( word );
-  if ( vit != variants.end() ){
+  variant_list vl;
+  if ( known ){
+    vl = lex.find_variants( word );
+  }
+  if ( !vl.empty() ){
     // edits found
-    string edit = vit->second[0].word;
-    vector<string> parts = TiCC::split_at( edit, SEPARATOR ); // edit can can be unseperated!
-    _suggestions = &vit->second;
-    _result = parts;
+    // edit can can be unseperated!
+    _result = TiCC::split_at( vl.word(0), SEPARATOR );
+    _suggestions = vl;
+    _corrected = true;
     string ed = set_ed_type();
     ++counts[ed];
     if ( verbose > 1 ){
-      cout << word << " = " << ed << " => " << result_text() << endl;
+      trace() << word << " = " << ed << " => " << result_text() << endl;
     }
     extra_skip = 2;
     if ( verbose ){
-      cout << "correction: " << endl;
-      cout << this << endl;
+      trace() << "correction: " << endl;
+      trace() << this << endl;
     }
-    apply_folia_correction( offset, proc );
+    plan.add( plan_step::EDIT, *this );
   }
   else {
     // a word with no suggested variants
-    auto uit = unknowns.find( word );
-    if ( uit == unknowns.end() ){
-      uit = unknowns.find( orig_word );
-    }
-    if ( uit != unknowns.end() ){
+    if ( known
+	 && ( lex.is_unknown( word )
+	      || lex.is_unknown( orig_word ) ) ){
       // ok it is a registrated garbage trigram
       _result.clear();
       _result.push_back("UNK" );
       _result.push_back("UNK" );
       _result.push_back("UNK" );
+      _corrected = true;
       ++counts["UNK UNK UNK"];
       set_ed_type( );
       extra_skip = 2;
-      apply_folia_correction( offset, proc );
+      plan.add( plan_step::EDIT, *this );
     }
     else {
       if ( verbose > 1 ){
-	cout << "no correction for trigram: " << this << endl;
-      }
-      // just use the ORIGINAL word so handle the first part like bigram
-      _orig.clear();
-      vector<string> parts = TiCC::split_at( orig_word, SEPARATOR );
-      _orig.push_back( parts[0] );
-      _orig.push_back( parts[1] );
-      _words.pop_back();
+	trace() << "no correction for trigram: " << this << endl;
+      }
+      // just use the ORIGINAL (filtered) words, so handle the first part
+      // like a bigram
+      _n = 2;
+      _filtered = true;
       _final_punct.clear();
       if ( verbose > 1 ){
-	cout << "try bigram: " << this << endl;
+	trace() << "try bigram: " << this << endl;
       }
-      extra_skip = correct_one_bigram( variants, unknowns,
-				       puncts, counts,
-				       offset, proc );
+      extra_skip = correct_one_bigram( lex, counts, plan );
     }
   }
   if ( verbose > 1 ){
-    cout << orig_text() << " = 3 => " << result_text()
+    trace() << orig_view() << " = 3 => " << result_text()
 	 << " extra_skip=" << extra_skip << endl;
   }
   return extra_skip;
 }
 
-string correct_trigrams( const vector<gram_r>& trigrams,
-			 const unordered_map<string,vector<word_conf> >& variants,
-			 const unordered_set<string>& unknowns,
-			 const unordered_map<string,string>& puncts,
-			 const vector<gram_r>& unigrams,
-			 unordered_map<string,size_t>& counts,
-			 const processor *proc ){
+int gram_r::correct( const ticcl_lexicon& lex,
+		    unordered_map<string,size_t>& counts,
+		    root_plan& plan ){
+  /// correct this n-gram, or else the longest leading part of it that has
+  /// a correction. Returns the number of extra tokens used
+  switch ( _n ){
+  case 3:
+    return correct_one_trigram( lex, counts, plan );
+  case 2:
+    return correct_one_bigram( lex, counts, plan );
+  default:
+    correct_one_unigram( lex, counts, plan );
+    return 0;
+  }
+}
+
+string correct_ngrams( const token_buffer& tokens,
+		       const vector<unsigned int>& known,
+		       const ticcl_lexicon& lex,
+		       unordered_map<string,size_t>& counts,
+		       root_plan& plan ){
+  /// one left to right pass over the tokens. At every position the longest
+  /// n-gram with a correction is used, and the tokens it covers are skipped.
+  /// Near the end of the tokens, the n-grams get shorter.
+  size_t order = std::min( ngram_size, tokens.size() );
   if ( verbose > 1 ){
-    cout << "correct trigrams" << endl;
+    switch ( order ){
+    case 3:
+      trace() << "correct trigrams" << endl;
+      break;
+    case 2:
+      trace() << "correct " << tokens.size()-1 << " bigrams" << endl;
+      break;
+    default:
+      trace() << "correct unigrams" << endl;
+    }
   }
   string result;
+  result.reserve( tokens.length() );
   int skip = 0;
-  size_t offset = 0;
-  size_t cnt = 0;
-  for ( auto tri : trigrams ){
-    ++cnt;
+  for ( size_t i=0; i < tokens.size(); ++i ){
+    size_t n = std::min( order, tokens.size()-i );
+    gram_r gram( tokens, i, n, known[i] );
+    if ( verbose > 1 && order == 2 && n == 2 ){
+      trace() << "bigram " << i+1 <<" is: '" << gram << "'" << endl;
+    }
     if ( skip > 0 ){
       --skip;
       continue;
     }
-    if ( verbose > 1 ){
-      cout << "trigram is: '" << tri.orig_text() << "'" << endl;
+    if ( verbose > 1 && order == 3 && n == 3 ){
+      trace() << "trigram is: '" << gram.orig_view() << "'" << endl;
     }
-    skip = tri.correct_one_trigram( variants, unknowns,
-				    puncts, counts, offset, proc );
-
+    skip = gram.correct( lex, counts, plan );
     if ( verbose > 2 ){
-      cout << "After correct_one_tri: cor=" << tri << endl;
-      cout << "After correct_one_tri: back=" << trigrams.back() << endl;
+      trace() << "handled " << n << "-gram: " << gram
+	      << " skip=" << skip << endl;
     }
-    result += tri.result_text();
-    if ( tri.has_space() ){
+    gram.append_result( result );
+    if ( n < order && i+skip+1 == tokens.size() ){
+      // the last tokens are used, so no separator
+      continue;
+    }
+    if ( gram.has_space() ){
       result += " ";
     }
     else {
-      --offset;
-    }
-    if ( verbose > 2 ){
-      cout << "skip=" << skip  << " intermediate:" << result << endl;
+      plan.add( plan_step::NO_SPACE, gram );
     }
   }
-  if ( skip > 1 ){
-    return result;
-  }
-  else if ( skip == 1 ){
-    gram_r last = unigrams.back();
-    last.correct_one_unigram( variants, unknowns,
-			      puncts, counts, offset, proc );
-    if ( verbose > 2 ){
-      cout << "handled last word: " << last << endl;
-    }
-    result += last.result_text();
-    return result;
-  }
-  else {
-    gram_r last_bi = extract_last_bigram( unigrams );
-    if ( verbose > 2 ){
-      cout << "correct last bigram: " << last_bi << endl;
-    }
-    skip = last_bi.correct_one_bigram( variants, unknowns,
-				       puncts, counts,
-				       offset, proc );
-    if ( verbose > 2 ){
-      cout << "handled last bigram: " << last_bi << endl;
-    }
-    result += last_bi.result_text();
-    if ( skip == 0 ){
-      gram_r last = unigrams[unigrams.size()-1];
-      if ( verbose > 2 ){
-	cout << "correct last word: " << last << endl;
-      }
-      if ( last_bi.has_space() ){
-	result += " ";
-      }
-      else {
-	--offset;
-      }
-      last.correct_one_unigram( variants, unknowns,
-				puncts, counts, offset, proc );
-      if ( verbose > 2 ){
-	cout << "handled last unigram: " << last << endl;
-      }
-      result += last.result_text();
-    }
-    return result;
+  if ( verbose > 2 ){
+    trace() << "corrected=" << result << endl;
   }
+  return result;
 }
 
 //#define HEMP_DEBUG
 
-void add_to_result( vector<gram_r>& result,
+void add_to_result( vector<token_r>& result,
 		    const string& mw,
 		    const vector<pair<hemp_status,FoliaElement*>>& inventory,
 		    const size_t last ){
@@ -947,7 +1684,7 @@ void add_to_result( vector<gram_r>& result,
       cerr << "index=" << index << endl;
       cerr << "inventory[" << index << "]= " << inventory[index] << endl;
     }
-    result.push_back( gram_r(p,inventory[index].second) );
+    result.push_back( token_r(p,inventory[index].second) );
     ++index;
   }
   if ( verbose > 4 ){
@@ -955,10 +1692,10 @@ void add_to_result( vector<gram_r>& result,
   }
 }
 
-vector<gram_r> replace_hemps( const vector<gram_r>& unigrams,
+vector<token_r> replace_hemps( const vector<token_r>& unigrams,
 			      const vector<pair<hemp_status,FoliaElement*>>& inventory,
-			      const unordered_map<string,string>& puncts ){
-  vector<gram_r> result;
+			      const ticcl_lexicon& lex ){
+  vector<token_r> result;
   result.reserve(unigrams.size() );
   string mw;
   for ( size_t i=0; i < unigrams.size(); ++i ){
@@ -969,9 +1706,9 @@ vector<gram_r> replace_hemps( const vector<gram_r>& unigrams,
       if ( !mw.empty() ){
 	// so this ends some previous HEMP
 	mw.pop_back(); // remove last '_'
-	const auto& it = puncts.find( mw );
-	if ( it != puncts.end() ){
-	  result.push_back( gram_r(it->second, unigrams[i-1].get_word(0) ) );
+	string value;
+	if ( lex.find_punct( mw, value ) ){
+	  result.push_back( token_r(value,unigrams[i-1].word) );
 	}
 	else {
 	  if ( verbose > 4 ){
@@ -984,10 +1721,10 @@ vector<gram_r> replace_hemps( const vector<gram_r>& unigrams,
       result.push_back( unigrams[i] );
     }
     else if ( inventory[i].first == END_PUNCT_HEMP ){
-      mw += unigrams[i].orig_text();
-      const auto& it = puncts.find( mw );
-      if ( it != puncts.end() ){
-	result.push_back( gram_r(it->second,unigrams[i].get_word(0) ) );
+      mw += unigrams[i].text;
+      string value;
+      if ( lex.find_punct( mw, value ) ){
+	result.push_back( token_r(value,unigrams[i].word) );
       }
       else {
 	if ( verbose > 4 ){
@@ -1001,9 +1738,9 @@ vector<gram_r> replace_hemps( const vector<gram_r>& unigrams,
       if ( !mw.empty() ){
 	// so this ends some previous HEMP
 	mw.pop_back(); //  remove last '_'
-	const auto& it = puncts.find( mw );
-	if ( it != puncts.end() ){
-	  result.push_back( gram_r(it->second,unigrams[i-1].get_word(0) ) );
+	string value;
+	if ( lex.find_punct( mw, value ) ){
+	  result.push_back( token_r(value,unigrams[i-1].word) );
 	}
 	else {
 	  if ( verbose > 4 ){
@@ -1012,10 +1749,10 @@ vector<gram_r> replace_hemps( const vector<gram_r>& unigrams,
 	  add_to_result( result, mw, inventory, i-1 );
 	}
       }
-      mw = unigrams[i].orig_text() + "_";
+      mw = unigrams[i].text + "_";
     }
     else if ( inventory[i].first == NORMAL_HEMP ){
-      mw += unigrams[i].orig_text() + "_";
+      mw += unigrams[i].text + "_";
     }
     if ( verbose > 4 ){
       cerr << "   result=" << result << endl;
@@ -1024,9 +1761,9 @@ vector<gram_r> replace_hemps( const vector<gram_r>& unigrams,
   if ( !mw.empty() ){
     // leftovers
     mw.pop_back(); //  remove last '_'
-    const auto& it = puncts.find( mw );
-    if ( it != puncts.end() ){
-      result.push_back( gram_r(it->second,unigrams.back().get_word(0)) );
+    string value;
+    if ( lex.find_punct( mw, value ) ){
+      result.push_back( token_r(value,unigrams.back().word) );
     }
     else {
       if ( verbose > 4 ){
@@ -1041,14 +1778,14 @@ vector<gram_r> replace_hemps( const vector<gram_r>& unigrams,
   return result;
 }
 
-vector<gram_r> replace_hemps( const vector<gram_r>& unigrams,
-			      const unordered_map<string,string>& puncts ){
+vector<token_r> replace_hemps( const vector<token_r>& unigrams,
+			      const ticcl_lexicon& lex ){
   if ( verbose > 4 ){
-    cout << "replace HEMPS in UNIGRAMS:\n" << unigrams << endl;
+    trace() << "replace HEMPS in UNIGRAMS:\n" << unigrams << endl;
   }
   vector<UnicodeString> u_uni( unigrams.size() );
   for ( size_t i=0; i < unigrams.size(); ++i ){
-    u_uni[i] = TiCC::UnicodeFromUTF8(unigrams[i].orig_text());
+    u_uni[i] = TiCC::UnicodeFromUTF8(unigrams[i].text);
   }
   vector<hemp_status> hemp_inventory = create_emph_inventory( u_uni );
   if ( verbose > 4 ){
@@ -1058,40 +1795,37 @@ vector<gram_r> replace_hemps( const vector<gram_r>& unigrams,
   }
   vector<pair<hemp_status,FoliaElement*>> inventory;
   for ( size_t i=0; i < unigrams.size(); ++i ){
-    inventory.push_back(make_pair(hemp_inventory[i],unigrams[i].get_word(0)));
+    inventory.push_back(make_pair(hemp_inventory[i],unigrams[i].word));
   }
   if ( verbose > 4 ){
     cerr << "PAIRED inventory " << inventory << endl;
   }
-  vector<gram_r> result = replace_hemps( unigrams, inventory, puncts );
+  vector<token_r> result = replace_hemps( unigrams, inventory, lex );
   if ( verbose > 4 ){
-    cout << "replace HEMPS out UNIGRAMS:\n" << result << endl;
+    trace() << "replace HEMPS out UNIGRAMS:\n" << result << endl;
   }
   return result;
 }
 
 //#define TEST_HEMP
 
-void correctNgrams( FoliaElement *root,
-		    const unordered_map<string,vector<word_conf> >& variants,
-		    const unordered_set<string>& unknowns,
-		    const unordered_map<string,string>& puncts,
-		    unordered_map<string,size_t>& counts,
-		    processor *proc ){
-  KWargs correction_args;
-  string original_set;
-  correction_args["processor"] = proc->id();
+void select_corrections( root_plan& plan,
+			 const ticcl_lexicon& lex ){
+  /// decide on the corrections in plan.root. This only reads the FoLiA
+  /// tree: the changes are stored in plan, and made by plan.apply()
+  FoliaElement *root = plan.root;
+  KWargs& correction_args = plan.correction_args;
+  string& original_set = plan.original_set;
+  unordered_map<string,size_t>& counts = plan.counts;
   vector<FoliaElement*> ev;
   bool doStrings = false;
   bool doTokens = false;
   vector<Word*> wv = root->select<Word>();
   if ( wv.size() > 0 ){
     if ( wv[0]->parent() != root ){
-      cerr << "found <w> nodes in a deeper context than requested by "
-	   << "the tags='' option!" << endl;
-      cerr << "Consider using a more elementary element. "
-	   << "(like 's' for 'p')" << endl;
-      exit( EXIT_FAILURE );
+      throw runtime_error( "found <w> nodes in a deeper context than "
+			   "requested by the tags='' option! Consider using"
+			   " a more elementary element. (like 's' for 'p')" );
     }
     ev.resize(wv.size());
     copy( wv.begin(), wv.end(), ev.begin() );
@@ -1109,11 +1843,9 @@ void correctNgrams( FoliaElement *root,
     vector<String*> sv = root->select<String>();
     if ( sv.size() > 0 ){
       if ( sv[0]->parent() != root ){
-	cerr << "found <str> nodes in a deeper context than requested by "
-	     << "the tags='' option!" << endl;
-	cerr << "Consider using a more elementary element. "
-	     << "(like 's' for 'p')" << endl;
-	exit( EXIT_FAILURE );
+	throw runtime_error( "found <str> nodes in a deeper context than "
+			     "requested by the tags='' option! Consider using"
+			     " a more elementary element. (like 's' for 'p')" );
       }
       ev.resize(sv.size());
       copy( sv.begin(), sv.end(), ev.begin() );
@@ -1130,17 +1862,17 @@ void correctNgrams( FoliaElement *root,
     }
   }
 
-  vector<gram_r> unigrams;
+  vector<token_r> unigrams;
 #ifdef TEST_HEMP
   vector<string> grams = {"Als","N","A","P","O","L","E","O","N",")A",
 			  "aan","(N","A","P","O","L","E","O","N)","EX",
 			  "voor","N","A","P","O","L","E","O","toch?",
 			  "tegen","P","Q.","zeker"};
-  cout << "Test HEMP: " << grams << endl;
+  trace() << "Test HEMP: " << grams << endl;
   std::transform( grams.cbegin(), grams.cend(),
 		  std::back_inserter( unigrams ),
-		  [](const string& s) { return gram_r(s); } );
-  cout << "old_uni: " << unigrams << endl;
+		  [](const string& s) { return token_r(s); } );
+  trace() << "old_uni: " << unigrams << endl;
 #else
   string inval;
   if ( ev.size() == 0 ){
@@ -1152,11 +1884,8 @@ void correctNgrams( FoliaElement *root,
       origV = root->select<TextContent>();
       if ( origV.empty() ){
 	// still nothing...
-#pragma omp critical
-	{
-	  cerr << "no text Words or Strings in : " << root->id()
-	       << " skipping" << endl;
-	}
+	plan.warning = "no text Words or Strings in : " + root->id()
+	  + " skipping";
 	return;
       }
     }
@@ -1169,7 +1898,7 @@ void correctNgrams( FoliaElement *root,
       vector<string> parts = TiCC::split( content );
       std::transform( parts.cbegin(), parts.cend(),
 		      std::back_inserter( unigrams ),
-		      [](const string& s) { return gram_r(s); } );
+		      [](const string& s) { return token_r(s); } );
     }
   }
   else {
@@ -1181,155 +1910,932 @@ void correctNgrams( FoliaElement *root,
       if ( space ){
 	inval += " ";
       }
-      unigrams.push_back( gram_r( content, it ) );
+      unigrams.push_back( token_r( content, it ) );
     }
   }
   //  cout << "found unigrams: " << unigrams << endl;
   inval = TiCC::trim( inval );
   if ( verbose > 1 ){
-#pragma omp critical
-    {
-      cout << "\n   correct " << ngram_size << "-grams in: '" << inval
-	   << "' (" << input_classname
-	   << ")" << endl;
-    }
+    trace() << "\n   correct " << ngram_size << "-grams in: '" << inval
+	    << "' (" << input_classname
+	    << ")" << endl;
   }
 #endif
-  unigrams = replace_hemps( unigrams, puncts );
+  unigrams = replace_hemps( unigrams, lex );
   //  cout << "after hemping: " << unigrams << endl;
-  vector<gram_r> bigrams;
-  vector<gram_r> trigrams;
   counts["TOKENS"] += unigrams.size();
-  if ( ngram_size > 1  && unigrams.size() > 1 ){
-    bigrams = extract_bigrams( unigrams );
-    if ( verbose > 3 ){
-      cout << "BIGRAMS:\n" << bigrams << endl;
+  string corrected;
+  if ( !unigrams.empty() ){
+    if ( doStrings ){
+      plan.declare = folia::AnnotationType::STRING;
+    }
+    else if ( doTokens ){
+      plan.declare = folia::AnnotationType::TOKEN;
+    }
+    filter_stats = filter_counts();
+    plan.tokens.reset( new token_buffer( unigrams ) );
+    const token_buffer& tokens = *plan.tokens;
+    const vector<unsigned int> known = lex.scan( tokens );
+    corrected = correct_ngrams( tokens, known, lex, counts, plan );
+    counts["FILTER-HIT"] += filter_stats.hits;
+    counts["FILTER-MISS"] += filter_stats.misses;
+  }
+  corrected = TiCC::trim( corrected );
+  if ( verbose > 1 ){
+    trace() << "corrected " << ngram_size << "-grams uit: '"
+	    << corrected << "' (" << output_classname << ")" << endl;
+  }
+  plan.corrected = corrected;
+}
+
+bool correctDoc( Document *doc,
+		 const ticcl_lexicon& lex,
+		 const list<ElementType>& tag_list,
+		 unordered_map<string,size_t>& counts,
+		 const string& command,
+		 const string& outName,
+		 correction_delta *delta ){
+  /// correct doc and save it as outName. When delta is given, the
+  /// corrections are saved as a stand-off delta in outName instead.
+  /// When outName is empty, nothing is saved
+  processor *proc = add_provenance( *doc, "FoLiA-correct", command );
+  KWargs args;
+  args["processor"] = proc->id();
+  doc->declare( folia::AnnotationType::CORRECTION, setname, args );
+  vector<FoliaElement*> ev;
+  if ( tag_list.empty() ){
+    vector<Sentence *> vs = doc->doc()->select<Sentence>();
+    if ( vs.empty() ){
+      vector<Paragraph*> vp = doc->doc()->select<Paragraph>();
+      merge<Paragraph>( ev, vp );
+    }
+    else {
+      merge<Sentence>( ev, vs );
+    }
+  }
+  else {
+    for ( const auto& et : tag_list ){
+      vector<FoliaElement*> v1 = doc->doc()->select( et );
+      if ( !v1.empty() ){
+	ev = v1;
+	break;
+      }
+    }
+  }
+  // first decide on the corrections of all roots, in parallel
+  vector<root_plan> plans( ev.size() );
+#pragma omp parallel for num_threads(root_threads) schedule(dynamic,1) if(root_threads > 1)
+  for ( size_t i=0; i < ev.size(); ++i ){
+    root_plan& plan = plans[i];
+    plan.root = ev[i];
+    trace_stream = &plan.traces;
+    try {
+      select_corrections( plan, lex );
+    }
+    catch ( exception& e ){
+      plan.error = e.what();
+    }
+    plan.trace_tail = plan.traces.str();
+    plan.traces.str( "" );
+    trace_stream = &cout;
+  }
+  // then change the document, in document order
+  for ( const auto& plan : plans ){
+    string error = plan.error;
+    if ( error.empty() ){
+      try {
+	if ( delta ){
+	  plan.record( *delta );
+	}
+	plan.apply( proc );
+      }
+      catch ( exception& e ){
+	error = e.what();
+      }
+    }
+    if ( !error.empty() ){
+#pragma omp critical
+      {
+	cerr << "FoLiA error in element: " << plan.root->id() << " of document " << doc->id() << endl;
+	cerr << error << endl;
+      }
+      remove( outName.c_str() );
+      return false;
+    }
+    for ( const auto& [edit,count] : plan.counts ){
+      counts[edit] += count;
+      if ( delta ){
+	delta->counts[edit] += count;
+      }
+    }
+  }
+  if ( outName.empty() ){
+    // only the statistics are wanted
+  }
+  else if ( delta ){
+    if ( !delta->save( outName ) ){
+#pragma omp critical
+      {
+	cerr << "unable to write delta file: " << outName << endl;
+      }
+      remove( outName.c_str() );
+      return false;
+    }
+  }
+  else {
+    doc->save( outName );
+  }
+  return true;
+}
+
+void rebase_text( Document *doc,
+		  const string& inputclass,
+		  const string& rebase_input ){
+
+  vector<TextContent*> tv = doc->doc()->select<TextContent>();
+  for ( const auto& t : tv ){
+    if ( t->cls() == inputclass ){
+      t->update_cls( rebase_input );
+    }
+  }
+}
+
+string output_name( const string& fileName, const string& outPrefix ){
+  /// derive the name of the corrected file: 'prefix/name.ticcl.ext'
+  string docName = fileName;
+  string outName = outPrefix;
+  string::size_type pos = docName.rfind("/");
+  if ( pos != string::npos ){
+    docName = docName.substr( pos+1 );
+  }
+  pos = docName.rfind(".folia");
+  if ( pos != string::npos ){
+    outName += docName.substr(0,pos) + ".ticcl" + docName.substr(pos);
+  }
+  else {
+    pos = docName.rfind(".");
+    if ( pos != string::npos ){
+      outName += docName.substr(0,pos) + ".ticcl" + docName.substr(pos);
+    }
+    else {
+      outName += docName + ".ticcl";
+    }
+  }
+  return outName;
+}
+
+bool parse_tags( const string& tagsstring,
+		 list<ElementType>& tag_list,
+		 string& bad_tag ){
+  /// fill tag_list from a comma separated list of FoLiA tags.
+  /// returns false when an unknown tag is found, which is stored in bad_tag
+  tag_list.clear();
+  if ( !tagsstring.empty() ){
+    vector<string> parts = TiCC::split_at( tagsstring, "," );
+    for( const auto& t : parts ){
+      ElementType et;
+      try {
+	et = TiCC::stringTo<ElementType>( t );
+      }
+      catch ( ... ){
+	bad_tag = t;
+	return false;
+      }
+      tag_list.push_back( et );
+    }
+  }
+  return true;
+}
+
+class line_channel {
+  /// line based communication over a socket
+public:
+  explicit line_channel( int fd ): _fd(fd) {};
+  bool read_line( string& );
+  bool write_line( const string& );
+private:
+  int _fd;
+  string _buffer;
+};
+
+bool line_channel::read_line( string& line ){
+  while ( true ){
+    string::size_type pos = _buffer.find( '\n' );
+    if ( pos != string::npos ){
+      line = _buffer.substr( 0, pos );
+      _buffer.erase( 0, pos+1 );
+      return true;
+    }
+    char buf[4096];
+    ssize_t n = read( _fd, buf, sizeof(buf) );
+    if ( n < 0 && errno == EINTR ){
+      continue;
+    }
+    if ( n <= 0 ){
+      if ( _buffer.empty() ){
+	return false;
+      }
+      // last line without a newline
+      line = _buffer;
+      _buffer.clear();
+      return true;
+    }
+    _buffer.append( buf, n );
+  }
+}
+
+bool line_channel::write_line( const string& line ){
+  string out = line + "\n";
+  const char *data = out.c_str();
+  size_t left = out.size();
+  while ( left > 0 ){
+    ssize_t n = write( _fd, data, left );
+    if ( n < 0 && errno == EINTR ){
+      continue;
+    }
+    if ( n <= 0 ){
+      return false;
+    }
+    data += n;
+    left -= n;
+  }
+  return true;
+}
+
+void print_statistics( const map<string,size_t>& total_counts ){
+  if ( !total_counts.empty() ){
+    cout << "edit statistics: " << endl;
+    cout << "\tedit\t count" << endl;
+    for ( const auto& [word,count] : total_counts ){
+      cout << "\t" << word << "\t" << count << endl;
+    }
+    const auto hits = total_counts.find( "FILTER-HIT" );
+    const auto misses = total_counts.find( "FILTER-MISS" );
+    if ( hits != total_counts.end() && misses != total_counts.end() ){
+      size_t total = hits->second + misses->second;
+      auto rate = [total]( size_t n ){
+	return ( total > 0 ? ( 100 * n ) / total : 0 );
+      };
+      cout << "lexicon filter: " << total << " tokens, "
+	   << hits->second << " passed (" << rate( hits->second ) << "%), "
+	   << misses->second << " rejected (" << rate( misses->second )
+	   << "%)" << endl;
+    }
+  }
+}
+
+string edit_summary( const unordered_map<string,size_t>& counts ){
+  /// the edit counts of one document as TAB separated 'edit=count' fields
+  map<string,size_t> sorted( counts.begin(), counts.end() );
+  string result;
+  for ( const auto& [edit,count] : sorted ){
+    result += "\t" + edit + "=" + TiCC::toString(count);
+  }
+  return result;
+}
+
+string absolute_path( const string& name ){
+  /// the server may run in another directory than the client
+  if ( name.empty() || name[0] == '/' ){
+    return name;
+  }
+  char buf[4096];
+  if ( getcwd( buf, sizeof(buf) ) == 0 ){
+    return name;
+  }
+  return string(buf) + "/" + name;
+}
+
+string temporary_name( const string& name ){
+  /// a unique name in the directory of name, with the same extension
+  static atomic<unsigned int> serial(0);
+  string::size_type pos = name.rfind( '/' );
+  string dir = ( pos == string::npos ) ? "" : name.substr( 0, pos+1 );
+  string base = ( pos == string::npos ) ? name : name.substr( pos+1 );
+  return dir + ".~" + TiCC::toString( getpid() ) + "."
+    + TiCC::toString( serial++ ) + "." + base;
+}
+
+bool same_user( int conn ){
+  /// is the peer on conn running as our user?
+#ifdef SO_PEERCRED
+  struct ucred cred;
+  socklen_t len = sizeof(cred);
+  if ( getsockopt( conn, SOL_SOCKET, SO_PEERCRED, &cred, &len ) != 0 ){
+    return false;
+  }
+  return cred.uid == geteuid();
+#else
+  (void)conn;
+  return true; // the socket itself is only accessible for us
+#endif
+}
+
+string run_job( const string& request,
+		const ticcl_lexicon& lex,
+		const list<ElementType>& default_tags,
+		const string& command,
+		map<string,size_t>& total_counts ){
+  /// handle one correction request of the form:
+  ///   input=file<TAB>output=file[<TAB>tags=t1,t2][<TAB>ngram=n]
+  /// returns a one line reply starting with 'OK' or 'FAILED'
+  string input;
+  string output;
+  list<ElementType> tag_list = default_tags;
+  vector<string> fields = TiCC::split_at( request, "\t" );
+  for ( const auto& f : fields ){
+    string::size_type pos = f.find( '=' );
+    if ( pos == string::npos ){
+      return "FAILED\treason=invalid field '" + f + "'";
+    }
+    string key = f.substr( 0, pos );
+    string value = f.substr( pos+1 );
+    if ( key == "input" ){
+      input = value;
+    }
+    else if ( key == "output" ){
+      output = value;
+    }
+    else if ( key == "tags" ){
+      string bad_tag;
+      if ( !parse_tags( value, tag_list, bad_tag ) ){
+	return "FAILED\treason=the string '" + bad_tag
+	  + "' doesn't represent a known FoLiA tag";
+      }
+    }
+    else if ( key == "ngram" ){
+      // the variants are filtered on n-gram size when loading
+      size_t n = 0;
+      if ( !TiCC::stringTo( value, n ) || n != ngram_size ){
+	return "FAILED\treason=this server only handles --ngram="
+	  + TiCC::toString(ngram_size);
+      }
+    }
+    else {
+      return "FAILED\treason=unknown field '" + key + "'";
+    }
+  }
+  if ( input.empty() ){
+    return "FAILED\treason=missing input";
+  }
+  if ( output.empty() ){
+    // store next to the input
+    string::size_type pos = input.rfind( '/' );
+    string prefix = ( pos == string::npos ) ? "" : input.substr( 0, pos+1 );
+    output = output_name( input, prefix );
+  }
+  string result = "input=" + input + "\toutput=" + output;
+  auto start = chrono::steady_clock::now();
+  Document *doc = 0;
+  try {
+    doc = new Document( "file='"+ input + "'" );
+  }
+  catch ( const exception& e ){
+    return "FAILED\t" + result + "\treason=" + e.what();
+  }
+  // work on a temporary, so an existing output is only replaced when the
+  // correction succeeds
+  string tmp_name = temporary_name( output );
+  if ( !TiCC::createPath( tmp_name ) ){
+    delete doc;
+    return "FAILED\t" + result + "\treason=unable to create output file";
+  }
+  if ( !rebase_inputclass.empty() ){
+    rebase_text( doc, safe_inputclass, rebase_inputclass );
+  }
+  unordered_map<string,size_t> counts;
+  bool ok = false;
+  try {
+    ok = correctDoc( doc, lex, tag_list, counts, command, tmp_name, 0 );
+  }
+  catch ( const exception& e ){
+    delete doc;
+    remove( tmp_name.c_str() );
+    return "FAILED\t" + result + "\treason=" + e.what();
+  }
+  delete doc;
+  if ( !ok ){
+    remove( tmp_name.c_str() );
+    return "FAILED\t" + result + "\treason=correction failed";
+  }
+  if ( rename( tmp_name.c_str(), output.c_str() ) != 0 ){
+    remove( tmp_name.c_str() );
+    return "FAILED\t" + result + "\treason=unable to replace the output";
+  }
+  auto msecs = chrono::duration_cast<chrono::milliseconds>( chrono::steady_clock::now() - start ).count();
+  result = "OK\t" + result + "\tmsecs=" + TiCC::toString(msecs)
+    + edit_summary( counts );
+#pragma omp critical
+  {
+    for ( const auto& [edit,count] : counts ){
+      total_counts[edit] += count;
+    }
+  }
+  return result;
+}
+
+bool stale_socket( const sockaddr_un& addr ){
+  /// is the socket at addr left behind by a server that is gone? Only then
+  /// a connection is refused
+  int fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+  if ( fd < 0 ){
+    return false;
+  }
+  bool stale = connect( fd, (const sockaddr*)&addr, sizeof(addr) ) != 0
+    && errno == ECONNREFUSED;
+  close( fd );
+  return stale;
+}
+
+bool serve( const string& address,
+	    const ticcl_lexicon& lex,
+	    const list<ElementType>& tag_list,
+	    const string& command,
+	    map<string,size_t>& total_counts ){
+  /// keep the lexicon loaded and handle correction requests. Requests are
+  /// read from a Unix domain socket, or from stdin when address is '-'.
+  /// Every thread handles requests; the request 'STOP' ends the server
+  atomic<bool> stop(false);
+  if ( address == "-" ){
+    cout << "serving on stdin" << endl;
+#pragma omp parallel shared(stop)
+    {
+      string line;
+      while ( true ){
+	bool got = false;
+#pragma omp critical(serve_input)
+	{
+	  got = !stop && getline( cin, line );
+	}
+	if ( !got ){
+	  break;
+	}
+	string reply;
+	if ( line == "STOP" ){
+	  stop = true;
+	  reply = "STOPPED";
+	}
+	else if ( !line.empty() ){
+	  reply = run_job( line, lex, tag_list, command, total_counts );
+	}
+#pragma omp critical(serve_output)
+	{
+	  cout << reply << endl;
+	}
+      }
+    }
+    return true;
+  }
+  signal( SIGPIPE, SIG_IGN ); // clients may disappear
+  int listen_fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+  if ( listen_fd < 0 ){
+    cerr << "unable to create a socket" << endl;
+    return false;
+  }
+  sockaddr_un addr;
+  memset( &addr, 0, sizeof(addr) );
+  addr.sun_family = AF_UNIX;
+  if ( address.size() >= sizeof(addr.sun_path) ){
+    cerr << "socket name too long: " << address << endl;
+    close( listen_fd );
+    return false;
+  }
+  strcpy( addr.sun_path, address.c_str() );
+  struct stat st;
+  if ( stat( address.c_str(), &st ) == 0 && S_ISSOCK( st.st_mode ) ){
+    if ( !stale_socket( addr ) ){
+      cerr << "socket '" << address << "' is in use by another server"
+	   << endl;
+      close( listen_fd );
+      return false;
+    }
+    // a stale socket of a previous run
+    unlink( address.c_str() );
+  }
+  // only our own user may connect: the jobs read and write files as us
+  mode_t old_mask = umask( 0077 );
+  int bound = bind( listen_fd, (sockaddr*)&addr, sizeof(addr) );
+  umask( old_mask );
+  if ( bound != 0
+       || chmod( address.c_str(), 0600 ) != 0
+       || listen( listen_fd, 64 ) != 0 ){
+    cerr << "unable to listen on socket '" << address << "': "
+	 << strerror(errno) << endl;
+    close( listen_fd );
+    return false;
+  }
+  cout << "serving on " << address << endl;
+  // the open connections, so STOP can end the ones that wait for a request
+  unordered_set<int> connections;
+#pragma omp parallel shared(stop,connections)
+  {
+    while ( !stop ){
+      int conn = accept( listen_fd, 0, 0 );
+      if ( conn < 0 ){
+	if ( !stop && errno == EINTR ){
+	  continue;
+	}
+	break;
+      }
+      bool stopped = false;
+#pragma omp critical(serve_connections)
+      {
+	stopped = stop;
+	if ( !stopped ){
+	  connections.insert( conn );
+	}
+      }
+      if ( stopped ){
+	close( conn );
+	break;
+      }
+      line_channel channel( conn );
+      if ( !same_user( conn ) ){
+	channel.write_line( "FAILED\treason=permission denied" );
+#pragma omp critical(serve_connections)
+	{
+	  connections.erase( conn );
+	}
+	close( conn );
+	continue;
+      }
+      string line;
+      while ( !stop && channel.read_line( line ) ){
+	string reply;
+	if ( line == "STOP" ){
+	  stop = true;
+	  reply = "STOPPED";
+	}
+	else if ( line.empty() ){
+	  continue;
+	}
+	else {
+	  reply = run_job( line, lex, tag_list, command, total_counts );
+	}
+	if ( !channel.write_line( reply ) ){
+	  break;
+	}
+      }
+#pragma omp critical(serve_connections)
+      {
+	connections.erase( conn );
+	if ( stop ){
+	  // wake up the threads that are waiting in accept(), or for the
+	  // next request of an idle client
+	  shutdown( listen_fd, SHUT_RDWR );
+	  for ( const auto& fd : connections ){
+	    shutdown( fd, SHUT_RDWR );
+	  }
+	}
+      }
+      close( conn );
+    }
+  }
+  close( listen_fd );
+  unlink( address.c_str() );
+  return true;
+}
+
+bool submit( const string& address, const string& request, string& reply ){
+  /// send one request to a FoLiA-correct server and wait for the reply
+  int fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+  if ( fd < 0 ){
+    reply = "FAILED\treason=unable to create a socket";
+    return false;
+  }
+  sockaddr_un addr;
+  memset( &addr, 0, sizeof(addr) );
+  addr.sun_family = AF_UNIX;
+  strncpy( addr.sun_path, address.c_str(), sizeof(addr.sun_path)-1 );
+  if ( connect( fd, (sockaddr*)&addr, sizeof(addr) ) != 0 ){
+    reply = "FAILED\treason=unable to connect to '" + address + "': "
+      + strerror(errno);
+    close( fd );
+    return false;
+  }
+  line_channel channel( fd );
+  bool ok = channel.write_line( request ) && channel.read_line( reply );
+  close( fd );
+  if ( !ok ){
+    reply = "FAILED\treason=no reply from server";
+  }
+  return ok && reply.compare( 0, 6, "FAILED" ) != 0;
+}
+
+int run_client( const string& address,
+		const vector<string>& fileNames,
+		const string& outPrefix,
+		const string& tagsstring,
+		bool clear,
+		bool send_ngram ){
+  /// submit every file as a job to the server on address. Threads (-t)
+  /// are used to keep several jobs in flight
+  int fail_count = 0;
+#pragma omp parallel for shared(fileNames,fail_count) schedule(dynamic,1)
+  for ( size_t fn=0; fn < fileNames.size(); ++fn ){
+    string outName = output_name( fileNames[fn], outPrefix );
+    if ( clear ){
+      remove( outName.c_str() );
+    }
+    if ( TiCC::isFile( outName ) ){
+#pragma omp critical
+      {
+	cerr << "skipping already done file: " << outName << endl;
+      }
+      continue;
+    }
+    string request = "input=" + absolute_path( fileNames[fn] )
+      + "\toutput=" + absolute_path( outName );
+    if ( send_ngram ){
+      request += "\tngram=" + TiCC::toString( ngram_size );
+    }
+    if ( !tagsstring.empty() ){
+      request += "\ttags=" + tagsstring;
+    }
+    string reply;
+    bool ok = submit( address, request, reply );
+#pragma omp critical
+    {
+      cout << reply << endl;
+      if ( !ok ){
+	++fail_count;
+      }
+    }
+  }
+  return fail_count;
+}
+
+string applied_name( const string& delta_name, const string& outPrefix ){
+  /// the name of the document recreated from delta_name: 'name.delta'
+  /// becomes 'name', in the directory outPrefix when given
+  string result = delta_name;
+  if ( result.size() > 6
+       && result.compare( result.size()-6, 6, ".delta" ) == 0 ){
+    result.resize( result.size()-6 );
+  }
+  else {
+    result += ".xml";
+  }
+  if ( !outPrefix.empty() ){
+    string::size_type pos = result.rfind( "/" );
+    if ( pos != string::npos ){
+      result = result.substr( pos+1 );
+    }
+    result = outPrefix + result;
+  }
+  return result;
+}
+
+bool replay_delta( Document *doc,
+		   const correction_delta& delta,
+		   const string& command,
+		   string& error ){
+  /// replay the changes recorded in delta on doc, the original document.
+  /// On failure, error holds the reason
+  processor *proc = add_provenance( *doc, "FoLiA-correct", command );
+  KWargs args;
+  args["processor"] = proc->id();
+  doc->declare( folia::AnnotationType::CORRECTION, setname, args );
+  const vector<vector<string>>& records = delta.records();
+  size_t i = 0;
+  while ( i < records.size() ){
+    const vector<string>& r = records[i++];
+    FoliaElement *root = (*doc)[r[1]];
+    if ( !root ){
+      error = "there is no element '" + r[1] + "'";
+      return false;
+    }
+    if ( input_hash( root ) != r[2] ){
+      error = "the text of '" + r[1] + "' has changed";
+      return false;
+    }
+    if ( r[3] != "-" ){
+      KWargs dargs;
+      if ( !r[5].empty() ){
+	dargs["alias"] = r[5];
+      }
+      dargs["processor"] = proc->id();
+      AnnotationType type = ( r[3] == "string" ) ? AnnotationType::STRING
+	: AnnotationType::TOKEN;
+      doc->declare( type, r[4], dargs );
+    }
+    size_t offset = 0;
+    for ( ; i < records.size() && records[i][0] != "R"; ++i ){
+      const vector<string>& step = records[i];
+      if ( step[0] == "N" ){
+	--offset;
+	continue;
+      }
+      if ( step[0] == "E" && step[1] == "-" ){
+	// no words to correct
+	continue;
+      }
+      vector<string> ids = TiCC::split( step[1] );
+      vector<FoliaElement*> oV;
+      for ( const auto& id : ids ){
+	FoliaElement *word = (*doc)[id];
+	if ( !word ){
+	  error = "there is no word '" + id + "'";
+	  return false;
+	}
+	oV.push_back( word );
+      }
+      if ( step[0] == "K" ){
+	oV[0]->settext( step[2], offset, output_classname );
+	offset += unicode_size( step[2] ) + 1;
+      }
+      else {
+	vector<pair<string,string>> suggestions;
+	for ( size_t j=6; j+1 < step.size(); j += 2 ){
+	  suggestions.push_back( make_pair( step[j], step[j+1] ) );
+	}
+	add_correction( oV, step[3], TiCC::split_at( step[4], SEPARATOR ),
+			step[5], suggestions, offset, proc );
+      }
+    }
+    if ( !r[6].empty() ){
+      root->settext( r[6], output_classname );
+    }
+  }
+  return true;
+}
+
+int apply_deltas( const vector<string>& fileNames,
+		  const string& outPrefix,
+		  bool clear ){
+  /// recreate the corrected documents from the deltas in fileNames, by
+  /// replaying the recorded changes on the original documents.
+  /// returns the number of failures
+  vector<correction_delta> deltas( fileNames.size() );
+  for ( size_t i=0; i < fileNames.size(); ++i ){
+    string error;
+    if ( !deltas[i].load( fileNames[i], error ) ){
+      cerr << error << endl;
+      return fileNames.size();
+    }
+  }
+  // the class and set names are global, so they must be the same for all
+  map<string,string>& settings = deltas[0].settings;
+  const vector<string> global = { "inputclass", "rebase-inputclass",
+				  "outputclass", "setname" };
+  for ( size_t i=1; i < deltas.size(); ++i ){
+    for ( const auto& key : global ){
+      if ( deltas[i].settings[key] != settings[key] ){
+	cerr << fileNames[i] << " and " << fileNames[0]
+	     << " were made with a different " << key
+	     << ". Please apply them separately." << endl;
+	return fileNames.size();
+      }
+    }
+  }
+  input_classname = settings["inputclass"];
+  rebase_inputclass = settings["rebase-inputclass"];
+  if ( !rebase_inputclass.empty() ){
+    safe_inputclass = input_classname;
+    input_classname = rebase_inputclass;
+  }
+  output_classname = settings["outputclass"];
+  setname = settings["setname"];
+
+  map<string,size_t> total_counts;
+  int fail_count = 0;
+#pragma omp parallel for shared(fileNames,deltas,fail_count) schedule(dynamic,1)
+  for ( size_t fn=0; fn < fileNames.size(); ++fn ){
+    map<string,string>& delta_settings = deltas[fn].settings;
+    string input = delta_settings["input"];
+    string outName = applied_name( fileNames[fn], outPrefix );
+    if ( clear ){
+      remove( outName.c_str() );
+    }
+    if ( TiCC::isFile( outName ) ){
+#pragma omp critical
+      {
+	cerr << "skipping already done file: " << outName << endl;
+      }
+      continue;
     }
-  }
-  if ( ngram_size > 2 && unigrams.size() > 2 ){
-    trigrams = extract_trigrams( unigrams );
-    if ( verbose > 5 ){
-      cout << "TRIGRAMS:\n" << trigrams << endl;
+    Document *doc = 0;
+    try {
+      doc = new Document( "file='"+ input + "'" );
     }
-  }
-  string corrected;
-  if ( trigrams.empty() ){
-    if ( bigrams.empty() ){
-      if ( !unigrams.empty() ){
-	if ( doStrings ){
-	  root->doc()->declare( folia::AnnotationType::STRING, original_set,
-				correction_args );	}
-	else if ( doTokens ){
-	  root->doc()->declare( folia::AnnotationType::TOKEN, original_set,
-				correction_args );
-	}
-	corrected = correct_unigrams( unigrams, variants, unknowns,
-				    puncts, counts, proc );
+    catch ( exception& e ){
+#pragma omp critical
+      {
+	cerr << "failed to load document '" << input << "'" << endl;
+	cerr << "reason: " << e.what() << endl;
+	++fail_count;
       }
+      continue;
     }
-    else {
-      if ( !unigrams.empty() ){
-	if ( doStrings ){
-	  root->doc()->declare( folia::AnnotationType::STRING, original_set,
-				correction_args );	}
-	else if ( doTokens ){
-	  root->doc()->declare( folia::AnnotationType::TOKEN, original_set,
-				correction_args );
-	}
-	corrected = correct_bigrams( bigrams, variants, unknowns,
-				     puncts, unigrams.back(), counts, proc );
+    if ( !TiCC::createPath( outName ) ){
+#pragma omp critical
+      {
+	cerr << "unable to create output file! " << outName << endl;
+	++fail_count;
       }
+      delete doc;
+      continue;
     }
-  }
-  else {
-    if ( !unigrams.empty() ){
-      if ( doStrings ){
-	root->doc()->declare( folia::AnnotationType::STRING, original_set,
-			      correction_args );	}
-      else if ( doTokens ){
-	root->doc()->declare( folia::AnnotationType::TOKEN, original_set,
-			      correction_args );
+    if ( !rebase_inputclass.empty() ){
+      rebase_text( doc, safe_inputclass, rebase_inputclass );
+    }
+    string error;
+    bool ok = false;
+    try {
+      ok = replay_delta( doc, deltas[fn], delta_settings["command"], error );
+      if ( ok ){
+	doc->save( outName );
       }
-      corrected = correct_trigrams( trigrams, variants, unknowns,
-				    puncts, unigrams, counts, proc );
     }
-  }
-  corrected = TiCC::trim( corrected );
-  if ( verbose > 1 ){
+    catch ( const exception& e ){
+      ok = false;
+      error = e.what();
+    }
 #pragma omp critical
     {
-      cout << "corrected " << ngram_size << "-grams uit: '"
-	   << corrected << "' (" << output_classname << ")" << endl;
+      if ( ok ){
+	for ( const auto& [word,count] : deltas[fn].counts ){
+	  total_counts[word] += count;
+	}
+	cout << "Applied :" << fileNames[fn] << " into " << outName << endl;
+      }
+      else {
+	cerr << "unable to apply " << fileNames[fn] << " to " << input
+	     << ": " << error << endl;
+	cout << "FAILED apply: " << fileNames[fn] << endl;
+	++fail_count;
+      }
     }
+    delete doc;
   }
-  if ( !corrected.empty() ){
-    //    cerr << "set text on " << root << endl;
-    //    cerr << par->str(output_classname) << endl;
-    // cerr << par->data()[1]->str(output_classname) << endl;
-    // cerr << par->data()[8]->str(output_classname) << endl;
-    // cerr << par->data()[88]->str(output_classname) << endl;
-    root->settext( corrected, output_classname );
-  }
+  print_statistics( total_counts );
+  return fail_count;
 }
 
-bool correctDoc( Document *doc,
-		 const unordered_map<string,vector<word_conf> >& variants,
-		 const unordered_set<string>& unknowns,
-		 const unordered_map<string,string>& puncts,
-		 const list<ElementType>& tag_list,
-		 unordered_map<string,size_t>& counts,
-		 const string& command,
-		 const string& outName ){
-  processor *proc = add_provenance( *doc, "FoLiA-correct", command );
-  KWargs args;
-  args["processor"] = proc->id();
-  doc->declare( folia::AnnotationType::CORRECTION, setname, args );
-  vector<FoliaElement*> ev;
-  if ( tag_list.empty() ){
-    vector<Sentence *> vs = doc->doc()->select<Sentence>();
-    if ( vs.empty() ){
-      vector<Paragraph*> vp = doc->doc()->select<Paragraph>();
-      merge<Paragraph>( ev, vp );
-    }
-    else {
-      merge<Sentence>( ev, vs );
-    }
-  }
-  else {
-    for ( const auto& et : tag_list ){
-      vector<FoliaElement*> v1 = doc->doc()->select( et );
-      if ( !v1.empty() ){
-	ev = v1;
-	break;
+void read_lexicon( ticcl_lexicon& lex,
+		   const string& variantsFileName,
+		   const string& unknownFileName,
+		   const string& punctFileName ){
+#ifdef TEST_HEMP
+  lex.puncts["N_A_P_O_L_E_O_N"] = "napoleon";
+  lex.puncts["N_A_P_O_L_E_O_N."] = "napoleon";
+  lex.puncts["(N_A_P_O_L_E_O_N)"] = "(napoleon)";
+  lex.puncts["P_Q."] = "PQRST";
+#endif
+
+#pragma omp parallel sections
+  {
+#pragma omp section
+    {
+#pragma omp critical
+      {
+	cout << "start reading variants " << endl;
+      }
+      if ( !fillVariants( variantsFileName, lex.variants, lex.num_sugg ) ){
+#pragma omp critical
+	{
+	  cerr << "no variants." << endl;
+	}
+	exit( EXIT_FAILURE );
+      }
+#pragma omp critical
+      {
+	cout << "read " << lex.variants.size() << " variants " << endl;
       }
     }
-  }
-  for( const auto& root : ev ){
-    try {
-      correctNgrams( root, variants, unknowns, puncts, counts, proc );
-    }
-    catch ( exception& e ){
+#pragma omp section
+    {
 #pragma omp critical
       {
-	cerr << "FoLiA error in element: " << root->id() << " of document " << doc->id() << endl;
-	cerr << e.what() << endl;
+	cout << "start reading unknowns " << endl;
+      }
+      if ( !fillUnknowns( unknownFileName, lex.unknowns, lex.unknown_keys ) ){
+#pragma omp critical
+	{
+	  cerr << "no unknown words!" << endl;
+	}
+      }
+#pragma omp critical
+      {
+	cout << "read " << lex.unknowns.size() << " unknown words " << endl;
       }
-      remove( outName.c_str() );
-      return false;
     }
-  }
-  doc->save( outName );
-  return true;
-}
-
-void rebase_text( Document *doc,
-		  const string& inputclass,
-		  const string& rebase_input ){
-
-  vector<TextContent*> tv = doc->doc()->select<TextContent>();
-  for ( const auto& t : tv ){
-    if ( t->cls() == inputclass ){
-      t->update_cls( rebase_input );
+#pragma omp section
+    {
+#pragma omp critical
+      {
+	cout << "start reading puncts " << endl;
+      }
+      if ( !fillPuncts( punctFileName, lex.puncts, lex.punct_keys ) ){
+#pragma omp critical
+	{
+	  cerr << "no punct words!" << endl;
+	}
+      }
+#pragma omp critical
+      {
+	cout << "read " << lex.puncts.size() << " punctuated words " << endl;
+      }
     }
   }
 }
@@ -1353,6 +2859,23 @@ void usage( const string& name ){
   cerr << "\t--punct='pname'\t name of punct words file, the *punct file produced by TICCL-unk" << endl;
   cerr << "\t--rank='vname'\t name of variants file. This can be a file produced by TICCL-rank, TICCL-chain " << endl;
   cerr << "\t\t\t or TICCL-chainclean" << endl;
+  cerr << "\t--compile-lexicon='lname'\t store the variants, unknowns and puncts" << endl;
+  cerr << "\t\t\t in a compiled lexicon file 'lname' and stop." << endl;
+  cerr << "\t\t\t (uses the --rank, --unk, --punct, --ngram and --nums values)" << endl;
+  cerr << "\t--lexicon='lname'\t use the compiled lexicon 'lname' instead of" << endl;
+  cerr << "\t\t\t the --rank, --unk and --punct files." << endl;
+  cerr << "\t--shared-lexicon\t publish the lexicon read from the --rank, --unk and" << endl;
+  cerr << "\t\t\t --punct files in shared memory, or use the one published by" << endl;
+  cerr << "\t\t\t an earlier run with the same files and settings." << endl;
+  cerr << "\t--serve='socket'\t load the lexicon once and handle correction jobs" << endl;
+  cerr << "\t\t\t from the Unix domain socket 'socket', or from stdin when '-'" << endl;
+  cerr << "\t--client='socket'\t submit the input files as jobs to a server on 'socket'" << endl;
+  cerr << "\t--stop-server\t with --client: stop the server when done." << endl;
+  cerr << "\t--delta\t\t write the corrections as a stand-off delta file" << endl;
+  cerr << "\t\t\t 'name.ticcl.xml.delta' instead of a corrected document." << endl;
+  cerr << "\t--apply-delta\t create the corrected documents from the given delta files." << endl;
+  cerr << "\t--stats-only\t run the correction, but only print the edit statistics." << endl;
+  cerr << "\t\t\t No output files are written." << endl;
   cerr << "\t--clear\t\t redo ALL corrections. (default is to skip already processed files)" << endl;
   cerr << "\t-R\t\t search the dirs recursively (when appropriate)" << endl;
   cerr << "\t-t <threads>\n\t--threads <threads> Number of threads to run on. "
@@ -1381,7 +2904,8 @@ int main( int argc, const char *argv[] ){
 			 "class:,inputclass:,outputclass:,rebase-inputclass:,"
 			 "setname:,clear,unk:,"
 			 "rank:,punct:,nums:,version,help,ngram:,string-nodes,"
-			 "word-nodes,threads:,tags:" );
+			 "word-nodes,threads:,tags:,compile-lexicon:,lexicon:,serve:,client:,"
+			 "stop-server,delta,apply-delta,stats-only,shared-lexicon" );
   try {
     opts.init( argc, argv );
   }
@@ -1400,6 +2924,10 @@ int main( int argc, const char *argv[] ){
   string variantsFileName;
   string unknownFileName;
   string punctFileName;
+  string lexiconFileName;
+  string compileFileName;
+  string serveAddress;
+  string clientAddress;
   string outPrefix;
   string value;
   if ( opts.extract( 'h' ) || opts.extract( "help" ) ){
@@ -1441,24 +2969,96 @@ int main( int argc, const char *argv[] ){
   opts.extract( 'e', expression );
   recursiveDirs = opts.extract( 'R' );
   opts.extract( 'O', outPrefix );
-  if ( !opts.extract( "punct", punctFileName ) ){
-    cerr << "missing '--punct' option" << endl;
+  opts.extract( "compile-lexicon", compileFileName );
+  opts.extract( "lexicon", lexiconFileName );
+  opts.extract( "serve", serveAddress );
+  opts.extract( "client", clientAddress );
+  bool stop_server = opts.extract( "stop-server" );
+  if ( !serveAddress.empty()
+       && ( !clientAddress.empty() || !compileFileName.empty() ) ){
+    cerr << "--serve cannot be combined with --client or --compile-lexicon"
+	 << endl;
+    exit( EXIT_FAILURE );
+  }
+  if ( stop_server && clientAddress.empty() ){
+    cerr << "--stop-server is only valid with --client" << endl;
     exit( EXIT_FAILURE );
   }
-  checkFile( "punct", punctFileName, ".punct" );
-  if ( !opts.extract( "unk", unknownFileName ) ){
-    cerr << "missing '--unk' option" << endl;
+  bool as_delta = opts.extract( "delta" );
+  bool apply_delta = opts.extract( "apply-delta" );
+  if ( ( as_delta || apply_delta )
+       && ( !serveAddress.empty() || !clientAddress.empty()
+	    || !compileFileName.empty() ) ){
+    cerr << "--delta and --apply-delta cannot be combined with --serve, "
+	 << "--client or --compile-lexicon" << endl;
     exit( EXIT_FAILURE );
   }
-  checkFile( "unk", unknownFileName, ".unk" );
-  if ( !opts.extract( "rank", variantsFileName ) ){
-    cerr << "missing '--rank' option" << endl;
+  if ( as_delta && apply_delta ){
+    cerr << "--delta and --apply-delta cannot be combined" << endl;
     exit( EXIT_FAILURE );
   }
-  if ( !TiCC::isFile( variantsFileName ) ){
-    cerr << "unable to find file '" << variantsFileName << "'" << endl;
+  bool stats_only = opts.extract( "stats-only" );
+  bool shared_lex = opts.extract( "shared-lexicon" );
+  if ( shared_lex && !compileFileName.empty() ){
+    cerr << "--shared-lexicon and --compile-lexicon cannot be combined"
+	 << endl;
+    exit( EXIT_FAILURE );
+  }
+  if ( stats_only
+       && ( as_delta || apply_delta || !serveAddress.empty()
+	    || !clientAddress.empty() || !compileFileName.empty() ) ){
+    cerr << "--stats-only cannot be combined with --delta, --apply-delta, "
+	 << "--serve, --client or --compile-lexicon" << endl;
     exit( EXIT_FAILURE );
   }
+  if ( !clientAddress.empty() ){
+    // the lexicon lives in the server
+  }
+  else if ( apply_delta ){
+    // the deltas hold the changes, no lexicon is needed
+  }
+  else if ( !lexiconFileName.empty() ){
+    if ( shared_lex ){
+      cerr << "--shared-lexicon is not needed with --lexicon, a compiled"
+	   << " lexicon is always shared" << endl;
+      exit( EXIT_FAILURE );
+    }
+    if ( !compileFileName.empty() ){
+      cerr << "--lexicon and --compile-lexicon cannot be combined" << endl;
+      exit( EXIT_FAILURE );
+    }
+    if ( opts.is_present( "punct" )
+	 || opts.is_present( "unk" )
+	 || opts.is_present( "rank" ) ){
+      cerr << "--lexicon cannot be combined with --punct, --unk or --rank"
+	   << endl;
+      exit( EXIT_FAILURE );
+    }
+    if ( !TiCC::isFile( lexiconFileName ) ){
+      cerr << "unable to find file '" << lexiconFileName << "'" << endl;
+      exit( EXIT_FAILURE );
+    }
+  }
+  else {
+    if ( !opts.extract( "punct", punctFileName ) ){
+      cerr << "missing '--punct' option" << endl;
+      exit( EXIT_FAILURE );
+    }
+    checkFile( "punct", punctFileName, ".punct" );
+    if ( !opts.extract( "unk", unknownFileName ) ){
+      cerr << "missing '--unk' option" << endl;
+      exit( EXIT_FAILURE );
+    }
+    checkFile( "unk", unknownFileName, ".unk" );
+    if ( !opts.extract( "rank", variantsFileName ) ){
+      cerr << "missing '--rank' option" << endl;
+      exit( EXIT_FAILURE );
+    }
+    if ( !TiCC::isFile( variantsFileName ) ){
+      cerr << "unable to find file '" << variantsFileName << "'" << endl;
+      exit( EXIT_FAILURE );
+    }
+  }
   if ( opts.extract( "nums", value ) ){
     if ( !TiCC::stringTo( value, numSugg )
 	 || numSugg < 1 ){
@@ -1486,7 +3086,9 @@ int main( int argc, const char *argv[] ){
     exit( EXIT_FAILURE );
   }
 #endif
+  bool ngram_given = false;
   if ( opts.extract( "ngram", value ) ){
+    ngram_given = true;
     if ( !TiCC::stringTo( value, ngram_size )
 	 || ngram_size > 3
 	 || ngram_size < 1 ){
@@ -1506,28 +3108,46 @@ int main( int argc, const char *argv[] ){
   list<ElementType> tag_list;
   string tagsstring;
   opts.extract( "tags", tagsstring );
-  if ( !tagsstring.empty() ){
-    vector<string> parts = TiCC::split_at( tagsstring, "," );
-    for( const auto& t : parts ){
-      ElementType et;
-      try {
-	et = TiCC::stringTo<ElementType>( t );
-      }
-      catch ( ... ){
-	cerr << "in option --tags, the string '" << t
-	     << "' doesn't represent a known FoLiA tag" << endl;
-	exit(EXIT_FAILURE);
-      }
-      tag_list.push_back( et );
-    }
+  string bad_tag;
+  if ( !parse_tags( tagsstring, tag_list, bad_tag ) ){
+    cerr << "in option --tags, the string '" << bad_tag
+	 << "' doesn't represent a known FoLiA tag" << endl;
+    exit(EXIT_FAILURE);
   }
 
   vector<string> file_names = opts.getMassOpts();
-  if ( file_names.size() == 0 ){
+  if ( !compileFileName.empty() ){
+    if ( !file_names.empty() ){
+      cerr << "--compile-lexicon: ignoring the input files" << endl;
+    }
+    ticcl_lexicon lex;
+    lex.num_sugg = numSugg;
+    read_lexicon( lex, variantsFileName, unknownFileName, punctFileName );
+    cout << "start compiling lexicon " << compileFileName << endl;
+    try {
+      lex.compile( compileFileName );
+    }
+    catch ( const exception& e ){
+      cerr << e.what() << endl;
+      exit( EXIT_FAILURE );
+    }
+    cout << "stored compiled lexicon in " << compileFileName << endl;
+    exit( EXIT_SUCCESS );
+  }
+  if ( !clientAddress.empty() && stop_server && file_names.empty() ){
+    string reply;
+    bool ok = submit( clientAddress, "STOP", reply );
+    cout << reply << endl;
+    exit( ok ? EXIT_SUCCESS : EXIT_FAILURE );
+  }
+  if ( file_names.size() == 0 && serveAddress.empty() ){
     cerr << "missing input file or directory" << endl;
     exit( EXIT_FAILURE );
   }
 
+  if ( stats_only ){
+    outPrefix.clear();
+  }
   if ( !outPrefix.empty() ){
     if ( outPrefix[outPrefix.length()-1] != '/' )
       outPrefix += "/";
@@ -1545,7 +3165,7 @@ int main( int argc, const char *argv[] ){
     fileNames.insert( fileNames.end(), fns.begin(), fns.end() );
   }
   size_t toDo = fileNames.size();
-  if ( toDo == 0 ){
+  if ( toDo == 0 && serveAddress.empty() ){
     if ( expression.empty() ){
       cerr << "no input-files found." << endl;
     }
@@ -1555,74 +3175,90 @@ int main( int argc, const char *argv[] ){
     exit(EXIT_SUCCESS);
   }
 
-  unordered_map<string,vector<word_conf> > variants;
-  unordered_set<string> unknowns;
-  unordered_map<string,string> puncts;
-#ifdef TEST_HEMP
-  puncts["N_A_P_O_L_E_O_N"] = "napoleon";
-  puncts["N_A_P_O_L_E_O_N."] = "napoleon";
-  puncts["(N_A_P_O_L_E_O_N)"] = "(napoleon)";
-  puncts["P_Q."] = "PQRST";
+#ifdef HAVE_OPENMP
+  if ( toDo > 0 && toDo < static_cast<size_t>(numThreads) ){
+    // more threads than files: use the spare ones inside the documents
+    root_threads = numThreads / toDo;
+    omp_set_max_active_levels( 2 );
+  }
 #endif
 
-#pragma omp parallel sections
-  {
-#pragma omp section
-    {
-#pragma omp critical
-      {
-	cout << "start reading variants " << endl;
-      }
-      if ( !fillVariants( variantsFileName, variants, numSugg ) ){
-#pragma omp critical
-	{
-	  cerr << "no variants." << endl;
-	}
-	exit( EXIT_FAILURE );
-      }
-#pragma omp critical
-      {
-	cout << "read " << variants.size() << " variants " << endl;
-      }
+  if ( !clientAddress.empty() ){
+    int fails = run_client( clientAddress, fileNames, outPrefix,
+			    tagsstring, clear, ngram_given );
+    if ( stop_server ){
+      string reply;
+      submit( clientAddress, "STOP", reply );
+      cout << reply << endl;
     }
-#pragma omp section
-    {
-#pragma omp critical
-      {
-	cout << "start reading unknowns " << endl;
-      }
-      if ( !fillUnknowns( unknownFileName, unknowns ) ){
-#pragma omp critical
-	{
-	  cerr << "no unknown words!" << endl;
-	}
+    exit( fails == 0 ? EXIT_SUCCESS : EXIT_FAILURE );
+  }
+
+  if ( apply_delta ){
+    int fails = apply_deltas( fileNames, outPrefix, clear );
+    exit( fails == 0 ? EXIT_SUCCESS : EXIT_FAILURE );
+  }
+
+  ticcl_lexicon lex;
+  lex.num_sugg = numSugg;
+  if ( shared_lex ){
+    cout << "start attaching shared lexicon" << endl;
+    try {
+      shared_lexicon segment( "FoLiA-correct",
+			      { variantsFileName,
+				unknownFileName,
+				punctFileName },
+			      "ngram=" + TiCC::toString(ngram_size)
+			      + " nums=" + TiCC::toString(numSugg) );
+      auto fill = [&]( lexicon_builder& builder ){
+	ticcl_lexicon text_lex;
+	text_lex.num_sugg = numSugg;
+	read_lexicon( text_lex,
+		      variantsFileName, unknownFileName, punctFileName );
+	text_lex.compile( builder );
+      };
+      if ( segment.attach( lex.image, fill, ngram_size, numSugg ) ){
+	cout << "attached to ";
       }
-#pragma omp critical
-      {
-	cout << "read " << unknowns.size() << " unknown words " << endl;
+      else {
+	cout << "published ";
       }
+      cout << "shared lexicon " << segment.file_name() << endl;
+      lex.check_image( segment.file_name() );
     }
-#pragma omp section
-    {
-#pragma omp critical
-      {
-	cout << "start reading puncts " << endl;
-      }
-      if ( !fillPuncts( punctFileName, puncts ) ){
-#pragma omp critical
-	{
-	  cerr << "no punct words!" << endl;
-	}
-      }
-#pragma omp critical
-      {
-	cout << "read " << puncts.size() << " punctuated words " << endl;
-      }
+    catch ( const exception& e ){
+      cerr << e.what() << endl;
+      exit( EXIT_FAILURE );
     }
+    cout << "mapped " << lex.image.size() << " lexicon entries" << endl;
   }
+  else if ( lexiconFileName.empty() ){
+    read_lexicon( lex, variantsFileName, unknownFileName, punctFileName );
+  }
+  else {
+    cout << "start mapping lexicon " << lexiconFileName << endl;
+    try {
+      lex.use_image( lexiconFileName );
+    }
+    catch ( const exception& e ){
+      cerr << e.what() << endl;
+      exit( EXIT_FAILURE );
+    }
+    cout << "mapped " << lex.image.size() << " lexicon entries" << endl;
+  }
+  lex.build_index();
 
   cout << "verbosity = " << verbose << endl;
 
+  if ( !serveAddress.empty() ){
+    map<string,size_t> total_counts;
+    if ( !serve( serveAddress, lex, tag_list, orig_command, total_counts ) ){
+      exit( EXIT_FAILURE );
+    }
+    print_statistics( total_counts );
+    return EXIT_SUCCESS;
+  }
+
   if ( fileNames.size() > 1  ){
     cout << "start processing of " << toDo << " files " << endl;
   }
@@ -1646,35 +3282,28 @@ int main( int argc, const char *argv[] ){
       }
       continue;
     }
-    string outName = outPrefix;
+    string outName;
+    if ( !stats_only ){
+      outName = output_name( docName, outPrefix );
+      if ( as_delta ){
+	outName += ".delta";
+      }
+    }
     string::size_type pos = docName.rfind("/");
     if ( pos != string::npos ){
       docName = docName.substr( pos+1 );
     }
-    pos = docName.rfind(".folia");
-    if ( pos != string::npos ){
-      outName += docName.substr(0,pos) + ".ticcl" + docName.substr(pos);
-    }
-    else {
-      pos = docName.rfind(".");
-      if ( pos != string::npos ){
-	outName += docName.substr(0,pos) + ".ticcl" + docName.substr(pos);
-      }
-      else {
-	outName += docName + ".ticcl";
-      }
-    }
-    if ( clear ){
+    if ( clear && !stats_only ){
       remove( outName.c_str() );
     }
-    if ( TiCC::isFile( outName ) ){
+    if ( !stats_only && TiCC::isFile( outName ) ){
 #pragma omp critical
       {
 	cerr << "skipping already done file: " << outName << endl;
       }
     }
     else {
-      if ( !TiCC::createPath( outName ) ){
+      if ( !stats_only && !TiCC::createPath( outName ) ){
 #pragma omp critical
 	{
 	  cerr << "unable to create output file! " << outName << endl;
@@ -1691,9 +3320,12 @@ int main( int argc, const char *argv[] ){
       }
       try {
 	unordered_map<string,size_t> counts;
-	if ( correctDoc( doc, variants, unknowns, puncts,
-			 tag_list, counts,
-			 orig_command, outName ) ){
+	correction_delta delta;
+	if ( as_delta ){
+	  delta.describe( absolute_path( fileNames[fn] ), orig_command );
+	}
+	if ( correctDoc( doc, lex, tag_list, counts, orig_command, outName,
+			 as_delta ? &delta : 0 ) ){
 #pragma omp critical
 	  {
 	    if (!counts.empty() ){
@@ -1703,7 +3335,11 @@ int main( int argc, const char *argv[] ){
 		total_counts[word] += count;
 	      }
 	    }
-	    if ( toDo > 1 ){
+	    if ( stats_only ){
+	      cout << "Statistics :" << docName << edit_summary( counts )
+		   << endl;
+	    }
+	    else if ( toDo > 1 ){
 	      cout << "Processed :" << docName << " into " << outName
 		   << " still " << --toDo << " files to go." << endl;
 	    }
@@ -1733,12 +3369,6 @@ int main( int argc, const char *argv[] ){
     delete doc;
   }
 
-  if ( !total_counts.empty() ){
-    cout << "edit statistics: " << endl;
-    cout << "\tedit\t count" << endl;
-    for ( const auto& [word,count] : total_counts ){
-      cout << "\t" << word << "\t" << count << endl;
-    }
-  }
+  print_statistics( total_counts );
   return EXIT_SUCCESS;
 }
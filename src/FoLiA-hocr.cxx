@@ -47,9 +47,9 @@ using namespace	std;
 using namespace	icu;
 
 bool verbose = false;
+bool split_pages = false;
 string setname = "FoLiA-hocr-set";
 string classname = "OCR";
-string processor_id;
 
 string extractContent( xmlNode* pnt ) {
   string result;
@@ -62,8 +62,61 @@ string extractContent( xmlNode* pnt ) {
 }
 
 
-void processParagraphs( xmlNode *div, folia::FoliaElement *out, const string& file ){
-  list<xmlNode*> pars = TiCC::FindNodes( div, "//p" );
+struct hocr_line {
+  /// the words of one 'ocr_line'
+  list<xmlNode*> words;     // the 'ocrx_word' nodes
+  list<xmlNode*> old_words; // the 'ocr_word' nodes, used when there are no
+                            // 'ocrx_word' nodes
+};
+
+struct hocr_par {
+  /// a <p> node, with its 'ocr_line' nodes
+  explicit hocr_par( xmlNode *n ): node(n) {};
+  xmlNode *node;
+  list<hocr_line> lines;
+};
+
+void scan_page( xmlNode *node,
+		list<hocr_par>& pars,
+		hocr_par *par,
+		hocr_line *line ){
+  /// collect the paragraphs, lines and words below node in one walk.
+  /// \param par the paragraph we are in, if any
+  /// \param line the line we are in, if any
+  for ( xmlNode *pnt = node->children; pnt; pnt = pnt->next ){
+    if ( pnt->type != XML_ELEMENT_NODE ){
+      continue;
+    }
+    string tag = TiCC::Name( pnt );
+    if ( tag == "p" ){
+      pars.push_back( hocr_par( pnt ) );
+      scan_page( pnt, pars, &pars.back(), 0 );
+      continue;
+    }
+    if ( par && tag == "span" ){
+      string cls = TiCC::getAttribute( pnt, "class" );
+      if ( cls == "ocr_line" ){
+	par->lines.push_back( hocr_line() );
+	scan_page( pnt, pars, par, &par->lines.back() );
+	continue;
+      }
+      if ( line ){
+	if ( cls == "ocrx_word" ){
+	  line->words.push_back( pnt );
+	}
+	else if ( cls == "ocr_word" ){
+	  line->old_words.push_back( pnt );
+	}
+      }
+    }
+    scan_page( pnt, pars, par, line );
+  }
+}
+
+void processParagraphs( const list<hocr_par>& pars,
+			folia::FoliaElement *out,
+			const string& file,
+			const string& processor_id ){
   if ( verbose ){
 #pragma omp critical
     {
@@ -71,35 +124,33 @@ void processParagraphs( xmlNode *div, folia::FoliaElement *out, const string& fi
     }
   }
   for ( const auto& p : pars ){
-    list<xmlNode*> lines = TiCC::FindNodes( p, ".//span[@class='ocr_line']" );
-    if ( lines.empty() ){
+    if ( p.lines.empty() ){
 #pragma omp critical
       {
 	cerr << "found no 'ocr_line' nodes in paragraph id="
-	     << TiCC::getAttribute( p, "id" ) << " (continuing)" << endl;
+	     << TiCC::getAttribute( p.node, "id" ) << " (continuing)" << endl;
       }
       continue;
     }
     if ( verbose ){
 #pragma omp critical
       {
-	cout << "\thandling 'ocr_line' total=" << lines.size() << endl;
+	cout << "\thandling 'ocr_line' total=" << p.lines.size() << endl;
       }
     }
-    string p_id = TiCC::getAttribute( p, "id" );
+    string p_id = TiCC::getAttribute( p.node, "id" );
     folia::KWargs p_args;
     p_args["processor"] = processor_id;
     out->doc()->declare( folia::AnnotationType::PARAGRAPH, setname,  p_args );
     p_args["xml:id"] = out->id() + "." + p_id;
     folia::Paragraph *par = out->add_child<folia::Paragraph>( p_args );
     UnicodeString txt;
-    for ( const auto& line : lines ){
-      list<xmlNode*> words = TiCC::FindNodes( line,
-					      ".//span[@class='ocrx_word']" );
-      if ( words.empty() ){
+    for ( const auto& line : p.lines ){
+      const list<xmlNode*> *words = &line.words;
+      if ( words->empty() ){
 	// no ocrx_words. Lets see...
-	words = TiCC::FindNodes( line, ".//span[@class='ocr_word']" );
-	if ( words.empty() ){
+	words = &line.old_words;
+	if ( words->empty() ){
 #pragma omp critical
 	  {
 	    cerr << "found no OCRX_WORD or OCR_WORD nodes in " << file << endl;
@@ -112,10 +163,10 @@ void processParagraphs( xmlNode *div, folia::FoliaElement *out, const string& fi
       if ( verbose ){
 #pragma omp critical
 	{
-	  cout << "\t\thandling 'ocr_word' total=" << words.size() << endl;
+	  cout << "\t\thandling 'ocr_word' total=" << words->size() << endl;
 	}
       }
-      for ( const auto& word : words ){
+      for ( const auto& word : *words ){
 	string w_id = TiCC::getAttribute( word, "id" );
 	string content = extractContent( word );
 	content = TiCC::trim( content );
@@ -150,6 +201,22 @@ void processParagraphs( xmlNode *div, folia::FoliaElement *out, const string& fi
   }
 }
 
+void find_pages( xmlNode *node, list<xmlNode*>& pages ){
+  /// collect the 'ocr_page' divs below node, in document order
+  for ( xmlNode *pnt = node->children; pnt; pnt = pnt->next ){
+    if ( pnt->type != XML_ELEMENT_NODE ){
+      continue;
+    }
+    if ( TiCC::Name( pnt ) == "div"
+	 && TiCC::getAttribute( pnt, "class" ) == "ocr_page" ){
+      pages.push_back( pnt );
+    }
+    else {
+      find_pages( pnt, pages );
+    }
+  }
+}
+
 string getDocId( const string& title ){
   string result;
   vector<string> vec = TiCC::split_at( title, ";" );
@@ -169,50 +236,61 @@ string getDocId( const string& title ){
   return result;
 }
 
-void convert_hocr( const string& fileName,
-		   const string& outputDir,
-		   const zipType outputType,
-		   const string& prefix,
-		   const string& command ){
-  if ( verbose ){
-#pragma omp critical
-    {
-      cout << "start handling " << fileName << endl;
-    }
+string output_name( const string& outputDir,
+		    const string& name,
+		    zipType inputType,
+		    zipType outputType ){
+  string outName = outputDir + "/" + name + ".folia.xml";
+  zipType type = inputType;
+  if ( outputType != NORMAL ){
+    type = outputType;
   }
-  zipType inputType;
-  xmlDoc *xdoc = getXml( fileName, inputType );
-  if ( !xdoc ){
-#pragma omp critical
-    {
-      cerr << "problem detecting type of file: " << fileName << endl;
-      cerr << "it MUST have extension .hocr, .html or .xhtml (or .bz2 or .gz variants)" << endl;
-    }
-    return;
+  if ( type == BZ2 ){
+    outName += ".bz2";
   }
-  xmlNode *root = xmlDocGetRootElement( xdoc );
-  list<xmlNode*> divs = TiCC::FindNodes( root, "//div[@class='ocr_page']" );
-  if ( divs.empty() ) {
+  else if ( type == GZ ){
+    outName += ".gz";
+  }
+  return outName;
+}
+
+void save_result( folia::Document& doc, const string& outName ){
+  vector<folia::Paragraph*> pv = doc.paragraphs();
+  if ( pv.size() == 0 ||
+       ( pv.size() == 1 && pv[0]->size() == 0 ) ){
+    // no paragraphs, or just 1 without data
 #pragma omp critical
     {
-      cerr << "no OCR_PAGE node found in " << fileName << endl;
+      cerr << "skipped empty result : " << outName << endl;
     }
-    exit(EXIT_FAILURE);
   }
-  if ( divs.size() > 1 ) {
+  else {
+    doc.save( outName );
+    if ( verbose ){
 #pragma omp critical
-    {
-      cerr << "multiple OCR_PAGE nodes found. Not supported. in " << fileName << endl;
+      {
+	cout << "created " << outName << endl;
+      }
     }
-    exit(EXIT_FAILURE);
   }
-  string title = TiCC::getAttribute( *divs.begin(), "title" );
+}
+
+void convert_page( xmlNode *page,
+		   const string& fileName,
+		   const string& outputDir,
+		   const zipType inputType,
+		   const zipType outputType,
+		   const string& prefix,
+		   const string& command ){
+  /// convert one 'ocr_page' into a FoLiA document of its own, named after
+  /// the image of the page
+  string title = TiCC::getAttribute( page, "title" );
   if ( title.empty() ){
 #pragma omp critical
     {
       cerr << "No 'title' attribute found in ocr_page: " << fileName << endl;
     }
-    exit(EXIT_FAILURE);
+    return;
   }
   title = getDocId( title );
   string docid = title.substr( 0, title.find(".") );
@@ -220,45 +298,111 @@ void convert_hocr( const string& fileName,
   folia::Document doc( "xml:id='" + docid + "'" );
   doc.set_metadata( "filename", title );
   folia::processor *proc = add_provenance( doc, "FoLiA-hocr", command );
-  processor_id = proc->id();
+  string processor_id = proc->id();
   folia::KWargs args;
   args["processor"] = processor_id;
   doc.declare( folia::AnnotationType::STRING, setname,  args );
   args.clear();
   args["xml:id"] = docid + ".text";
   folia::Text *text = doc.create_root<folia::Text>( args );
-  processParagraphs( root, text, TiCC::basename(fileName) );
-  xmlFreeDoc( xdoc );
+  list<hocr_par> pars;
+  scan_page( page, pars, 0, 0 );
+  processParagraphs( pars, text, TiCC::basename(fileName), processor_id );
+  save_result( doc, output_name( outputDir, prefix + title,
+				 inputType, outputType ) );
+}
 
-  string outName = outputDir + "/" + prefix + title + ".folia.xml";
-  zipType type = inputType;
-  if ( outputType != NORMAL ){
-    type = outputType;
+void convert_book( const list<xmlNode*>& pages,
+		   const string& fileName,
+		   const string& outputDir,
+		   const zipType inputType,
+		   const zipType outputType,
+		   const string& prefix,
+		   const string& command ){
+  /// convert a multi-page hOCR file into one FoLiA document, with a
+  /// Division per 'ocr_page'. The pages are scanned in parallel, and added
+  /// to the document in order.
+  string name = TiCC::basename( fileName );
+  string docid = prefix + name.substr( 0, name.find(".") );
+  folia::Document doc( "xml:id='" + docid + "'" );
+  doc.set_metadata( "filename", name );
+  folia::processor *proc = add_provenance( doc, "FoLiA-hocr", command );
+  string processor_id = proc->id();
+  folia::KWargs args;
+  args["processor"] = processor_id;
+  doc.declare( folia::AnnotationType::STRING, setname,  args );
+  doc.declare( folia::AnnotationType::DIVISION, setname,  args );
+  args.clear();
+  args["xml:id"] = docid + ".text";
+  folia::Text *text = doc.create_root<folia::Text>( args );
+  vector<xmlNode*> page_nodes( pages.begin(), pages.end() );
+  vector<list<hocr_par>> scanned( page_nodes.size() );
+  for ( size_t i=0; i < page_nodes.size(); ++i ){
+#pragma omp task shared(page_nodes,scanned) firstprivate(i)
+    scan_page( page_nodes[i], scanned[i], 0, 0 );
   }
-  if ( type == BZ2 ){
-    outName += ".bz2";
+#pragma omp taskwait
+  args.clear();
+  args["class"] = "page";
+  args["generate_id"] = text->id();
+  for ( const auto& pars : scanned ){
+    folia::Division *div = text->add_child<folia::Division>( args );
+    processParagraphs( pars, div, name, processor_id );
   }
-  else if ( type == GZ ){
-    outName += ".gz";
+  save_result( doc, output_name( outputDir, docid, inputType, outputType ) );
+}
+
+void convert_hocr( const string& fileName,
+		   const string& outputDir,
+		   const zipType outputType,
+		   const string& prefix,
+		   const string& command ){
+  if ( verbose ){
+#pragma omp critical
+    {
+      cout << "start handling " << fileName << endl;
+    }
   }
-  vector<folia::Paragraph*> pv = doc.paragraphs();
-  if ( pv.size() == 0 ||
-       ( pv.size() == 1 && pv[0]->size() == 0 ) ){
-    // no paragraphs, or just 1 without data
+  zipType inputType;
+  xmlDoc *xdoc = getXml( fileName, inputType );
+  if ( !xdoc ){
 #pragma omp critical
     {
-      cerr << "skipped empty result : " << outName << endl;
+      cerr << "problem detecting type of file: " << fileName << endl;
+      cerr << "it MUST have extension .hocr, .html or .xhtml (or .bz2 or .gz variants)" << endl;
     }
+    return;
   }
-  else {
-    doc.save( outName );
-    if ( verbose ){
+  xmlNode *root = xmlDocGetRootElement( xdoc );
+  list<xmlNode*> pages;
+  find_pages( root, pages );
+  if ( pages.empty() ) {
 #pragma omp critical
-      {
-	cout << "created " << outName << endl;
-      }
+    {
+      cerr << "no OCR_PAGE node found in " << fileName << endl;
     }
+    xmlFreeDoc( xdoc );
+    return;
   }
+  if ( verbose && pages.size() > 1 ){
+#pragma omp critical
+    {
+      cout << "found " << pages.size() << " pages in " << fileName << endl;
+    }
+  }
+  if ( pages.size() == 1 || split_pages ){
+    for ( const auto& page : pages ){
+#pragma omp task shared(fileName,outputDir,prefix,command) firstprivate(page)
+      convert_page( page, fileName, outputDir,
+		    inputType, outputType, prefix, command );
+    }
+#pragma omp taskwait
+  }
+  else {
+    convert_book( pages, fileName, outputDir,
+		  inputType, outputType, prefix, command );
+  }
+  xmlFreeDoc( xdoc );
 }
 
 void usage(){
@@ -274,6 +418,9 @@ void usage(){
     "(default '" << setname << "')" << endl;
   cerr << "\t--class='class'\t the FoLiA class name for <t> nodes. "
     "(default '" << classname << "')" << endl;
+  cerr << "\t--split\t\t convert every page of a multi-page hOCR file into a" << endl;
+  cerr << "\t\t\t document of its own. (default: one document with a" << endl;
+  cerr << "\t\t\t Division per page)" << endl;
   cerr << "\t--prefix='pre'\t add this prefix to ALL created files. (default 'FH-') " << endl;
   cerr << "\t\t\t use 'none' for an empty prefix. (can be dangerous)" << endl;
   cerr << "\t-v\t\t verbose output " << endl;
@@ -282,7 +429,8 @@ void usage(){
 
 int main( int argc, char *argv[] ){
   TiCC::CL_Options opts( "vVt:O:h",
-			 "compress:,class:,setname:,help,version,prefix:,threads:" );
+			 "compress:,class:,setname:,help,version,prefix:,threads:,"
+			 "split" );
   try {
     opts.init( argc, argv );
   }
@@ -338,6 +486,7 @@ int main( int argc, char *argv[] ){
 #endif
   }
   opts.extract( 'O', outputDir );
+  split_pages = opts.extract( "split" );
   opts.extract( "setname", setname );
   opts.extract( "class", classname );
   string prefix = "FH-";
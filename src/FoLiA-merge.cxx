@@ -43,6 +43,7 @@
 #include "ticcutils/Timer.h"
 #include "libfolia/folia.h"
 #include "foliautils/common_code.h"
+#include "foliautils/mapped_lexicon.h"
 
 #include "config.h"
 #ifdef HAVE_OPENMP
@@ -58,6 +59,38 @@ int verbose = 0;
 string lem_setname = "merged-lemma-set";
 string pos_setname = "merged-pos-set";
 
+class merge_lexicon {
+  /// word => (lemma,POS). Either read into this process, or mapped from a
+  /// shared_lexicon, where the value is stored as 'lemma<TAB>POS'
+public:
+  bool find( const UnicodeString&, UnicodeString&, UnicodeString& ) const;
+  map<UnicodeString,pair<UnicodeString,UnicodeString>> entries;
+  mapped_lexicon image;
+};
+
+bool merge_lexicon::find( const UnicodeString& word,
+			  UnicodeString& lemma,
+			  UnicodeString& pos ) const {
+  if ( image.is_open() ){
+    const lexicon_entry *e = image.find( TiCC::UnicodeToUTF8( word ) );
+    if ( !e || !( e->flags & LEX_VALUE ) ){
+      return false;
+    }
+    string_view value = image.value( *e );
+    size_t tab = value.find( '\t' );
+    lemma = TiCC::UnicodeFromUTF8( string( value.substr( 0, tab ) ) );
+    pos = TiCC::UnicodeFromUTF8( string( value.substr( tab+1 ) ) );
+    return true;
+  }
+  auto const it = entries.find( word );
+  if ( it == entries.end() ){
+    return false;
+  }
+  lemma = it->second.first;
+  pos = it->second.second;
+  return true;
+}
+
 map<UnicodeString,pair<UnicodeString,UnicodeString>> fill_lexicon( const string& fn ){
   ifstream is( fn );
   map<UnicodeString,pair<UnicodeString,UnicodeString>> result;
@@ -79,15 +112,14 @@ map<UnicodeString,pair<UnicodeString,UnicodeString>> fill_lexicon( const string&
 }
 
 void add_lemma_pos( FoliaElement *word,
-		    const map<UnicodeString,pair<UnicodeString,UnicodeString>>& lexicon ){
+		    const merge_lexicon& lexicon ){
   UnicodeString val = word->unicode();
   if ( verbose > 0 ){
     cerr << "lookup: '" << val << "'" << endl;
   }
-  auto const it = lexicon.find( val );
-  if ( it != lexicon.end() ){
-    UnicodeString lemma = it->second.first;
-    UnicodeString pos = it->second.second;
+  UnicodeString lemma;
+  UnicodeString pos;
+  if ( lexicon.find( val, lemma, pos ) ){
     if ( verbose > 0 ){
       cerr << "found lemma : '" << lemma << "', pos=" << pos << endl;
     }
@@ -103,7 +135,7 @@ void add_lemma_pos( FoliaElement *word,
 }
 
 bool merge_values( Document *doc,
-		   const map<UnicodeString,pair<UnicodeString,UnicodeString>>& lexicon,
+		   const merge_lexicon& lexicon,
 		   const string& outName,
 		   const string& command ){
   processor *proc = add_provenance( *doc, "FoLiA-merge", command );
@@ -137,6 +169,9 @@ void usage( const string& name ){
        << endl;
   cerr << "\t-l or --lexicon=<name>\t the lexicon for word/lemma/POS lookup "
        << endl;
+  cerr << "\t--shared-lexicon\t keep the lexicon in shared memory, for use by"
+       << endl;
+  cerr << "\t\t\t other runs with the same lexicon." << endl;
   cerr << "\t--lemset='name'\t (default '" << lem_setname << "')" << endl;
   cerr << "\t--posset='name'\t (default '" << pos_setname << "')" << endl;
   cerr << "\t-O\t output prefix" << endl;
@@ -151,7 +186,7 @@ void usage( const string& name ){
 
 int main( int argc, const char *argv[] ){
   TiCC::CL_Options opts( "vVl:O:t:h",
-			 "help,lemset:,posset:,lexicon:,threads:" );
+			 "help,lemset:,posset:,lexicon:,threads:,shared-lexicon" );
   try {
     opts.init( argc, argv );
   }
@@ -179,6 +214,7 @@ int main( int argc, const char *argv[] ){
   opts.extract( "posset", pos_setname );
   string outPrefix;
   opts.extract( 'O', outPrefix );
+  bool shared_lex = opts.extract( "shared-lexicon" );
   if ( !( opts.extract( "l", lex_filename ) ||
 	  opts.extract( "lexicon", lex_filename ) ) ){
     cerr << "missing '-l or --lexicon' option" << endl;
@@ -226,7 +262,34 @@ int main( int argc, const char *argv[] ){
     }
   }
 
-  map<UnicodeString,pair<UnicodeString,UnicodeString>> lexicon = fill_lexicon( lex_filename );
+  merge_lexicon lexicon;
+  if ( shared_lex ){
+    try {
+      shared_lexicon segment( "FoLiA-merge", { lex_filename } );
+      auto fill = [&]( lexicon_builder& builder ){
+	for ( const auto& [word,value] : fill_lexicon( lex_filename ) ){
+	  builder.add_value( TiCC::UnicodeToUTF8( word ),
+			     TiCC::UnicodeToUTF8( value.first ) + "\t"
+			     + TiCC::UnicodeToUTF8( value.second ) );
+	}
+      };
+      if ( segment.attach( lexicon.image, fill ) ){
+	cout << "attached to ";
+      }
+      else {
+	cout << "published ";
+      }
+      cout << "shared lexicon " << segment.file_name() << " with "
+	   << lexicon.image.size() << " entries" << endl;
+    }
+    catch ( const exception& e ){
+      cerr << e.what() << endl;
+      exit( EXIT_FAILURE );
+    }
+  }
+  else {
+    lexicon.entries = fill_lexicon( lex_filename );
+  }
   cout << "verbosity = " << verbose << endl;
 
   if ( filenames.size() > 1  ){
@@ -25,6 +25,7 @@
 */
 
 #include <cassert>
+#include <cstdlib>
 #include <string>
 #include <list>
 #include <map>
@@ -32,6 +33,8 @@
 #include <stdexcept>
 #include <iostream>
 #include <fstream>
+#include <algorithm>
+#include "unicode/regex.h"
 #include "ticcutils/StringOps.h"
 #include "ticcutils/PrettyPrint.h"
 #include "libfolia/folia.h"
@@ -57,11 +60,11 @@ bool do_strings = true;
 bool do_markup = true;
 bool do_sent = false;
 bool trust_tokenization = false;
+bool book_mode = false;
 const string processor_label = "FoLiA-page";
 
 string setname = "";
 string classname = "OCR";
-string processor_id;
 
 folia::Hyphbreak *make_hbreak( const UnicodeString& hyph ){
   auto *hb = new folia::Hyphbreak();
@@ -97,7 +100,8 @@ void appendStr( folia::FoliaElement *root,
 		const UnicodeString& uval,
 		const UnicodeString& hyph,
 		const string& id,
-		const string& file ){
+		const string& file,
+		const string& processor_id ){
   if ( !uval.isEmpty() ){
     folia::KWargs ref_args;
     if ( do_refs ){
@@ -127,7 +131,7 @@ void appendStr( folia::FoliaElement *root,
 
 string getOrg( xmlNode *root ){
   string result;
-  xmlNode* page = TiCC::xPath( root, "*:Page" );
+  xmlNode* page = first_child( root, "Page" );
   if ( page ){
     string ref = TiCC::getAttribute( page, "imageFilename" );
     if ( !ref.empty() ) {
@@ -135,7 +139,7 @@ string getOrg( xmlNode *root ){
       return result;
     }
   }
-  xmlNode* comment = TiCC::xPath( root, "*:Metadata/*:Comment" );
+  xmlNode* comment = first_child( root, "Metadata/Comment" );
   if ( comment ){
     xmlNode *node = comment->children;
     if ( node->type == XML_CDATA_SECTION_NODE ){
@@ -166,9 +170,10 @@ UnicodeString handle_one_word( folia::Sentence *sent,
 			       folia::TextContent *s_txt,
 			       xmlNode *word,
 			       bool last,
-			       const string& fileName ){
+			       const string& fileName,
+			       const string& processor_id ){
   string wid = TiCC::getAttribute( word, "id" );
-  list<xmlNode*> unicodes = TiCC::FindNodes( word, "./*:TextEquiv/*:Unicode" );
+  list<xmlNode*> unicodes = child_nodes( word, "TextEquiv/Unicode" );
   if ( unicodes.size() != 1 ){
     throw runtime_error( "expected only 1 unicode entry in Word: " + wid );
   }
@@ -216,8 +221,9 @@ UnicodeString handle_one_word( folia::Sentence *sent,
 
 void handle_uni_lines( folia::FoliaElement *root,
 		       xmlNode *parent,
-		       const string& fileName ){
-  list<xmlNode*> unicodes = TiCC::FindNodes( parent, "./*:TextEquiv/*:Unicode" );
+		       const string& fileName,
+		       const string& processor_id ){
+  list<xmlNode*> unicodes = child_nodes( parent, "TextEquiv/Unicode" );
   if ( unicodes.empty() ){
 #pragma omp critical
     {
@@ -241,7 +247,7 @@ void handle_uni_lines( folia::FoliaElement *root,
     UnicodeString uval = extract_final_hyphen( value, hyph );
     string id = "str_1";
     int pos = 0;
-    appendStr( root, pos, uval, hyph, id, fileName );
+    appendStr( root, pos, uval, hyph, id, fileName, processor_id );
     add_text( root, uval, hyph );
   }
 }
@@ -251,11 +257,12 @@ UnicodeString handle_one_line( folia::FoliaElement *par,
 			       xmlNode *line,
 			       UnicodeString& final_hyph,
 			       const string& fileName,
+			       const string& processor_id,
                                string& id //output variable
                              ){
   UnicodeString result;
   string lid = TiCC::getAttribute( line, "id" );
-  list<xmlNode*> words = TiCC::FindNodes( line, "./*:Word" );
+  list<xmlNode*> words = child_nodes( line, "Word" );
   if ( !words.empty() ){
     // We have Words!.
     if ( trust_tokenization ){
@@ -273,7 +280,8 @@ UnicodeString handle_one_line( folia::FoliaElement *par,
 	= new folia::TextContent( args, sent->doc() );
       for ( const auto& w : words ){
 	bool last = (&w == &words.back());
-	final_hyph = handle_one_word( sent, s_txt, w, last, fileName );
+	final_hyph = handle_one_word( sent, s_txt, w, last, fileName,
+				       processor_id );
       }
       sent->append( s_txt );
       return "";
@@ -281,7 +289,7 @@ UnicodeString handle_one_line( folia::FoliaElement *par,
     else {
       // we add the text as strings, enabling external tokenizations
       auto& w = words.front();
-      list<xmlNode*> unicodes = TiCC::FindNodes( w, "./*:TextEquiv/*:Unicode" );
+      list<xmlNode*> unicodes = child_nodes( w, "TextEquiv/Unicode" );
       if ( unicodes.empty() ){
 #pragma omp critical
 	{
@@ -301,14 +309,15 @@ UnicodeString handle_one_line( folia::FoliaElement *par,
       result = UnicodeValue( it );
       result = extract_final_hyphen( result, final_hyph );
       string word_id = TiCC::getAttribute( w, "id" );
-      appendStr( par, pos, result, final_hyph, word_id, fileName );
+      appendStr( par, pos, result, final_hyph, word_id, fileName,
+		 processor_id );
       pos += result.length();
       id = par->id() + "."  + word_id;
     }
   }
   else {
     // lines without words.
-    list<xmlNode*> unicodes = TiCC::FindNodes( line, "./*:TextEquiv/*:Unicode" );
+    list<xmlNode*> unicodes = child_nodes( line, "TextEquiv/Unicode" );
     if ( unicodes.empty() ){
 #pragma omp critical
       {
@@ -323,7 +332,7 @@ UnicodeString handle_one_line( folia::FoliaElement *par,
       UnicodeString hyph;
       result = extract_final_hyphen( result, hyph );
       if ( !result.isEmpty() ){
-	appendStr( par, pos, result, hyph, lid, fileName );
+	appendStr( par, pos, result, hyph, lid, fileName, processor_id );
 	pos += result.length();
         id = par->id() + "."  + lid;
 	break; // We take the first non-empty Unicode string
@@ -335,7 +344,8 @@ UnicodeString handle_one_line( folia::FoliaElement *par,
 
 void handle_one_region( folia::FoliaElement *root,
 			xmlNode *region,
-			const string& fileName ){
+			const string& fileName,
+			const string& processor_id ){
   string ind = TiCC::getAttribute( region, "id" );
   string type = TiCC::getAttribute( region, "type" );
   folia::KWargs p_args;
@@ -349,13 +359,16 @@ void handle_one_region( folia::FoliaElement *root,
   if ( type.empty() || type == "paragraph" ){
   }
   else if ( type == "page-number" ){
-    xmlNode* uni_node = TiCC::xPath( region, "*:TextEquiv/*:Unicode" );
+    xmlNode* uni_node = first_child( region, "TextEquiv/Unicode" );
     if ( uni_node ){
       string value = TiCC::TextValue( uni_node );
       folia::KWargs args;
       args["pagenr"] = value;
       par->add_child<folia::Linebreak>( args );
-      root->doc()->set_metadata( "page-number", value );
+      if ( !book_mode ){
+	// in a book, the Linebreak is all we have per page
+	root->doc()->set_metadata( "page-number", value );
+      }
       return;
     }
     else {
@@ -376,7 +389,7 @@ void handle_one_region( folia::FoliaElement *root,
     cerr << "ignore not implemented region TYPE: " << type << endl;
     return;
   }
-  list<xmlNode*> lines = TiCC::FindNodes( region, "./*:TextLine" );
+  list<xmlNode*> lines = child_nodes( region, "TextLine" );
   if ( !lines.empty() ){
     folia::KWargs text_args;
     text_args["class"] = classname;
@@ -393,6 +406,7 @@ void handle_one_region( folia::FoliaElement *root,
 						line,
 						final_hyph,
 						fileName,
+						processor_id,
 						id );
       if ( line_txt.isEmpty() ){
 	++i;
@@ -455,7 +469,7 @@ void handle_one_region( folia::FoliaElement *root,
   }
   else {
     // No TextLine's use unicode nodes directly
-    handle_uni_lines( par, region, fileName );
+    handle_uni_lines( par, region, fileName, processor_id );
   }
 }
 
@@ -473,8 +487,8 @@ list<xmlNode*> sort_regions( const list<xmlNode*>& all_regions,
       sn[id] = r;
     }
     map<string,xmlNode*> region_refs;
-    list<xmlNode*> order = TiCC::FindNodes( my_order.front(),
-					    ".//*:RegionRefIndexed" );
+    list<xmlNode*> order = find_nodes( my_order.front(),
+				       ".//*:RegionRefIndexed" );
     vector<string> id_order( order.size() );
     set<string> in_order;
     for ( const auto& ord : order ){
@@ -508,20 +522,32 @@ list<xmlNode*> sort_regions( const list<xmlNode*>& all_regions,
   }
 }
 
-bool convert_pagexml( const string& fileName,
-		      const string& outputDir,
-		      const zipType outputType,
-		      const string& prefix,
-		      const string& command ){
+struct page_data {
+  /// a parsed PAGE-XML file, with its TextRegions in reading order
+  page_data(): xdoc(0), inputType(UNKNOWN), ok(false) {};
+  ~page_data(){ if ( xdoc ) xmlFreeDoc( xdoc ); };
+  page_data( const page_data& ) = delete;
+  page_data& operator=( const page_data& ) = delete;
+  string fileName;
+  string orgFile;
+  xmlDoc *xdoc;
+  zipType inputType;
+  list<xmlNode*> regions;
+  bool ok;
+};
+
+bool read_page( const string& fileName, page_data& page ){
+  /// parse fileName and collect its TextRegions in reading order
+  /// \return true on succes. Otherwise the errors are reported already
   if ( verbose ){
 #pragma omp critical
     {
       cout << "start handling " << fileName << endl;
     }
   }
-  zipType inputType;
-  xmlDoc *xdoc = getXml( fileName, inputType );
-  if ( !xdoc ){
+  page.fileName = fileName;
+  page.xdoc = getXml( fileName, page.inputType );
+  if ( !page.xdoc ){
 #pragma omp critical
     {
       cerr << "problem detecting type of file: " << fileName << endl;
@@ -529,9 +555,9 @@ bool convert_pagexml( const string& fileName,
     }
     return false;
   }
-  xmlNode *root = xmlDocGetRootElement( xdoc );
-  string orgFile = getOrg( root );
-  if ( orgFile.empty() ) {
+  xmlNode *root = xmlDocGetRootElement( page.xdoc );
+  page.orgFile = getOrg( root );
+  if ( page.orgFile.empty() ) {
 #pragma omp critical
     {
       cerr << "unable to retrieve an original filename from " << fileName << endl;
@@ -541,48 +567,40 @@ bool convert_pagexml( const string& fileName,
   if ( verbose ){
 #pragma omp critical
     {
-      cout << "original file: " << orgFile << endl;
+      cout << "original file: " << page.orgFile << endl;
     }
   }
-  list<xmlNode*> all_regions =  TiCC::FindNodes( root, ".//*:TextRegion" );
-  list<xmlNode*> order = TiCC::FindNodes( root, ".//*:ReadingOrder" );
+  list<xmlNode*> all_regions =  find_nodes( root, ".//*:TextRegion" );
+  list<xmlNode*> order = find_nodes( root, ".//*:ReadingOrder" );
   if ( order.size() > 1 ){
 #pragma omp critical
     {
       cerr << "Found more then 1 ReadingOrder node in " << fileName << endl;
       cerr << "This is not supported." << endl;
     }
-    xmlFreeDoc( xdoc );
     return false;
   }
-  list<xmlNode*> ordered_regions = sort_regions( all_regions, order );
-  if ( ordered_regions.empty() ){
+  page.regions = sort_regions( all_regions, order );
+  if ( page.regions.empty() ){
 #pragma omp critical
     {
       cerr << "no usable data in file:" << fileName << endl;
     }
-    xmlFreeDoc( xdoc );
     return false;
   }
-  string docid = orgFile.substr( 0, orgFile.find(".") );
-  docid = prefix + docid;
-  folia::Document doc( "xml:id='" + docid + "'" );
-  doc.set_metadata( "page_file", stripDir( fileName ) );
-  folia::processor *proc = add_provenance( doc, processor_label, command );
-  processor_id = proc->id();
-  folia::KWargs args;
-  args["xml:id"] =  docid + ".text";
-  folia::Text *text = doc.create_root<folia::Text>( args );
-  for ( const auto& no : ordered_regions ){
-    handle_one_region( text, no, fileName );
-  }
-  xmlFreeDoc( xdoc );
+  page.ok = true;
+  return true;
+}
 
+string output_name( const string& outputDir,
+		    const string& name,
+		    zipType inputType,
+		    zipType outputType ){
   string outName;
   if ( !outputDir.empty() ){
     outName = outputDir;
   }
-  outName += prefix + orgFile + ".folia.xml";
+  outName += name + ".folia.xml";
   zipType type = inputType;
   if ( outputType != NORMAL ){
     type = outputType;
@@ -593,6 +611,12 @@ bool convert_pagexml( const string& fileName,
   else if ( type == GZ ){
     outName += ".gz";
   }
+  return outName;
+}
+
+bool save_result( folia::Document& doc,
+		  const string& what,
+		  const string& outName ){
   vector<folia::Paragraph*> pv = doc.paragraphs();
   if ( pv.size() == 0 ||
        ( pv.size() == 1 && pv[0]->size() == 0 ) ){
@@ -607,12 +631,293 @@ bool convert_pagexml( const string& fileName,
     doc.save( outName );
 #pragma omp critical
     {
-      cout << "converted: " << fileName << " into: "  << outName << endl;
+      cout << "converted: " << what << " into: "  << outName << endl;
     }
   }
   return true;
 }
 
+bool convert_pagexml( const string& fileName,
+		      const string& outputDir,
+		      const zipType outputType,
+		      const string& prefix,
+		      const string& command ){
+  page_data page;
+  if ( !read_page( fileName, page ) ){
+    return false;
+  }
+  string docid = page.orgFile.substr( 0, page.orgFile.find(".") );
+  docid = prefix + docid;
+  folia::Document doc( "xml:id='" + docid + "'" );
+  doc.set_metadata( "page_file", stripDir( fileName ) );
+  folia::processor *proc = add_provenance( doc, processor_label, command );
+  string processor_id = proc->id();
+  folia::KWargs args;
+  args["xml:id"] =  docid + ".text";
+  folia::Text *text = doc.create_root<folia::Text>( args );
+  for ( const auto& no : page.regions ){
+    handle_one_region( text, no, fileName, processor_id );
+  }
+  string outName = output_name( outputDir, prefix + page.orgFile,
+				page.inputType, outputType );
+  return save_result( doc, fileName, outName );
+}
+
+bool page_order( const string& s1, const string& s2 ){
+  /// compare file names, with digit sequences compared by their value.
+  /// So page_9.xml sorts before page_10.xml
+  size_t i = 0;
+  size_t j = 0;
+  while ( i < s1.size() && j < s2.size() ){
+    if ( isdigit(s1[i]) && isdigit(s2[j]) ){
+      size_t i_end = i;
+      while ( i_end < s1.size() && isdigit(s1[i_end]) ){
+	++i_end;
+      }
+      size_t j_end = j;
+      while ( j_end < s2.size() && isdigit(s2[j_end]) ){
+	++j_end;
+      }
+      string n1 = s1.substr( i, i_end-i );
+      string n2 = s2.substr( j, j_end-j );
+      n1.erase( 0, min( n1.find_first_not_of('0'), n1.size()-1 ) );
+      n2.erase( 0, min( n2.find_first_not_of('0'), n2.size()-1 ) );
+      if ( n1.size() != n2.size() ){
+	return n1.size() < n2.size();
+      }
+      if ( n1 != n2 ){
+	return n1 < n2;
+      }
+      i = i_end;
+      j = j_end;
+    }
+    else {
+      if ( s1[i] != s2[j] ){
+	return s1[i] < s2[j];
+      }
+      ++i;
+      ++j;
+    }
+  }
+  if ( s1.size() - i != s2.size() - j ){
+    return s1.size() - i < s2.size() - j;
+  }
+  return s1 < s2;
+}
+
+bool convert_book( const string& book_id,
+		   const vector<string>& pages,
+		   const string& outputDir,
+		   const zipType outputType,
+		   const string& prefix,
+		   const string& command ){
+  /// convert all pages of a book into one FoLiA document, with a Division
+  /// per page, in the order of pages.
+  /// The pages are parsed in parallel, a batch at a time, and added to the
+  /// document in order.
+  if ( verbose ){
+#pragma omp critical
+    {
+      cout << "start handling book " << book_id << " ("
+	   << pages.size() << " pages)" << endl;
+    }
+  }
+  string docid = prefix + book_id;
+  folia::Document doc( "xml:id='" + docid + "'" );
+  folia::processor *proc = add_provenance( doc, processor_label, command );
+  string processor_id = proc->id();
+  folia::KWargs args;
+  args["xml:id"] =  docid + ".text";
+  folia::Text *text = doc.create_root<folia::Text>( args );
+  args.clear();
+  args["processor"] = processor_id;
+  doc.declare( folia::AnnotationType::DIVISION, setname, args );
+  args.clear();
+  args["class"] = "page";
+  size_t batch = 2;
+#ifdef HAVE_OPENMP
+  batch = 2 * omp_get_max_threads();
+#endif
+  zipType inputType = UNKNOWN;
+  size_t failures = 0;
+  for ( size_t start=0; start < pages.size(); start += batch ){
+    size_t end = min( start + batch, pages.size() );
+    vector<page_data> parsed( end - start );
+    for ( size_t i=start; i < end; ++i ){
+#pragma omp task shared(parsed,pages) firstprivate(i)
+      read_page( pages[i], parsed[i-start] );
+    }
+#pragma omp taskwait
+    for ( auto& page : parsed ){
+      if ( !page.ok ){
+	++failures;
+	continue;
+      }
+      if ( inputType == UNKNOWN ){
+	inputType = page.inputType;
+      }
+      args["generate_id"] = text->id();
+      folia::Division *div = text->add_child<folia::Division>( args );
+      for ( const auto& no : page.regions ){
+	handle_one_region( div, no, page.fileName, processor_id );
+      }
+      if ( verbose ){
+#pragma omp critical
+	{
+	  cout << "added page: " << page.fileName << " as: " << div->id()
+	       << endl;
+	}
+      }
+    }
+  }
+  if ( failures == pages.size() ){
+    return false;
+  }
+  if ( failures > 0 ){
+#pragma omp critical
+    {
+      cerr << "book " << book_id << ": skipped " << failures
+	   << " unusable pages" << endl;
+    }
+  }
+  string outName = output_name( outputDir, prefix + book_id,
+				inputType, outputType );
+  return save_result( doc, "book " + book_id + " (" + TiCC::toString(pages.size())
+		      + " pages)", outName );
+}
+
+typedef vector<pair<string,vector<string>>> book_list;
+
+string book_name( const string& dir ){
+  /// the name of the directory, also when it is given as '.' or '..'
+  string result;
+  char *real = realpath( dir.c_str(), 0 );
+  if ( real ){
+    result = stripDir( real );
+    free( real );
+  }
+  if ( result.empty() ){
+    // no such directory, or '/'
+    result = stripDir( dir );
+  }
+  return result;
+}
+
+book_list books_by_dir( const vector<string>& fileNames ){
+  /// every directory is a book, named after that directory
+  map<string,size_t> index;
+  book_list result;
+  for ( const auto& file : fileNames ){
+    string dir = ".";
+    string::size_type pos = file.rfind( "/" );
+    if ( pos != string::npos ){
+      dir = file.substr( 0, pos );
+    }
+    auto it = index.find( dir );
+    if ( it == index.end() ){
+      index[dir] = result.size();
+      result.push_back( make_pair( book_name( dir ), vector<string>() ) );
+      result.back().second.push_back( file );
+    }
+    else {
+      result[it->second].second.push_back( file );
+    }
+  }
+  for ( auto& book : result ){
+    sort( book.second.begin(), book.second.end(), page_order );
+  }
+  return result;
+}
+
+book_list books_by_pattern( const vector<string>& fileNames,
+			    const string& pattern ){
+  /// files with the same book id are a book. The id is the part of the
+  /// file name that matches the first group in pattern, or the complete
+  /// match when there is no group.
+  UErrorCode u_stat = U_ZERO_ERROR;
+  RegexMatcher matcher( TiCC::UnicodeFromUTF8(pattern), 0, u_stat );
+  if ( U_FAILURE(u_stat) ){
+    throw runtime_error( "invalid --bookpattern: '" + pattern + "'" );
+  }
+  map<string,size_t> index;
+  book_list result;
+  for ( const auto& file : fileNames ){
+    UnicodeString name = TiCC::UnicodeFromUTF8( stripDir( file ) );
+    matcher.reset( name );
+    if ( !matcher.find() ){
+#pragma omp critical
+      {
+	cerr << "skipping " << file << ", it doesn't match the book pattern"
+	     << endl;
+      }
+      continue;
+    }
+    int group = ( matcher.groupCount() > 0 ? 1 : 0 );
+    string id = TiCC::UnicodeToUTF8( matcher.group( group, u_stat ) );
+    auto it = index.find( id );
+    if ( it == index.end() ){
+      index[id] = result.size();
+      result.push_back( make_pair( id, vector<string>() ) );
+      result.back().second.push_back( file );
+    }
+    else {
+      result[it->second].second.push_back( file );
+    }
+  }
+  for ( auto& book : result ){
+    sort( book.second.begin(), book.second.end(), page_order );
+  }
+  return result;
+}
+
+book_list books_from_manifest( const string& manifest ){
+  /// a manifest has one line per page: the book id, a TAB and the PAGE file.
+  /// Pages are taken in the order of the manifest. Relative file names are
+  /// relative to the directory of the manifest.
+  ifstream is( manifest );
+  if ( !is ){
+    throw runtime_error( "unable to open manifest: '" + manifest + "'" );
+  }
+  string dir;
+  string::size_type pos = manifest.rfind( "/" );
+  if ( pos != string::npos ){
+    dir = manifest.substr( 0, pos+1 );
+  }
+  map<string,size_t> index;
+  book_list result;
+  string line;
+  size_t line_nr = 0;
+  while ( getline( is, line ) ){
+    ++line_nr;
+    line = TiCC::trim( line );
+    if ( line.empty() || line[0] == '#' ){
+      continue;
+    }
+    vector<string> parts = TiCC::split_at( line, "\t" );
+    if ( parts.size() != 2
+	 || TiCC::trim( parts[0] ).empty()
+	 || TiCC::trim( parts[1] ).empty() ){
+      throw runtime_error( "invalid line " + TiCC::toString(line_nr)
+			   + " in manifest: '" + line + "'" );
+    }
+    string id = TiCC::trim( parts[0] );
+    string file = TiCC::trim( parts[1] );
+    if ( file[0] != '/' ){
+      file = dir + file;
+    }
+    auto it = index.find( id );
+    if ( it == index.end() ){
+      index[id] = result.size();
+      result.push_back( make_pair( id, vector<string>() ) );
+      result.back().second.push_back( file );
+    }
+    else {
+      result[it->second].second.push_back( file );
+    }
+  }
+  return result;
+}
+
 void usage(){
   cerr << "Usage: FoLiA-page [options] file/dir" << endl;
   cerr << "\t-t <threads>\n\t--threads <threads> Number of threads to run on." << endl;
@@ -630,6 +935,12 @@ void usage(){
   cerr << "\t--nostrings\t do not add string annotations (no str), implies --norefs" << endl;
   cerr << "\t--nomarkup\t do not add any markup to the text (no t-str)" << endl;
   cerr << "\t--trusttokens\t when the Page-file contains Word items, translate them to FoLiA Word and Sentence elements" << endl;
+  cerr << "\t--book\t\t convert all pages in a directory into one FoLiA document," << endl;
+  cerr << "\t\t\t with a Division per page, in file name order." << endl;
+  cerr << "\t--bookpattern='re' like --book, but group the pages by the part of the" << endl;
+  cerr << "\t\t\t file name that matches the first group in 're'." << endl;
+  cerr << "\t--manifest='file' like --book, but take the books and their pages from" << endl;
+  cerr << "\t\t\t 'file'. Every line has a book id, a TAB and a PAGE file." << endl;
   cerr << "\t--compress='c'\t with 'c'=b create bzip2 files (.bz2) " << endl;
   cerr << "\t\t\t with 'c'=g create gzip files (.gz)" << endl;
   cerr << "\t-v\t\t verbose output " << endl;
@@ -639,7 +950,8 @@ void usage(){
 int main( int argc, char *argv[] ){
   TiCC::CL_Options opts( "CSvVt:O:h",
 			 "compress:,class:,setname:,help,version,prefix:,"
-			 "norefs,threads:,trusttokens,sent,nostrings,nomarkup" );
+			 "norefs,threads:,trusttokens,sent,nostrings,nomarkup,"
+			 "book,bookpattern:,manifest:" );
   try {
     opts.init( argc, argv );
   }
@@ -698,6 +1010,19 @@ int main( int argc, char *argv[] ){
     exit( EXIT_FAILURE );
   }
   trust_tokenization = opts.extract( "trusttokens" );
+  string book_pattern;
+  string manifest;
+  book_mode = opts.extract( "book" );
+  if ( opts.extract( "bookpattern", book_pattern ) ){
+    book_mode = true;
+  }
+  if ( opts.extract( "manifest", manifest ) ){
+    if ( !book_pattern.empty() ){
+      cerr << "--manifest and --bookpattern can't be combined" << endl;
+      exit( EXIT_FAILURE );
+    }
+    book_mode = true;
+  }
   opts.extract( 'O', outputDir );
   if ( opts.extract( "setname", value )
        || opts.extract( 'S', value ) ){
@@ -713,7 +1038,7 @@ int main( int argc, char *argv[] ){
     prefix.clear();
   }
   vector<string> fileNames = opts.getMassOpts();
-  if ( fileNames.empty() ){
+  if ( fileNames.empty() && manifest.empty() ){
     cerr << "missing input file(s)" << endl;
     exit(EXIT_FAILURE);
   }
@@ -733,6 +1058,57 @@ int main( int argc, char *argv[] ){
       }
     }
   }
+#ifdef HAVE_OPENMP
+  if ( numThreads >= 1 ){
+    omp_set_num_threads( numThreads );
+  }
+#endif
+  if ( book_mode ){
+    book_list books;
+    try {
+      if ( !manifest.empty() ){
+	books = books_from_manifest( manifest );
+      }
+      else {
+	string name = fileNames[0];
+	if ( TiCC::isDir(name) ){
+	  fileNames = TiCC::searchFilesMatch( name, ".xml", true );
+	}
+	if ( book_pattern.empty() ){
+	  books = books_by_dir( fileNames );
+	}
+	else {
+	  books = books_by_pattern( fileNames, book_pattern );
+	}
+      }
+    }
+    catch ( const exception& e ){
+      cerr << e.what() << endl;
+      exit( EXIT_FAILURE );
+    }
+    if ( books.empty() ){
+      cerr << "no matching files found." << endl;
+      exit(EXIT_FAILURE);
+    }
+    if ( books.size() > 1 ){
+      cout << "start processing of " << books.size() << " books " << endl;
+    }
+#pragma omp parallel for shared(books) schedule(dynamic)
+    for ( size_t bn=0; bn < books.size(); ++bn ){
+      if ( !convert_book( books[bn].first,
+			  books[bn].second,
+			  outputDir,
+			  outputType,
+			  prefix,
+			  command ) )
+#pragma omp critical
+	{
+	  cerr << "failure on book " << books[bn].first << endl;
+	}
+    }
+    cout << "done" << endl;
+    exit(EXIT_SUCCESS);
+  }
   string name = fileNames[0];
   if ( !( TiCC::isFile(name) || TiCC::isDir(name) ) ){
     cerr << "parameter '" << name << "' doesn't seem to be a file or directory"
@@ -751,12 +1127,6 @@ int main( int argc, char *argv[] ){
     cout << "start processing of " << toDo << " files " << endl;
   }
 
-#ifdef HAVE_OPENMP
-  if ( numThreads >= 1 ){
-    omp_set_num_threads( numThreads );
-  }
-#endif
-
 #pragma omp parallel for shared(fileNames)
   for ( size_t fn=0; fn < fileNames.size(); ++fn ){
     if ( !convert_pagexml( fileNames[fn],
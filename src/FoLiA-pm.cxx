@@ -1059,36 +1059,12 @@ folia::Document *create_basedoc( const string& docid,
   return doc;
 }
 
-void process_topic( const string& outDir,
-		    const string& prefix,
-		    const string& command,
-		    Text* base_text,
-		    xmlNode *topic,
-		    bool no_split ){
-  string id = TiCC::getAttribute( topic, "id" );
-  if ( verbose ){
-#pragma omp critical
-    {
-      cerr << "process_topic: id=" << id << endl;
-    }
-  }
+void fill_topic( FoliaElement *root,
+		 xmlNode *topic,
+		 const string& id ){
+  /// add a topic Division for the topic node to root
+  Document *doc = root->doc();
   KWargs args;
-  Document *doc = 0;
-  FoliaElement *root;
-  if ( no_split ){
-    doc = base_text->doc();
-    args["generate_id"] = base_text->id();
-    args["class"] = "proceedings";
-    args["processor"] = processor_id;
-    root = base_text->add_child<Division>( args );
-  }
-  else {
-    id = prefix + id;
-    doc = create_basedoc( id, command );
-    args["xml:id"] = id + ".text";
-    root = doc->create_root<Text>( args );
-  }
-  args.clear();
   args["xml:id"] = id + ".div";
   args["class"] = "topic";
   args["processor"] = processor_id;
@@ -1123,21 +1099,60 @@ void process_topic( const string& outDir,
     }
     p = p->next;
   }
-  if ( !no_split ){
+}
+
+void process_topic( Text* base_text,
+		    xmlNode *topic ){
+  /// add topic to the document of base_text
+  string id = TiCC::getAttribute( topic, "id" );
+  if ( verbose ){
+#pragma omp critical
+    {
+      cerr << "process_topic: id=" << id << endl;
+    }
+  }
+  KWargs args;
+  args["generate_id"] = base_text->id();
+  args["class"] = "proceedings";
+  args["processor"] = processor_id;
+  FoliaElement *root = base_text->add_child<Division>( args );
+  fill_topic( root, topic, id );
+}
+
+string convert_topic( const string& outDir,
+		      const string& prefix,
+		      const string& command,
+		      xmlNode *topic ){
+  /// convert topic into a document of its own, and save it.
+  /// Only reads the input tree, so topics can be converted in parallel
+  /// \return the id of the new document
+  string id = TiCC::getAttribute( topic, "id" );
+  if ( verbose ){
+#pragma omp critical
+    {
+      cerr << "process_topic: id=" << id << endl;
+    }
+  }
+  id = prefix + id;
+  Document *doc = create_basedoc( id, command );
+  try {
+    KWargs args;
+    args["xml:id"] = id + ".text";
+    Text *root = doc->create_root<Text>( args );
+    fill_topic( root, topic, id );
     string filename = outDir+id+".folia.xml";
     doc->save( filename );
-    delete doc;
 #pragma omp critical
     {
       cout << "saved external file: " << filename << endl;
     }
-
-    args.clear();
-    args["xml:id"] = id;
-    args["src"] = id + ".folia.xml";
-    External *ext = new External( args );
-    base_text->append( ext );
   }
+  catch ( ... ){
+    delete doc;
+    throw;
+  }
+  delete doc;
+  return id;
 }
 
 void process_proceeding( const string& outDir,
@@ -1153,9 +1168,39 @@ void process_proceeding( const string& outDir,
       cerr << "process_proceeding: id=" << id << endl;
     }
   }
-  list<xmlNode*> topics = TiCC::FindNodes( proceed, "*:topic" );
-  for ( const auto& topic : topics ){
-    process_topic( outDir, prefix, command, root, topic, no_split );
+  list<xmlNode*> topic_list = TiCC::FindNodes( proceed, "*:topic" );
+  if ( no_split ){
+    for ( const auto& topic : topic_list ){
+      process_topic( root, topic );
+    }
+    return;
+  }
+  // every topic becomes a document of its own. Convert them in parallel,
+  // and refer to them from the base document in the original order
+  vector<xmlNode*> topics( topic_list.begin(), topic_list.end() );
+  vector<string> ids( topics.size() );
+  vector<string> errors( topics.size() );
+  for ( size_t i=0; i < topics.size(); ++i ){
+#pragma omp task shared(topics,ids,errors,outDir,prefix,command) firstprivate(i)
+    {
+      try {
+	ids[i] = convert_topic( outDir, prefix, command, topics[i] );
+      }
+      catch ( const exception& e ){
+	errors[i] = e.what();
+      }
+    }
+  }
+#pragma omp taskwait
+  for ( size_t i=0; i < topics.size(); ++i ){
+    if ( !errors[i].empty() ){
+      throw runtime_error( errors[i] );
+    }
+    KWargs args;
+    args["xml:id"] = ids[i];
+    args["src"] = ids[i] + ".folia.xml";
+    External *ext = new External( args );
+    root->append( ext );
   }
 }
 
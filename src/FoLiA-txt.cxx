@@ -25,9 +25,19 @@
 */
 
 #include <cassert>
+#include <cstdint>
+#include <cstring>
 #include <string>
+#include <string_view>
 #include <iostream>
 #include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "ticcutils/CommandLine.h"
 #include "ticcutils/StringOps.h"
@@ -52,6 +62,8 @@ string command;
 string outputDir;
 size_t to_do;
 size_t failed_docs = 0;
+size_t chunk_size = 0;
+size_t max_pending_chunks = 2;
 
 void usage(){
   cerr << "Usage: [options] file/dir" << endl;
@@ -66,6 +78,10 @@ void usage(){
   cerr << "\t--remove-end-hyphens:yes|no (default = 'yes') " << endl;
   cerr << "\t\t\t if 'yes', hyphens (-) att the end of lines are converted to"
     " <t-hbr> nodes.\n\t\t\t And ignored in general." << endl;
+  cerr << "\t--chunk-size=N\t split the output into several documents, each with" << endl;
+  cerr << "\t\t\t about N million characters of text. The documents are" << endl;
+  cerr << "\t\t\t split between paragraphs, and saved while the input is read." << endl;
+  cerr << "\t\t\t (default 0, one document per input file)" << endl;
   cerr << "\t--setname The FoLiA setname of the created nodes. "
     "(Default '" << setname << "')" << endl;
   cerr << "\t--class The classname of the <t> nodes that are created. (Default '"
@@ -88,157 +104,491 @@ void add_paragraph( folia::FoliaElement *par,
   }
 }
 
-bool handle_one_file( const string& fileName ){
-  ifstream is( fileName );
-  if ( !is ){
-#pragma omp critical
-    {
-      cerr << "failed to read " << fileName << endl;
-    }
+folia::Text *create_document( const string& docid, string& processor_id ){
+  /// create a new Document with the declarations we need
+  /// \param docid the id of the new Document
+  /// \param processor_id returns the id of the provenance processor
+  /// \return the Text root. It throws when docid is invalid
+  Document *d = new Document( "xml:id='"+ docid + "'" );
+  processor *proc = add_provenance( *d, "FoLiA-txt", command );
+  processor_id = proc->id();
+  KWargs p_args;
+  p_args["processor"] = processor_id;
+  d->declare( folia::AnnotationType::STRING, setname, p_args );
+  d->declare( folia::AnnotationType::PARAGRAPH, setname, p_args );
+  d->declare( folia::AnnotationType::LINEBREAK, setname, p_args );
+  p_args.clear();
+  p_args["xml:id"] = docid + ".text";
+  return d->create_root<folia::Text>( p_args );
+}
+
+class mapped_text {
+  /// a read-only view on a text file, mapped into memory
+public:
+  mapped_text(): _map(0), _size(0) {};
+  ~mapped_text();
+  mapped_text( const mapped_text& ) = delete;
+  mapped_text& operator=( const mapped_text& ) = delete;
+  bool open( const string& );
+  string_view text() const {
+    return string_view( static_cast<const char*>(_map), _size );
+  };
+private:
+  void *_map;
+  size_t _size;
+};
+
+mapped_text::~mapped_text(){
+  if ( _map ){
+    munmap( _map, _size );
+  }
+}
+
+bool mapped_text::open( const string& file_name ){
+  /// map file_name into memory
+  /// \return false when the file can't be mapped, (e.g. it is a pipe)
+  /// an empty file gives an empty text
+  struct stat st;
+  if ( stat( file_name.c_str(), &st ) != 0
+       || !S_ISREG( st.st_mode ) ){
+    // don't open it: a named pipe loses its data when we close it again
     return false;
   }
-#pragma omp critical
-  {
-    cout << "Starting " << fileName << endl;
+  int fd = ::open( file_name.c_str(), O_RDONLY );
+  if ( fd < 0 ){
+    return false;
   }
-  string nameNoExt = fileName;
-  string::size_type pos = fileName.rfind( "." );
-  if ( pos != string::npos ){
-    nameNoExt = fileName.substr(0, pos );
+  if ( fstat( fd, &st ) != 0
+       || !S_ISREG( st.st_mode ) ){
+    ::close( fd );
+    return false;
+  }
+  if ( st.st_size == 0 ){
+    ::close( fd );
+    return true;
+  }
+  void *map = mmap( 0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+  ::close( fd );
+  if ( map == MAP_FAILED ){
+    return false;
+  }
+  madvise( map, st.st_size, MADV_SEQUENTIAL );
+  _map = map;
+  _size = st.st_size;
+  return true;
+}
+
+inline bool is_ascii_blank( char c ){
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+size_t find_special( const char *p, size_t len ){
+  /// find the first byte in p that is not printable ASCII, a space, a TAB or
+  /// a CR. Those lines need the full Unicode treatment.
+  /// \return the position of that byte, or len when there is none
+  size_t i = 0;
+#ifdef __SSE2__
+  const __m128i low = _mm_set1_epi8( 0x20 );
+  const __m128i del = _mm_set1_epi8( 0x7F );
+  const __m128i tab = _mm_set1_epi8( '\t' );
+  const __m128i cr = _mm_set1_epi8( '\r' );
+  for ( ; i + 16 <= len; i += 16 ){
+    __m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i*>(p+i) );
+    // bytes >= 0x80 are negative as signed chars, so they compare as 'low'
+    __m128i bad = _mm_or_si128( _mm_cmpgt_epi8( low, v ),
+				_mm_cmpeq_epi8( v, del ) );
+    __m128i ok = _mm_or_si128( _mm_cmpeq_epi8( v, tab ),
+			       _mm_cmpeq_epi8( v, cr ) );
+    int mask = _mm_movemask_epi8( _mm_andnot_si128( ok, bad ) );
+    if ( mask != 0 ){
+      return i + __builtin_ctz( mask );
+    }
   }
-  string docid = nameNoExt;
-  pos = docid.rfind( "/" );
+#endif
+  for ( ; i < len; ++i ){
+    unsigned char c = p[i];
+    if ( ( c < 0x20 || c >= 0x7F )
+	 && c != '\t' && c != '\r' ){
+      return i;
+    }
+  }
+  return len;
+}
+
+void split_ascii( string_view line, vector<string_view>& words ){
+  /// split a line of printable ASCII on spaces and TABs (and a CR)
+  /// this gives the same words as trim() and TiCC::split() on that line
+  words.clear();
+  const char *p = line.data();
+  size_t len = line.size();
+  size_t start = string_view::npos;
+  size_t i = 0;
+#ifdef __SSE2__
+  const __m128i space = _mm_set1_epi8( ' ' );
+  const __m128i tab = _mm_set1_epi8( '\t' );
+  const __m128i cr = _mm_set1_epi8( '\r' );
+  for ( ; i + 16 <= len; i += 16 ){
+    __m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i*>(p+i) );
+    __m128i blank = _mm_or_si128( _mm_cmpeq_epi8( v, space ),
+				  _mm_or_si128( _mm_cmpeq_epi8( v, tab ),
+						_mm_cmpeq_epi8( v, cr ) ) );
+    unsigned int mask = _mm_movemask_epi8( blank );
+    // every change between blank and non-blank is a word boundary
+    unsigned int prev = ( start == string_view::npos ) ? 1 : 0;
+    unsigned int edges = ( mask ^ ( (mask << 1) | prev ) ) & 0xFFFF;
+    while ( edges != 0 ){
+      size_t pos = i + __builtin_ctz( edges );
+      if ( start == string_view::npos ){
+	start = pos;
+      }
+      else {
+	words.push_back( line.substr( start, pos - start ) );
+	start = string_view::npos;
+      }
+      edges &= edges - 1;
+    }
+  }
+#endif
+  for ( ; i < len; ++i ){
+    if ( is_ascii_blank( p[i] ) ){
+      if ( start != string_view::npos ){
+	words.push_back( line.substr( start, i - start ) );
+	start = string_view::npos;
+      }
+    }
+    else if ( start == string_view::npos ){
+      start = i;
+    }
+  }
+  if ( start != string_view::npos ){
+    words.push_back( line.substr( start ) );
+  }
+}
+
+class txt_converter {
+  /// converts the lines of one text file into one or more FoLiA documents
+public:
+  txt_converter( const string&, const string& );
+  ~txt_converter();
+  bool init();
+  void add_line( string_view );
+  void add_line( UnicodeString& );
+  bool finish();
+private:
+  void end_paragraph();
+  void add_word( const UnicodeString&, bool );
+  void next_chunk();
+  string _file_name;
+  string _name_no_ext;
+  string _docid;
+  string _chunk_id;
+  string _chunk_name;
+  string _processor_id;
+  folia::Text *_text;
+  folia::FoliaElement *_par;
+  string _par_id;
+  vector<FoliaElement*> _par_stack; // temp store for textfragments which
+  // will make up the paragraph text. may include formatting like <t-hbr/>
+  vector<string_view> _words;
+  size_t _chunk_nr;
+  size_t _chunk_chars;
+  size_t _saved;
+  int _par_count;
+  int _chunk_par_count;
+  int _wrd_cnt;
+};
+
+txt_converter::txt_converter( const string& file_name,
+			      const string& name_no_ext ):
+  _file_name( file_name ),
+  _name_no_ext( name_no_ext ),
+  _text(0),
+  _par(0),
+  _chunk_nr(0),
+  _chunk_chars(0),
+  _saved(0),
+  _par_count(0),
+  _chunk_par_count(0),
+  _wrd_cnt(0)
+{
+  _docid = _name_no_ext;
+  string::size_type pos = _docid.rfind( "/" );
   if ( pos != string::npos ){
-    docid = docid.substr( pos+1 );
+    _docid = _docid.substr( pos+1 );
   }
   if ( !outputDir.empty() ){
-    nameNoExt = docid;
+    _name_no_ext = _docid;
+  }
+  // in chunked mode, every chunk becomes a document of its own.
+  // Those are named after the chunk number
+  _chunk_id = _docid;
+  _chunk_name = _name_no_ext;
+  if ( chunk_size > 0 ){
+    _chunk_id += ".part1";
+    _chunk_name += ".part1";
   }
-  Document *d = 0;
+}
+
+txt_converter::~txt_converter(){
+  if ( _text ){
+    delete _text->doc();
+  }
+}
+
+bool txt_converter::init(){
   try {
-    docid = create_NCName( docid );
-    d = new Document( "xml:id='"+ docid + "'" );
+    _docid = create_NCName( _docid );
+    _chunk_id = create_NCName( _chunk_id );
+    _text = create_document( _chunk_id, _processor_id );
   }
   catch ( exception& e ){
 #pragma omp critical
     {
-      cerr << "failed to create a document with id:'" << docid << "'" << endl;
+      cerr << "failed to create a document with id:'" << _chunk_id << "'"
+	   << endl;
       cerr << "reason: " << e.what() << endl;
     }
     return false;
   }
-  processor *proc = add_provenance( *d, "FoLiA-txt", command );
-  string processor_id = proc->id();
-  KWargs p_args;
-  p_args["processor"] = processor_id;
-  d->declare( folia::AnnotationType::STRING, setname, p_args );
-  d->declare( folia::AnnotationType::PARAGRAPH, setname, p_args );
-  d->declare( folia::AnnotationType::LINEBREAK, setname, p_args );
-  p_args.clear();
-  p_args["xml:id"] = docid + ".text";
-  folia::Text *text = d->create_root<folia::Text>( p_args );
-  int parCount = 0;
-  int wrdCnt = 0;
-  folia::FoliaElement *par = 0;
-  string parId;
-  vector<FoliaElement*> par_stack; // temp store for textfragments which will
-  // make up the paragraph text. may include formatting like <t-hbr/>
-  UnicodeString line;
-  while ( TiCC::getline( is, line ) ){
-    line.trim();
-    if ( line.length() == 1
-	 && line[line.length()-1] == ZWNJ ){
-      line = pop_back( line );
+  return true;
+}
+
+void txt_converter::next_chunk(){
+  /// this chunk is full. Save it in the background, and start a new one
+  string outname = outputDir + _chunk_name + ".folia.xml";
+  Document *full = _text->doc();
+  _text = 0;
+#pragma omp task firstprivate(full,outname)
+  {
+    full->save( outname );
+    delete full;
+#pragma omp critical
+    {
+      cout << "Saved: " << outname << endl;
     }
-    if ( line.isEmpty() ){
-      // end a paragraph
-      if ( par && !par_stack.empty() ){
-	// do we have some fragments?
-	add_paragraph( par, par_stack );
-	par_stack.clear();
-	par = 0;
-      }
-      continue;
+  }
+  ++_saved;
+  if ( _saved % max_pending_chunks == 0 ){
+    // don't keep too many chunks in memory
+#pragma omp taskwait
+  }
+  ++_chunk_nr;
+  _chunk_id = _docid + ".part" + TiCC::toString( _chunk_nr+1 );
+  _chunk_name = _name_no_ext + ".part" + TiCC::toString( _chunk_nr+1 );
+  _text = create_document( _chunk_id, _processor_id );
+  _chunk_chars = 0;
+  _chunk_par_count = 0;
+}
+
+void txt_converter::end_paragraph(){
+  if ( _par && !_par_stack.empty() ){
+    // do we have some fragments?
+    add_paragraph( _par, _par_stack );
+    _par_stack.clear();
+    _par = 0;
+    if ( chunk_size > 0
+	 && _chunk_chars >= chunk_size ){
+      next_chunk();
     }
-    vector<UnicodeString> words = TiCC::split( line );
-    for ( const auto& w : words ){
-      if ( par == 0 ){
-	// start a new Paragraph, only when at least 1 entry.
-	folia::KWargs par_args;
-	par_args["processor"] = processor_id;
-	parId = docid + ".p." +  TiCC::toString(++parCount);
-	par_args["xml:id"] = parId;
-	par = text->add_child<folia::Paragraph>( par_args );
-	wrdCnt = 0;
-      }
-      UnicodeString str_content = w; // the value to create a String node
-      str_content.trim();
-      if ( !is_norm_empty(str_content) ){
-	UnicodeString par_content = str_content; // the value we will use for
-	// the paragraph text
-	UnicodeString hyph; // hyphen symbol
-	if ( keep_hyphens ){
-	  // only soft hyphens are removed
-	  par_content = extract_soft_hyphen( par_content, hyph );
-	}
-	else {
-	  par_content = extract_final_hyphen( par_content, hyph );
-	}
-	// now we can add the <String>
-	folia::KWargs str_args;
-	str_args["xml:id"] = parId + ".str." +  TiCC::toString(++wrdCnt);
-	folia::FoliaElement *str = par->add_child<folia::String>( str_args );
-	str->setutext( str_content, classname );
-	if ( hyph.isEmpty() && &w != &words.back() ){
-	  par_content += " "; // no hyphen, so add a space separator except
-	  // for last word
-	}
-	XmlText *e = new folia::XmlText(); // create partial text
-	e->setuvalue( par_content );
-	par_stack.push_back( e ); // add the XmlText to te stack
-	if ( !hyph.isEmpty() ){
-	  // add an extra HyphBreak to the stack
-	  FoliaElement *hb = new folia::Hyphbreak();
-	  XmlText *hb_txt = hb->add_child<folia::XmlText>(); // create partial text
-	  hb_txt->setuvalue( hyph );
-	  par_stack.push_back( hb );
-	}
-	else if ( &w == &words.back() ){
-	  folia::KWargs line_args;
-	  par_stack.push_back( new folia::Linebreak(line_args) );
-	}
-      }
+  }
+}
+
+void txt_converter::add_word( const UnicodeString& w, bool last ){
+  if ( _par == 0 ){
+    // start a new Paragraph, only when at least 1 entry.
+    folia::KWargs par_args;
+    par_args["processor"] = _processor_id;
+    _par_id = _chunk_id + ".p." +  TiCC::toString(++_par_count);
+    ++_chunk_par_count;
+    par_args["xml:id"] = _par_id;
+    _par = _text->add_child<folia::Paragraph>( par_args );
+    _wrd_cnt = 0;
+  }
+  UnicodeString str_content = w; // the value to create a String node
+  str_content.trim();
+  if ( !is_norm_empty(str_content) ){
+    UnicodeString par_content = str_content; // the value we will use for
+    // the paragraph text
+    UnicodeString hyph; // hyphen symbol
+    if ( keep_hyphens ){
+      // only soft hyphens are removed
+      par_content = extract_soft_hyphen( par_content, hyph );
+    }
+    else {
+      par_content = extract_final_hyphen( par_content, hyph );
+    }
+    // now we can add the <String>
+    folia::KWargs str_args;
+    str_args["xml:id"] = _par_id + ".str." +  TiCC::toString(++_wrd_cnt);
+    folia::FoliaElement *str = _par->add_child<folia::String>( str_args );
+    str->setutext( str_content, classname );
+    if ( hyph.isEmpty() && !last ){
+      par_content += " "; // no hyphen, so add a space separator except
+      // for last word
+    }
+    XmlText *e = new folia::XmlText(); // create partial text
+    e->setuvalue( par_content );
+    _par_stack.push_back( e ); // add the XmlText to te stack
+    if ( !hyph.isEmpty() ){
+      // add an extra HyphBreak to the stack
+      FoliaElement *hb = new folia::Hyphbreak();
+      XmlText *hb_txt = hb->add_child<folia::XmlText>(); // create partial text
+      hb_txt->setuvalue( hyph );
+      _par_stack.push_back( hb );
     }
+    else if ( last ){
+      folia::KWargs line_args;
+      _par_stack.push_back( new folia::Linebreak(line_args) );
+    }
+  }
+}
+
+void txt_converter::add_line( UnicodeString& line ){
+  /// handle one line of text, in full Unicode
+  line.trim();
+  if ( line.length() == 1
+       && line[line.length()-1] == ZWNJ ){
+    line = pop_back( line );
+  }
+  if ( line.isEmpty() ){
+    // end a paragraph
+    end_paragraph();
+    return;
+  }
+  _chunk_chars += line.length();
+  vector<UnicodeString> words = TiCC::split( line );
+  for ( const auto& w : words ){
+    add_word( w, &w == &words.back() );
+  }
+}
+
+void txt_converter::add_line( string_view line ){
+  /// handle one UTF-8 line of text from the mapped file.
+  /// Lines with only printable ASCII are split here, without converting the
+  /// whole line to UTF-16 first. All other lines take the Unicode route.
+  if ( find_special( line.data(), line.size() ) != line.size() ){
+    UnicodeString u_line = TiCC::UnicodeFromUTF8( string(line) );
+    add_line( u_line );
+    return;
+  }
+  split_ascii( line, _words );
+  if ( _words.empty() ){
+    // end a paragraph
+    end_paragraph();
+    return;
   }
-  if ( par && !par_stack.empty() ){
+  _chunk_chars += _words.back().data() + _words.back().size()
+    - _words.front().data();
+  for ( size_t i=0; i < _words.size(); ++i ){
+    UnicodeString w = UnicodeString::fromUTF8( icu::StringPiece( _words[i].data(),
+								  _words[i].size() ) );
+    add_word( w, i == _words.size()-1 );
+  }
+}
+
+bool txt_converter::finish(){
+  /// save the last (or only) document
+  if ( _par && !_par_stack.empty() ){
     // leftovers
-    add_paragraph( par, par_stack );
-    par = 0;
-    par_stack.clear();
+    add_paragraph( _par, _par_stack );
+    _par = 0;
+    _par_stack.clear();
   }
-  if ( parCount == 0 ){
+  Document *d = _text->doc();
+  _text = 0;
+  if ( _par_count == 0 ){
 #pragma omp critical
     {
-      cerr << "no useful data found in document:'" << docid << "'" << endl;
+      cerr << "no useful data found in document:'" << _docid << "'" << endl;
       cerr << "skipped!" << endl;
     }
+    delete d;
     return false;
   }
-#pragma omp critical
-  {
-    string outname = outputDir + nameNoExt + ".folia.xml";
+  if ( _chunk_par_count > 0 ){
+    string outname = outputDir + _chunk_name + ".folia.xml";
+    // the save runs outside any critical section, so threads save in parallel
     d->save( outname );
-    cout << "Processed: " << fileName << " into " << outname
-	 << " still " << --to_do << " files to go." << endl;
+    if ( chunk_size > 0 ){
+      ++_saved;
+#pragma omp critical
+      {
+	cout << "Saved: " << outname << endl;
+      }
+    }
+    else {
+#pragma omp critical
+      {
+	cout << "Processed: " << _file_name << " into " << outname
+	     << " still " << --to_do << " files to go." << endl;
+      }
+    }
   }
   delete d;
+  if ( chunk_size > 0 ){
+#pragma omp taskwait
+#pragma omp critical
+    {
+      cout << "Processed: " << _file_name << " into " << _saved
+	   << " parts, still " << --to_do << " files to go." << endl;
+    }
+  }
   return true;
 }
 
+bool handle_one_file( const string& fileName ){
+  mapped_text mapped;
+  bool is_mapped = mapped.open( fileName );
+  ifstream is;
+  if ( !is_mapped ){
+    // not a regular file. Read it line by line
+    is.open( fileName );
+    if ( !is ){
+#pragma omp critical
+      {
+	cerr << "failed to read " << fileName << endl;
+      }
+      return false;
+    }
+  }
+#pragma omp critical
+  {
+    cout << "Starting " << fileName << endl;
+  }
+  string nameNoExt = fileName;
+  string::size_type pos = fileName.rfind( "." );
+  if ( pos != string::npos ){
+    nameNoExt = fileName.substr(0, pos );
+  }
+  txt_converter converter( fileName, nameNoExt );
+  if ( !converter.init() ){
+    return false;
+  }
+  if ( is_mapped ){
+    string_view buffer = mapped.text();
+    while ( !buffer.empty() ){
+      // memchr is vectorized in every libc we know of
+      const char *eol = static_cast<const char*>( memchr( buffer.data(),
+							  '\n',
+							  buffer.size() ) );
+      size_t len = eol ? eol - buffer.data() : buffer.size();
+      converter.add_line( buffer.substr( 0, len ) );
+      buffer.remove_prefix( eol ? len+1 : len );
+    }
+  }
+  else {
+    UnicodeString line;
+    while ( TiCC::getline( is, line ) ){
+      converter.add_line( line );
+    }
+  }
+  return converter.finish();
+}
+
 int main( int argc, char *argv[] ){
   TiCC::CL_Options opts( "hVt:O:",
 			 "class:,setname:,remove-end-hyphens:,"
-			 "help,version,threads:" );
+			 "help,version,threads:,chunk-size:" );
   try {
     opts.init( argc, argv );
   }
@@ -285,6 +635,20 @@ int main( int argc, char *argv[] ){
   }
   opts.extract( "class", classname );
   opts.extract( "setname", setname );
+  if ( opts.extract( "chunk-size", value ) ){
+    // a stream happily reads "-1" into a size_t, and a huge size in
+    // megabytes would wrap around to a small one in bytes
+    if ( value.find( '-' ) != string::npos
+	 || !TiCC::stringTo( value, chunk_size )
+	 || chunk_size > SIZE_MAX / 1000000 ){
+      cerr << "illegal value for --chunk-size (" << value << ")" << endl;
+      exit( EXIT_FAILURE );
+    }
+    chunk_size *= 1000000;
+  }
+#ifdef HAVE_OPENMP
+  max_pending_chunks = max( size_t(2), size_t(numThreads) );
+#endif
   string h_val;
   if ( opts.extract( "remove-end-hyphens", h_val ) ){
     keep_hyphens = !TiCC::stringTo<bool>( h_val );
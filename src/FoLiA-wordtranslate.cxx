@@ -43,6 +43,7 @@
 #include "ticcutils/Unicode.h"
 #include "libfolia/folia.h"
 #include "foliautils/common_code.h"
+#include "foliautils/mapped_lexicon.h"
 
 #include "config.h"
 #ifdef HAVE_OPENMP
@@ -67,6 +68,8 @@ void usage( const string& name ){
   cerr << "\t-p\t lexicon_file (format: $word\\n); monolingual lexicon of words that are preserved as-is" << endl;
   cerr << "\t-H\t dictionary_file (format: INT historical lexicon dump)" << endl;
   cerr << "\t-l\t language - constraint to language" << endl;
+  cerr << "\t--shared-lexicon\t keep the -d and -H dictionaries in shared memory," << endl;
+  cerr << "\t\t\t for use by other runs with the same dictionaries." << endl;
   cerr << "\t-r or --rules\t rules_file (format: $pattern\\s$replacement\\n)" << endl;
   cerr << "\t--inputclass\t class (default: current)" << endl;
   cerr << "\t--outputclass\t class (default: translated)" << endl;
@@ -94,11 +97,108 @@ namespace std
 }
 
 
-using t_dictionary = unordered_map<UnicodeString,UnicodeString>;
+class translation_table {
+  /// source => target. Either read into this process, or mapped from a
+  /// shared_lexicon
+public:
+  bool find( const UnicodeString&, UnicodeString& ) const;
+  size_t size() const {
+    return image.is_open() ? image.size() : entries.size();
+  };
+  void compile( lexicon_builder& ) const;
+  unordered_map<UnicodeString,UnicodeString> entries;
+  mapped_lexicon image;
+};
+
+bool translation_table::find( const UnicodeString& source,
+			      UnicodeString& target ) const {
+  if ( image.is_open() ){
+    const lexicon_entry *e = image.find( TiCC::UnicodeToUTF8( source ) );
+    if ( !e || !( e->flags & LEX_VALUE ) ){
+      return false;
+    }
+    target = TiCC::UnicodeFromUTF8( string( image.value( *e ) ) );
+    return true;
+  }
+  const auto it = entries.find( source );
+  if ( it == entries.end() ){
+    return false;
+  }
+  target = it->second;
+  return true;
+}
+
+void translation_table::compile( lexicon_builder& builder ) const {
+  for ( const auto& [source,target] : entries ){
+    builder.add_value( TiCC::UnicodeToUTF8( source ),
+		       TiCC::UnicodeToUTF8( target ) );
+  }
+}
+
+class frequency_table {
+  /// key => value => freq. Either read into this process, or mapped from
+  /// a shared_lexicon, where the values are stored as suggestions, with
+  /// the frequency as confidence
+public:
+  void add( const UnicodeString& key, const UnicodeString& value ){
+    entries[key][value]++;
+  };
+  bool most_frequent( const UnicodeString&, UnicodeString& ) const;
+  bool empty() const {
+    return image.is_open() ? image.size() == 0 : entries.empty();
+  };
+  void compile( lexicon_builder& ) const;
+  unordered_map<UnicodeString,unordered_map<UnicodeString,int>> entries;
+  mapped_lexicon image;
+};
+
+bool frequency_table::most_frequent( const UnicodeString& key,
+				     UnicodeString& value ) const {
+  /// find the most frequent value for key (resolves ambiguity harshly)
+  float max = 0;
+  if ( image.is_open() ){
+    const lexicon_entry *e = image.find( TiCC::UnicodeToUTF8( key ) );
+    if ( !e || !( e->flags & LEX_VARIANT ) ){
+      return false;
+    }
+    const lexicon_suggestion *sugg = image.suggestions( *e );
+    for ( size_t i=0; i < e->suggestion_count; ++i ){
+      if ( sugg[i].confidence >= max ){
+	max = sugg[i].confidence;
+	value = TiCC::UnicodeFromUTF8( string( image.word( sugg[i] ) ) );
+      }
+    }
+    return true;
+  }
+  const auto it = entries.find( key );
+  if ( it == entries.end() ){
+    return false;
+  }
+  for ( const auto& iter2 : it->second ){
+    if ( iter2.second >= max ){
+      max = iter2.second;
+      value = iter2.first;
+    }
+  }
+  return true;
+}
+
+void frequency_table::compile( lexicon_builder& builder ) const {
+  // keep the order of the values, so ties are resolved the same way
+  for ( const auto& [key,values] : entries ){
+    for ( const auto& [value,freq] : values ){
+      builder.add_variant( TiCC::UnicodeToUTF8( key ),
+			   TiCC::UnicodeToUTF8( value ),
+			   freq );
+    }
+  }
+}
+
+using t_dictionary = translation_table;
 using t_lexicon = unordered_set<UnicodeString>;
 using t_rules = vector<pair<UnicodeString,UnicodeString>>;
-using t_histdictionary = unordered_map<UnicodeString,unordered_map<UnicodeString,int>>; //dictionary from historical lexicon,    form => lemma => freq
-using t_lemmamap = unordered_map<UnicodeString,unordered_map<UnicodeString,int>>; //lemma => src:lemma_id => freq
+using t_histdictionary = frequency_table; //dictionary from historical lexicon,    form => lemma => freq
+using t_lemmamap = frequency_table; //lemma => src:lemma_id => freq
 
 UnicodeString applyRules( const UnicodeString& orig_source, const t_rules& rules) {
   UnicodeString source = orig_source;
@@ -131,17 +231,9 @@ UnicodeString lemmatiser( Word *word,
   UnicodeString target_flat = target;
   target_flat.toLower();
   if (lemmamap.empty()) return target_flat;
-  const auto& lemmamap_iter = lemmamap.find(target_flat);
-  if (lemmamap_iter != lemmamap.end()) {
-    //resolve ambiguity by majority vote: just select the most frequent lemma->id pair (lexicon contains multiple occurrences)
-    int max = 0;
-    UnicodeString lemma_id;
-    for ( const auto& iter2 : lemmamap_iter->second ){
-      if (iter2.second >= max) {
-	max = iter2.second;
-	lemma_id = iter2.first;
-      }
-    }
+  UnicodeString lemma_id;
+  //resolve ambiguity by majority vote: just select the most frequent lemma->id pair (lexicon contains multiple occurrences)
+  if (lemmamap.most_frequent(target_flat, lemma_id)) {
     {
       KWargs args;
       args["class"] = TiCC::UnicodeToUTF8(lemma_id);
@@ -216,12 +308,12 @@ bool translateDoc( Document *doc,
     string modernisationsource = "none";
     UnicodeString target = source_flat;
     //check if word is in dictionary
-    const auto& entry = dictionary.find(source_flat);
-    const auto& histentry = histdictionary.find(source_flat);
-    if ( entry != dictionary.end()) {
+    UnicodeString translation;
+    UnicodeString histlemma;
+    if ( dictionary.find(source_flat, translation) ) {
       if (outputclass != inputclass) {
 	//TODO: check if outputclass is not already present
-	target = entry->second;
+	target = translation;
 	modernisationsource = "lexicon";
 	changed = true;
         lemmatiser(word, target, lemmamap);
@@ -235,17 +327,11 @@ bool translateDoc( Document *doc,
         lemmatiser(word, source_flat, lemmamap);
     } else {
       //word is NOT in preservation lexicon
-      if (histentry != histdictionary.end()) {
+      //find the most frequent lemma for this word form (resolves ambiguity harshly)
+      if (histdictionary.most_frequent(source_flat, histlemma)) {
 	//word is in INT historical lexicon
 	if (outputclass != inputclass) {
-	  //find the most frequent lemma for this word form (resolves ambiguity harshly)
-	  int max = 0;
-	  for ( const auto& iter2 : histentry->second ){
-	    if (iter2.second >= max) {
-	      max = iter2.second;
-	      target = iter2.first;
-	    }
-	  }
+	  target = histlemma;
 	  modernisationsource = "inthistlexicon";
 	  changed = true;
 	  target = lemmatiser(word, target, lemmamap);
@@ -311,7 +397,7 @@ int loadDictionary(const string & filename, t_dictionary & dictionary) {
       vector<string> parts = TiCC::split_at( line, "\t" );
       if ( parts.size() == 2) {
 	added++;
-	dictionary[TiCC::UnicodeFromUTF8(parts[0])] = TiCC::UnicodeFromUTF8(parts[1]);
+	dictionary.entries[TiCC::UnicodeFromUTF8(parts[0])] = TiCC::UnicodeFromUTF8(parts[1]);
       }
       else {
 	cerr << "WARNING: loadDictionary: error in line " << linenum << ": " << line << endl;
@@ -335,9 +421,9 @@ int loadHistoricalLexicon(const string & filename, t_histdictionary & dictionary
         if (parts[0] != "multiple") { //ignore many=>one
 	  added++;
 	  const UnicodeString lemma = TiCC::UnicodeFromUTF8(parts[4]).toLower();
-	  dictionary[TiCC::UnicodeFromUTF8(parts[6])][lemma]++;
+	  dictionary.add(TiCC::UnicodeFromUTF8(parts[6]), lemma);
 	  const UnicodeString lemma_id = TiCC::UnicodeFromUTF8(parts[1]) + TiCC::UnicodeFromUTF8(":") + TiCC::UnicodeFromUTF8(parts[3]); //e.g: WNT:M078848  or clitics like MNW:57244⊕40508
-	  lemmamap[lemma][lemma_id]++;
+	  lemmamap.add(lemma, lemma_id);
         }
       } else {
 	cerr << "WARNING: loadHistoricalLexicon: error in line " << linenum << ": " << line << endl;
@@ -391,9 +477,25 @@ int loadRules( const string& filename,
   return added;
 }
 
+void share_table( mapped_lexicon& image,
+		  const string& file_name,
+		  const string& part,
+		  const function<void(lexicon_builder&)>& fill ){
+  /// map the shared image of (a part of) file_name, building it first
+  /// when needed
+  try {
+    shared_lexicon segment( "FoLiA-wordtranslate", { file_name }, part );
+    segment.attach( image, fill );
+  }
+  catch ( const exception& e ){
+    cerr << e.what() << endl;
+    exit( EXIT_FAILURE );
+  }
+}
+
 int main( int argc, const char *argv[] ) {
   TiCC::CL_Options opts( "d:e:p:r:vVt:O:RhH:l:",
-			 "inputclass:,outputclass:,version,help,threads:" );
+			 "inputclass:,outputclass:,version,help,threads:,shared-lexicon" );
   try {
     opts.init( argc, argv );
   }
@@ -465,6 +567,7 @@ int main( int argc, const char *argv[] ) {
   opts.extract( "inputclass", inputclass );
   opts.extract( "outputclass", outputclass );
   opts.extract( "expr", expression );
+  bool shared_lex = opts.extract( "shared-lexicon" );
 
   if (inputclass == outputclass) {
     cerr << "Inputclass and outputclass are the same, this is not implemented yet..." << endl;
@@ -473,9 +576,21 @@ int main( int argc, const char *argv[] ) {
 
   string dictionaryfile;
   if ( opts.extract( 'd', dictionaryfile) ){
-    cerr << "Loading dictionary... ";
-    int cnt = loadDictionary(dictionaryfile, dictionary);
-    cerr << cnt << " entries" << endl;
+    if ( shared_lex ){
+      cerr << "Attaching shared dictionary... ";
+      share_table( dictionary.image, dictionaryfile, "dictionary",
+		   [&]( lexicon_builder& builder ){
+		     t_dictionary text;
+		     loadDictionary(dictionaryfile, text);
+		     text.compile( builder );
+		   } );
+      cerr << dictionary.size() << " entries" << endl;
+    }
+    else {
+      cerr << "Loading dictionary... ";
+      int cnt = loadDictionary(dictionaryfile, dictionary);
+      cerr << cnt << " entries" << endl;
+    }
   }
   else {
     cerr << "No dictionary specified" << endl;
@@ -490,9 +605,35 @@ int main( int argc, const char *argv[] ) {
 
   string inthistlexiconfile;
   if ( opts.extract( 'H', inthistlexiconfile) ){
-    cerr << "Loading INT historical lexicon... ";
-    int cnt = loadHistoricalLexicon(inthistlexiconfile, histdictionary, lemmamap);
-    cerr << cnt << " entries" << endl;
+    if ( shared_lex ){
+      cerr << "Attaching shared INT historical lexicon... ";
+      // both tables come from the same file: read it at most once
+      t_histdictionary hist_text;
+      t_lemmamap lemma_text;
+      bool loaded = false;
+      auto load = [&](){
+	if ( !loaded ){
+	  loadHistoricalLexicon(inthistlexiconfile, hist_text, lemma_text);
+	  loaded = true;
+	}
+      };
+      share_table( histdictionary.image, inthistlexiconfile, "forms",
+		   [&]( lexicon_builder& builder ){
+		     load();
+		     hist_text.compile( builder );
+		   } );
+      share_table( lemmamap.image, inthistlexiconfile, "lemmas",
+		   [&]( lexicon_builder& builder ){
+		     load();
+		     lemma_text.compile( builder );
+		   } );
+      cerr << histdictionary.image.size() << " word forms" << endl;
+    }
+    else {
+      cerr << "Loading INT historical lexicon... ";
+      int cnt = loadHistoricalLexicon(inthistlexiconfile, histdictionary, lemmamap);
+      cerr << cnt << " entries" << endl;
+    }
   }
 
   string preservelexiconfile;
@@ -25,9 +25,14 @@
 */
 
 #include <string>
-#include "libfolia/folia.h"
+#include <list>
+#include <map>
+#include <cctype>
+#include <stdexcept>
 #include "libfolia/folia.h"
 #include "libxml/HTMLparser.h"
+#include "libxml/xpath.h"
+#include "libxml/xpathInternals.h"
 #include "foliautils/common_code.h"
 #include "ticcutils/XMLtools.h"
 #include "ticcutils/StringOps.h"
@@ -109,6 +114,269 @@ xmlDoc *getXml( const string& file, zipType& type ){
   }
 }
 
+xml_element_stream::xml_element_stream( const string& file,
+					const string& name ):
+  _name( name ),
+  _type( NORMAL ),
+  _reader( 0 ),
+  _window( 0 ),
+  _current( 0 ),
+  _depth( -1 ),
+  _skip( false ),
+  _error( false )
+{
+  if ( TiCC::match_back( file, ".gz" ) ){
+    _type = GZ;
+  }
+  else if ( TiCC::match_back( file, ".bz2" ) ){
+    _type = BZ2;
+  }
+  if ( _type == BZ2 ){
+    // the reader can't handle bzip2 itself, so decompress in memory.
+    // That is still a lot smaller than the tree.
+    _buffer = TiCC::bz2ReadFile( file );
+    _reader = xmlReaderForMemory( _buffer.c_str(), _buffer.length(),
+				  0, 0, XML_PARSER_OPTIONS );
+  }
+  else {
+    // gzip is handled by the reader
+    _reader = xmlReaderForFile( file.c_str(), 0, XML_PARSER_OPTIONS );
+  }
+  _window = xmlNewDoc( (const xmlChar*)"1.0" );
+  xmlNode *root = xmlNewDocNode( _window, 0, (const xmlChar*)"window", 0 );
+  xmlDocSetRootElement( _window, root );
+}
+
+xml_element_stream::~xml_element_stream(){
+  if ( _reader ){
+    xmlFreeTextReader( _reader );
+  }
+  xmlFreeDoc( _window );
+}
+
+xmlNode *xml_element_stream::read_element( bool& adjacent ){
+  /// read up to the next wanted element, and return a copy of it.
+  /// \param adjacent is set to false when anything but whitespace is
+  /// found between the previous element and this one, or when this one is
+  /// at another depth. Then they were no siblings in the file.
+  /// \return the copy, or 0 at the end of the input
+  adjacent = ( _depth >= 0 );
+  int ret;
+  while ( ( ret = ( _skip ? xmlTextReaderNext( _reader )
+		    : xmlTextReaderRead( _reader ) ) ) == 1 ){
+    _skip = false;
+    int type = xmlTextReaderNodeType( _reader );
+    if ( type == XML_READER_TYPE_WHITESPACE
+	 || type == XML_READER_TYPE_SIGNIFICANT_WHITESPACE ){
+      continue;
+    }
+    int depth = xmlTextReaderDepth( _reader );
+    if ( type == XML_READER_TYPE_ELEMENT
+	 && _name == (const char*)xmlTextReaderConstLocalName( _reader ) ){
+      if ( depth != _depth ){
+	adjacent = false;
+      }
+      _depth = depth;
+      xmlNode *node = xmlTextReaderExpand( _reader );
+      if ( !node ){
+	_error = true;
+	return 0;
+      }
+      // continue after this subtree next time
+      _skip = true;
+      return xmlDocCopyNode( node, _window, 1 );
+    }
+    if ( depth <= _depth ){
+      // something else at the level of the previous element, or above it
+      adjacent = false;
+    }
+  }
+  if ( ret < 0 ){
+    _error = true;
+  }
+  return 0;
+}
+
+xmlNode *xml_element_stream::next(){
+  /// \return the next element, or 0 when there are no more. Check good()
+  /// afterwards, to see if the input was read completely
+  if ( !_reader ){
+    return 0;
+  }
+  xmlNode *root = xmlDocGetRootElement( _window );
+  if ( _current ){
+    // keep the element returned last, as the previous one.
+    // everything before it is not needed anymore
+    while ( root->children != _current ){
+      xmlNode *old = root->children;
+      xmlUnlinkNode( old );
+      xmlFreeNode( old );
+    }
+    _current = _current->next;
+  }
+  else {
+    bool dummy;
+    _current = read_element( dummy );
+    if ( _current ){
+      xmlAddChild( root, _current );
+    }
+  }
+  while ( _current && _current->type != XML_ELEMENT_NODE ){
+    // skip the separators
+    _current = _current->next;
+  }
+  if ( _current && !_current->next ){
+    // read ahead, so _current->next is what it would be in the file
+    bool adjacent;
+    xmlNode *ahead = read_element( adjacent );
+    if ( ahead ){
+      if ( !adjacent ){
+	// keep them apart
+	xmlAddChild( root, xmlNewDocComment( _window,
+					     (const xmlChar*)"gap" ) );
+      }
+      xmlAddChild( root, ahead );
+    }
+  }
+  return _current;
+}
+
+static bool is_named( const xmlNode *node, const string& name ){
+  return node->type == XML_ELEMENT_NODE
+    && name == (const char*)node->name;
+}
+
+list<xmlNode*> child_nodes( const xmlNode *node, const string& path ){
+  /// find the elements below node that match path, without XPath.
+  /// \param path a list of local names, separated by '/'. So
+  /// "TextEquiv/Unicode" gives the same nodes as the XPath
+  /// "./*:TextEquiv/*:Unicode", in the same order
+  list<xmlNode*> result;
+  if ( !node ){
+    return result;
+  }
+  string::size_type pos = path.find( '/' );
+  string name = path.substr( 0, pos );
+  for ( xmlNode *pnt = node->children; pnt; pnt = pnt->next ){
+    if ( is_named( pnt, name ) ){
+      if ( pos == string::npos ){
+	result.push_back( pnt );
+      }
+      else {
+	result.splice( result.end(), child_nodes( pnt, path.substr( pos+1 ) ) );
+      }
+    }
+  }
+  return result;
+}
+
+xmlNode *first_child( const xmlNode *node, const string& path ){
+  /// find the first element below node that matches path, without XPath.
+  /// \param path a list of local names, separated by '/', like for
+  /// child_nodes()
+  /// \return the node, or 0 when there is none
+  if ( !node ){
+    return 0;
+  }
+  string::size_type pos = path.find( '/' );
+  string name = path.substr( 0, pos );
+  for ( xmlNode *pnt = node->children; pnt; pnt = pnt->next ){
+    if ( is_named( pnt, name ) ){
+      if ( pos == string::npos ){
+	return pnt;
+      }
+      xmlNode *hit = first_child( pnt, path.substr( pos+1 ) );
+      if ( hit ){
+	return hit;
+      }
+    }
+  }
+  return 0;
+}
+
+static string expand_any_ns( const string& xpath ){
+  /// replace every '*:Name' in xpath by "*[local-name()='Name']", the same
+  /// way TiCC::FindNodes does
+  string result;
+  string::size_type pos = 0;
+  while ( pos < xpath.size() ){
+    string::size_type hit = xpath.find( "*:", pos );
+    if ( hit == string::npos ){
+      result += xpath.substr( pos );
+      break;
+    }
+    result += xpath.substr( pos, hit - pos );
+    string::size_type end = hit + 2;
+    while ( end < xpath.size()
+	    && ( std::isalnum( static_cast<unsigned char>( xpath[end] ) )
+		 || xpath[end] == '_'
+		 || xpath[end] == '-'
+		 || xpath[end] == '.' ) ){
+      ++end;
+    }
+    result += "*[local-name()='" + xpath.substr( hit+2, end-hit-2 ) + "']";
+    pos = end;
+  }
+  return result;
+}
+
+class xpath_cache {
+  /// the compiled XPath expressions of one thread
+public:
+  ~xpath_cache(){
+    for ( const auto& it : _compiled ){
+      xmlXPathFreeCompExpr( it.second );
+    }
+  }
+  xmlXPathCompExpr *get( const string& xpath ){
+    auto it = _compiled.find( xpath );
+    if ( it != _compiled.end() ){
+      return it->second;
+    }
+    string expanded = expand_any_ns( xpath );
+    xmlXPathCompExpr *comp = xmlXPathCompile( (const xmlChar*)expanded.c_str() );
+    if ( !comp ){
+      throw runtime_error( "invalid XPath expression: '" + xpath + "'" );
+    }
+    _compiled[xpath] = comp;
+    return comp;
+  }
+private:
+  map<string,xmlXPathCompExpr*> _compiled;
+};
+
+list<xmlNode*> find_nodes( const xmlNode *node, const string& xpath ){
+  /// evaluate xpath with node as context, like TiCC::FindNodes, but every
+  /// expression is compiled only once per thread.
+  /// '*:Name' matches Name in any namespace. Other prefixes are those
+  /// declared on the root of the document
+  thread_local xpath_cache cache;
+  list<xmlNode*> result;
+  if ( !node || !node->doc ){
+    return result;
+  }
+  xmlXPathCompExpr *comp = cache.get( xpath );
+  xmlXPathContext *ctxt = xmlXPathNewContext( node->doc );
+  xmlNode *root = xmlDocGetRootElement( node->doc );
+  for ( const xmlNs *ns = root ? root->nsDef : 0; ns; ns = ns->next ){
+    if ( ns->prefix ){
+      xmlXPathRegisterNs( ctxt, ns->prefix, ns->href );
+    }
+  }
+  ctxt->node = const_cast<xmlNode*>( node );
+  xmlXPathObject *obj = xmlXPathCompiledEval( comp, ctxt );
+  if ( obj ){
+    if ( obj->type == XPATH_NODESET && obj->nodesetval ){
+      for ( int i=0; i < obj->nodesetval->nodeNr; ++i ){
+	result.push_back( obj->nodesetval->nodeTab[i] );
+      }
+    }
+    xmlXPathFreeObject( obj );
+  }
+  xmlXPathFreeContext( ctxt );
+  return result;
+}
+
 bool isalnum( UChar uc ){
   int8_t charT =  u_charType( uc );
   return ( charT == U_LOWERCASE_LETTER ||
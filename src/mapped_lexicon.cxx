@@ -0,0 +1,623 @@
+/*
+  Copyright (c) 2014 - 2024
+  CLST  - Radboud University
+  ILK   - Tilburg University
+
+  This file is part of foliautils
+
+  foliautils is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 3 of the License, or
+  (at your option) any later version.
+
+  foliautils is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+  For questions and suggestions, see:
+      https://github.com/LanguageMachines/foliautils/issues
+  or send mail to:
+      lamasoftware (at ) science.ru.nl
+*/
+
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <cstdlib>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "foliautils/mapped_lexicon.h"
+
+using namespace std;
+
+// the hash functions are part of the file format. Never change them without
+// raising LEXICON_VERSION
+
+static uint64_t lex_hash( string_view key ){
+  // FNV-1a
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for ( const auto& c : key ){
+    h ^= static_cast<unsigned char>(c);
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+static uint64_t lex_mix( uint64_t h ){
+  // the splitmix64 finalizer
+  h ^= h >> 30;
+  h *= 0xbf58476d1ce4e5b9ULL;
+  h ^= h >> 27;
+  h *= 0x94d049bb133111ebULL;
+  h ^= h >> 31;
+  return h;
+}
+
+static uint64_t lex_slot( uint64_t h, uint32_t seed, uint64_t slots ){
+  return lex_mix( h ^ ( (seed+1) * 0x9e3779b97f4a7c15ULL ) ) % slots;
+}
+
+static uint64_t align8( uint64_t pos ){
+  return (pos + 7) & ~uint64_t(7);
+}
+
+static uint64_t align64( uint64_t pos ){
+  return (pos + 63) & ~uint64_t(63);
+}
+
+static bool fits( uint64_t offset, uint64_t count, size_t size,
+		  uint64_t alignment, uint64_t file_size ){
+  /// do count elements of size bytes at offset fit in a file of file_size?
+  /// offset must be a multiple of alignment
+  return offset % alignment == 0
+    && offset <= file_size
+    && count <= ( file_size - offset ) / size;
+}
+
+void lexicon_filter::init( size_t tokens ){
+  size_t count = 1;
+  while ( count * 512 < tokens * 12 ){
+    count *= 2;
+  }
+  _own.assign( count, filter_block() );
+  _blocks = _own.data();
+  _mask = count - 1;
+}
+
+void lexicon_filter::attach( const filter_block *blocks, size_t count ){
+  /// use count blocks stored elsewhere. count must be a power of 2
+  _own.clear();
+  _blocks = count > 0 ? blocks : 0;
+  _mask = count - 1;
+}
+
+void lexicon_filter::add( string_view token ){
+  uint64_t h = lex_mix( lex_hash( token ) );
+  filter_block& b = _own[h & _mask];
+  uint64_t bits = lex_mix( h );
+  for ( int i=0; i < 6; ++i ){
+    unsigned int pos = bits & 511;
+    b.bits[pos >> 6] |= uint64_t(1) << ( pos & 63 );
+    bits >>= 9;
+  }
+}
+
+void lexicon_filter::add_tokens( string_view key ){
+  /// add every LEXICON_SEPARATOR separated token of key
+  while ( true ){
+    size_t pos = key.find( LEXICON_SEPARATOR );
+    add( key.substr( 0, pos ) );
+    if ( pos == string_view::npos ){
+      break;
+    }
+    key.remove_prefix( pos+1 );
+  }
+}
+
+bool lexicon_filter::may_contain( string_view token ) const {
+  if ( _blocks == 0 ){
+    // not initialized, so no opinion
+    return true;
+  }
+  uint64_t h = lex_mix( lex_hash( token ) );
+  const filter_block& b = _blocks[h & _mask];
+  uint64_t bits = lex_mix( h );
+  for ( int i=0; i < 6; ++i ){
+    unsigned int pos = bits & 511;
+    if ( !( b.bits[pos >> 6] & ( uint64_t(1) << ( pos & 63 ) ) ) ){
+      return false;
+    }
+    bits >>= 9;
+  }
+  return true;
+}
+
+uint64_t lexicon_builder::intern( const string& s ){
+  const auto it = _interned.find( s );
+  if ( it != _interned.end() ){
+    return it->second;
+  }
+  uint64_t offset = _pool.size();
+  _pool += s;
+  _interned[s] = offset;
+  return offset;
+}
+
+lexicon_suggestion lexicon_builder::intern( const string& word, float conf ){
+  lexicon_suggestion result;
+  result.word_offset = intern( word );
+  result.word_length = word.size();
+  result.confidence = conf;
+  return result;
+}
+
+lexicon_builder::key_rec& lexicon_builder::get_key( const string& key ){
+  const auto it = _index.find( key );
+  if ( it != _index.end() ){
+    return _keys[it->second];
+  }
+  _index[key] = _keys.size();
+  key_rec rec;
+  rec.key_offset = intern( key );
+  rec.key_length = key.size();
+  _keys.push_back( rec );
+  return _keys.back();
+}
+
+void lexicon_builder::add_variant( const string& key,
+				   const string& word,
+				   float conf ){
+  key_rec& rec = get_key( key );
+  rec.flags |= LEX_VARIANT;
+  rec.suggestions.push_back( intern( word, conf ) );
+}
+
+void lexicon_builder::add_unknown( const string& key ){
+  key_rec& rec = get_key( key );
+  rec.flags |= LEX_UNKNOWN;
+}
+
+void lexicon_builder::add_value( const string& key, const string& value ){
+  key_rec& rec = get_key( key );
+  rec.flags |= LEX_VALUE;
+  rec.value_offset = intern( value );
+  rec.value_length = value.size();
+}
+
+void lexicon_builder::save( const string& file_name ) const {
+  /// build a perfect hash over all keys ("hash and displace") and write
+  /// the complete image to file_name
+  lexicon_header header;
+  memset( &header, 0, sizeof(header) );
+  memcpy( header.magic, LEXICON_MAGIC, sizeof(LEXICON_MAGIC) );
+  header.version = LEXICON_VERSION;
+  header.ngram_size = _ngram_size;
+  header.source_stamp = _stamp;
+  header.num_sugg = _num_sugg;
+  header.key_count = _keys.size();
+  header.bucket_count = _keys.size() / 4 + 1;
+  header.slot_count = _keys.size() + _keys.size() / 9 + 1;
+  // distribute the keys over the buckets
+  vector<uint64_t> hashes( _keys.size() );
+  vector<vector<uint32_t>> buckets( header.bucket_count );
+  for ( size_t i=0; i < _keys.size(); ++i ){
+    string_view key( _pool.data() + _keys[i].key_offset,
+		     _keys[i].key_length );
+    hashes[i] = lex_hash( key );
+    buckets[hashes[i] % header.bucket_count].push_back( i );
+  }
+  // place the largest buckets first, while the table is still empty
+  vector<uint32_t> order( header.bucket_count );
+  for ( size_t b=0; b < order.size(); ++b ){
+    order[b] = b;
+  }
+  stable_sort( order.begin(), order.end(),
+	       [&buckets]( uint32_t a, uint32_t b ){
+		 return buckets[a].size() > buckets[b].size(); } );
+  vector<uint32_t> seeds( header.bucket_count, 0 );
+  vector<int64_t> slot_key( header.slot_count, -1 );
+  vector<uint64_t> candidate;
+  for ( const auto& b : order ){
+    const vector<uint32_t>& bucket = buckets[b];
+    if ( bucket.empty() ){
+      break;
+    }
+    uint32_t seed = 0;
+    while ( true ){
+      candidate.clear();
+      bool ok = true;
+      for ( const auto& k : bucket ){
+	uint64_t slot = lex_slot( hashes[k], seed, header.slot_count );
+	if ( slot_key[slot] >= 0
+	     || find( candidate.begin(), candidate.end(), slot )
+	     != candidate.end() ){
+	  ok = false;
+	  break;
+	}
+	candidate.push_back( slot );
+      }
+      if ( ok ){
+	break;
+      }
+      if ( ++seed == 0x1000000 ){
+	throw runtime_error( "lexicon_builder: unable to find a perfect hash."
+			     " Duplicate keys?" );
+      }
+    }
+    seeds[b] = seed;
+    for ( size_t i=0; i < bucket.size(); ++i ){
+      slot_key[candidate[i]] = bucket[i];
+    }
+  }
+  // now fill the slots, and lay out the suggestions per slot
+  vector<lexicon_entry> slots( header.slot_count );
+  memset( slots.data(), 0, slots.size() * sizeof(lexicon_entry) );
+  vector<lexicon_suggestion> suggestions;
+  for ( size_t s=0; s < slots.size(); ++s ){
+    if ( slot_key[s] < 0 ){
+      continue;
+    }
+    const key_rec& rec = _keys[slot_key[s]];
+    lexicon_entry& e = slots[s];
+    e.key_offset = rec.key_offset;
+    e.key_length = rec.key_length;
+    e.value_offset = rec.value_offset;
+    e.value_length = rec.value_length;
+    e.flags = rec.flags;
+    e.first_suggestion = suggestions.size();
+    e.suggestion_count = rec.suggestions.size();
+    suggestions.insert( suggestions.end(),
+			rec.suggestions.begin(), rec.suggestions.end() );
+  }
+  // the filter gets the tokens of all keys
+  size_t token_count = 0;
+  for ( const auto& rec : _keys ){
+    string_view key( _pool.data() + rec.key_offset, rec.key_length );
+    token_count += count( key.begin(), key.end(), LEXICON_SEPARATOR ) + 1;
+  }
+  lexicon_filter filter;
+  filter.init( token_count );
+  for ( const auto& rec : _keys ){
+    filter.add_tokens( string_view( _pool.data() + rec.key_offset,
+				    rec.key_length ) );
+  }
+  header.filter_blocks = filter.block_count();
+  header.suggestion_count = suggestions.size();
+  header.pool_size = _pool.size();
+  header.seeds_offset = align8( sizeof(header) );
+  header.slots_offset
+    = align8( header.seeds_offset + seeds.size() * sizeof(uint32_t) );
+  header.suggestions_offset
+    = align8( header.slots_offset + slots.size() * sizeof(lexicon_entry) );
+  header.pool_offset
+    = align8( header.suggestions_offset
+	      + suggestions.size() * sizeof(lexicon_suggestion) );
+  header.filter_offset = align64( header.pool_offset + _pool.size() );
+  header.file_size = header.filter_offset
+    + header.filter_blocks * sizeof(filter_block);
+
+  // write to a temporary first, so readers never map a half-written file.
+  // It has a unique name, so concurrent builders of the same file don't
+  // truncate each other's temporary
+  string tmp_name = file_name + ".XXXXXX";
+  int fd = mkstemp( &tmp_name[0] );
+  if ( fd < 0 ){
+    throw runtime_error( "lexicon_builder: unable to create a temporary"
+			 " file for '" + file_name + "'" );
+  }
+  // mkstemp() makes it private, but other processes must map it too
+  fchmod( fd, 0644 );
+  ::close( fd );
+  ofstream os( tmp_name, ios::binary | ios::trunc );
+  if ( !os ){
+    remove( tmp_name.c_str() );
+    throw runtime_error( "lexicon_builder: unable to open '" + tmp_name
+			 + "' for writing" );
+  }
+  auto pad_to = [&os]( uint64_t pos ){
+    while ( static_cast<uint64_t>(os.tellp()) < pos ){
+      os.put( '\0' );
+    }
+  };
+  os.write( reinterpret_cast<const char*>(&header), sizeof(header) );
+  pad_to( header.seeds_offset );
+  os.write( reinterpret_cast<const char*>(seeds.data()),
+	    seeds.size() * sizeof(uint32_t) );
+  pad_to( header.slots_offset );
+  os.write( reinterpret_cast<const char*>(slots.data()),
+	    slots.size() * sizeof(lexicon_entry) );
+  pad_to( header.suggestions_offset );
+  os.write( reinterpret_cast<const char*>(suggestions.data()),
+	    suggestions.size() * sizeof(lexicon_suggestion) );
+  pad_to( header.pool_offset );
+  os.write( _pool.data(), _pool.size() );
+  pad_to( header.filter_offset );
+  os.write( reinterpret_cast<const char*>(filter.blocks()),
+	    header.filter_blocks * sizeof(filter_block) );
+  os.close();
+  if ( !os ){
+    remove( tmp_name.c_str() );
+    throw runtime_error( "lexicon_builder: writing '" + tmp_name
+			 + "' failed" );
+  }
+  if ( rename( tmp_name.c_str(), file_name.c_str() ) != 0 ){
+    remove( tmp_name.c_str() );
+    throw runtime_error( "lexicon_builder: unable to rename '" + tmp_name
+			 + "' to '" + file_name + "'" );
+  }
+}
+
+mapped_lexicon::mapped_lexicon():
+  _map(0),
+  _map_size(0),
+  _header(0),
+  _seeds(0),
+  _slots(0),
+  _suggestions(0),
+  _pool(0)
+{
+}
+
+mapped_lexicon::~mapped_lexicon(){
+  close();
+}
+
+void mapped_lexicon::close(){
+  if ( _map ){
+    munmap( _map, _map_size );
+  }
+  _map = 0;
+  _map_size = 0;
+  _header = 0;
+  _filter.attach( 0, 0 );
+}
+
+void mapped_lexicon::open( const string& file_name ){
+  /// map the compiled lexicon file_name read-only into memory.
+  /// The pages are shared with every other process mapping the same file
+  close();
+  int fd = ::open( file_name.c_str(), O_RDONLY );
+  if ( fd < 0 ){
+    throw runtime_error( "mapped_lexicon: unable to open '" + file_name
+			 + "'" );
+  }
+  struct stat st;
+  if ( fstat( fd, &st ) != 0
+       || static_cast<size_t>(st.st_size) < sizeof(lexicon_header) ){
+    ::close( fd );
+    throw runtime_error( "mapped_lexicon: '" + file_name
+			 + "' is not a compiled lexicon" );
+  }
+  void *map = mmap( 0, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+  ::close( fd );
+  if ( map == MAP_FAILED ){
+    throw runtime_error( "mapped_lexicon: unable to map '" + file_name
+			 + "'" );
+  }
+  const lexicon_header *header = static_cast<const lexicon_header*>(map);
+  if ( memcmp( header->magic, LEXICON_MAGIC, sizeof(LEXICON_MAGIC) ) != 0
+       || header->file_size != static_cast<uint64_t>(st.st_size) ){
+    munmap( map, st.st_size );
+    throw runtime_error( "mapped_lexicon: '" + file_name
+			 + "' is not a compiled lexicon" );
+  }
+  if ( header->version != LEXICON_VERSION ){
+    munmap( map, st.st_size );
+    throw runtime_error( "mapped_lexicon: '" + file_name
+			 + "' has version " + to_string(header->version)
+			 + ", expected " + to_string(LEXICON_VERSION)
+			 + ". Please recompile it." );
+  }
+  // every section must lie inside the file, or find() reads past the map
+  uint64_t size = header->file_size;
+  uint64_t blocks = header->filter_blocks;
+  if ( header->bucket_count == 0
+       || header->slot_count == 0
+       || header->key_count > header->slot_count
+       || blocks == 0
+       || ( blocks & ( blocks - 1 ) ) != 0
+       || !fits( header->seeds_offset, header->bucket_count,
+		 sizeof(uint32_t), 8, size )
+       || !fits( header->slots_offset, header->slot_count,
+		 sizeof(lexicon_entry), 8, size )
+       || !fits( header->suggestions_offset, header->suggestion_count,
+		 sizeof(lexicon_suggestion), 8, size )
+       || !fits( header->pool_offset, header->pool_size, 1, 8, size )
+       || !fits( header->filter_offset, blocks,
+		 sizeof(filter_block), 64, size ) ){
+    munmap( map, st.st_size );
+    throw runtime_error( "mapped_lexicon: '" + file_name
+			 + "' is not a compiled lexicon" );
+  }
+  _map = map;
+  _map_size = st.st_size;
+  _header = header;
+  const char *base = static_cast<const char*>(map);
+  _seeds = reinterpret_cast<const uint32_t*>(base + header->seeds_offset);
+  _slots = reinterpret_cast<const lexicon_entry*>(base + header->slots_offset);
+  _suggestions = reinterpret_cast<const lexicon_suggestion*>(base + header->suggestions_offset);
+  _pool = base + header->pool_offset;
+  _filter.attach( reinterpret_cast<const filter_block*>(base + header->filter_offset),
+		  header->filter_blocks );
+}
+
+const lexicon_entry *mapped_lexicon::find( string_view key ) const {
+  /// lookup key. returns 0 when not found, or when no lexicon is open
+  if ( !_header ){
+    return 0;
+  }
+  uint64_t h = lex_hash( key );
+  uint32_t seed = _seeds[h % _header->bucket_count];
+  const lexicon_entry *e = &_slots[lex_slot( h, seed, _header->slot_count )];
+  if ( e->flags == 0
+       || e->key_length != key.size() ){
+    return 0;
+  }
+  // the entry must point inside the pool and the suggestions, also in a
+  // damaged file
+  uint64_t pool_size = _header->pool_size;
+  if ( e->key_offset > pool_size
+       || e->key_length > pool_size - e->key_offset ){
+    throw runtime_error( "mapped_lexicon: the lexicon is corrupted" );
+  }
+  if ( memcmp( _pool + e->key_offset, key.data(), key.size() ) != 0 ){
+    return 0;
+  }
+  if ( e->value_offset > pool_size
+       || e->value_length > pool_size - e->value_offset
+       || e->first_suggestion > _header->suggestion_count
+       || e->suggestion_count
+       > _header->suggestion_count - e->first_suggestion ){
+    throw runtime_error( "mapped_lexicon: the lexicon is corrupted" );
+  }
+  const lexicon_suggestion *sugg = _suggestions + e->first_suggestion;
+  for ( size_t i=0; i < e->suggestion_count; ++i ){
+    if ( sugg[i].word_offset > pool_size
+	 || sugg[i].word_length > pool_size - sugg[i].word_offset ){
+      throw runtime_error( "mapped_lexicon: the lexicon is corrupted" );
+    }
+  }
+  return e;
+}
+
+static string hex64( uint64_t h ){
+  static const char digits[] = "0123456789abcdef";
+  string result( 16, '0' );
+  for ( int i=15; i >= 0; --i ){
+    result[i] = digits[h & 0xf];
+    h >>= 4;
+  }
+  return result;
+}
+
+static string shared_dir(){
+  const char *env = getenv( "FOLIAUTILS_SHM_DIR" );
+  if ( env && *env ){
+    return env;
+  }
+  struct stat st;
+  if ( stat( "/dev/shm", &st ) == 0 && S_ISDIR( st.st_mode ) ){
+    return "/dev/shm";
+  }
+  return "/tmp";
+}
+
+shared_lexicon::shared_lexicon( const string& tool,
+				const vector<string>& sources,
+				const string& params ){
+  /// tool and params are part of the identity of the image, so tools (or
+  /// runs with other settings) that build a different lexicon from the
+  /// same files don't share it.
+  string name = tool + '\n' + params;
+  string stamp = name + '\n' + to_string( LEXICON_VERSION );
+  for ( const auto& source : sources ){
+    char *real = realpath( source.c_str(), 0 );
+    struct stat st;
+    if ( !real || stat( real, &st ) != 0 ){
+      free( real );
+      throw runtime_error( "shared_lexicon: unable to find '" + source
+			   + "'" );
+    }
+    name += '\n' + string(real);
+    stamp += '\n' + string(real)
+      + '\t' + to_string( st.st_size )
+      + '\t' + to_string( st.st_mtim.tv_sec )
+      + '.' + to_string( st.st_mtim.tv_nsec );
+    free( real );
+  }
+  _file_name = shared_dir() + "/foliautils-" + tool + "-"
+    + hex64( lex_mix( lex_hash( name ) ) ) + ".lex";
+  _stamp = lex_mix( lex_hash( stamp ) );
+}
+
+bool shared_lexicon::open_current( mapped_lexicon& image ) const {
+  /// map the published image, when it is there and up to date
+  struct stat st;
+  if ( stat( _file_name.c_str(), &st ) != 0 ){
+    return false;
+  }
+  try {
+    image.open( _file_name );
+  }
+  catch ( const runtime_error& ){
+    // an older format, or a stale file. It will be replaced
+    return false;
+  }
+  if ( image.source_stamp() != _stamp ){
+    image.close();
+    return false;
+  }
+  return true;
+}
+
+bool shared_lexicon::attach( mapped_lexicon& image,
+			     const function<void(lexicon_builder&)>& fill,
+			     size_t ngram,
+			     size_t nums ) const {
+  /// map the published image into 'image'. When there is none yet, or the
+  /// sources changed, fill() is called to build it, and it is published.
+  /// Only one process builds at a time: the others wait, and then map its
+  /// result.
+  /// returns true when an existing image was used, false when it was built
+  if ( open_current( image ) ){
+    return true;
+  }
+  string lock_name = _file_name + ".lock";
+  int fd = -1;
+  while ( true ){
+    fd = ::open( lock_name.c_str(), O_RDWR | O_CREAT, 0666 );
+    if ( fd < 0 ){
+      throw runtime_error( "shared_lexicon: unable to open '" + lock_name
+			   + "'" );
+    }
+    if ( flock( fd, LOCK_EX ) != 0 ){
+      ::close( fd );
+      throw runtime_error( "shared_lexicon: unable to lock '" + lock_name
+			   + "'" );
+    }
+    // the holder before us removes the lock file when it is done. When it
+    // did, our lock is on a file that nobody else will see, so start over
+    struct stat locked;
+    struct stat current;
+    if ( fstat( fd, &locked ) == 0
+	 && stat( lock_name.c_str(), &current ) == 0
+	 && locked.st_dev == current.st_dev
+	 && locked.st_ino == current.st_ino ){
+      break;
+    }
+    ::close( fd );
+  }
+  auto unlock = [&](){
+    unlink( lock_name.c_str() );
+    ::close( fd );
+  };
+  try {
+    if ( open_current( image ) ){
+      // published while we were waiting
+      unlock();
+      return true;
+    }
+    lexicon_builder builder( ngram, nums );
+    builder.set_stamp( _stamp );
+    fill( builder );
+    builder.save( _file_name );
+  }
+  catch ( ... ){
+    unlock();
+    throw;
+  }
+  unlock();
+  image.open( _file_name );
+  return false;
+}
@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+#
+# a local stand-in for the resolver that FoLiA-alto fetches ALTO files from.
+# usage: altoserver.py <alto dir> <port file> <log file> [loop|badchunk]
+#
+# /resolve?urn=<urn> redirects (alternately with an absolute and a relative
+# Location) to /alto/<urn>, which serves the cached ALTO file for that urn.
+# Connections are kept alive, but every connection is dropped without an
+# answer on its 4th request, like a server that closes an idle connection.
+# The first request for page 0005 gets a 503, so it has to be retried.
+# With 'loop', page 0010 redirects to itself forever.
+# With 'badchunk', the first chunked answer for page 0007 has a malformed
+# chunk size line.
+
+import http.server
+import os
+import sys
+import urllib.parse
+
+alto_dir, port_file, log_file = sys.argv[1:4]
+mode = sys.argv[4] if len(sys.argv) > 4 else ""
+loop = mode == "loop"
+badchunk = mode == "badchunk"
+seen = set()
+redirects = 0
+
+
+def log(event):
+    with open(log_file, "a") as f:
+        f.write(event + "\n")
+
+
+def cache_name(urn):
+    # the same name that FoLiA-alto gives the file in its cache
+    return urn.replace(":mpeg21", "").replace(":", "_") + ".xml"
+
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def setup(self):
+        super().setup()
+        self.served = 0
+        log("connection")
+
+    def answer(self, status, body=b"", headers=(), chunked=False,
+               malformed=False):
+        self.send_response(status)
+        for key, value in headers:
+            self.send_header(key, value)
+        if chunked:
+            self.send_header("Transfer-Encoding", "chunked")
+            self.end_headers()
+            for pos in range(0, len(body), 4096):
+                part = body[pos:pos+4096]
+                if malformed:
+                    # no hex digits, so it is not a size, and certainly
+                    # not the size 0 of the last chunk
+                    self.wfile.write(b"x%x\r\n" % len(part))
+                    self.close_connection = True
+                    return
+                self.wfile.write(b"%x\r\n%s\r\n" % (len(part), part))
+            self.wfile.write(b"0\r\n\r\n")
+        else:
+            self.send_header("Content-Length", str(len(body)))
+            self.end_headers()
+            self.wfile.write(body)
+
+    def do_GET(self):
+        global redirects
+        self.served += 1
+        if self.served == 4:
+            log("dropped")
+            self.close_connection = True
+            return
+        if self.served > 1:
+            log("reused")
+        url = urllib.parse.urlsplit(self.path)
+        if url.path == "/resolve":
+            urn = urllib.parse.parse_qs(url.query)["urn"][0]
+            if loop and ":0010:" in urn:
+                location = self.path
+            else:
+                location = "/alto/" + urn
+            redirects += 1
+            if redirects % 2:
+                location = "http://%s%s" % (self.headers["Host"], location)
+            log("redirect")
+            self.answer(302, headers=[("Location", location)])
+            return
+        if url.path.startswith("/alto/"):
+            urn = url.path[len("/alto/"):]
+            if ":0005:" in urn and urn not in seen:
+                seen.add(urn)
+                log("unavailable")
+                self.answer(503)
+                return
+            try:
+                with open(os.path.join(alto_dir, cache_name(urn)), "rb") as f:
+                    body = f.read()
+            except OSError:
+                self.answer(404)
+                return
+            malformed = False
+            if badchunk and ":0007:" in urn and "bad " + urn not in seen:
+                seen.add("bad " + urn)
+                log("malformed")
+                malformed = True
+            self.answer(200, body, [("Content-Type", "text/xml")],
+                        chunked=":0002:" in urn or ":0007:" in urn,
+                        malformed=malformed)
+            return
+        self.answer(404)
+
+    def log_message(self, format, *args):
+        pass
+
+
+server = http.server.ThreadingHTTPServer(("127.0.0.1", 0), Handler)
+with open(port_file + ".tmp", "w") as f:
+    f.write(str(server.server_address[1]))
+os.rename(port_file + ".tmp", port_file)
+server.serve_forever()